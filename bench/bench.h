@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* report helpers shared by benchmarks, text for reading and one line JSON
+ * for comparing across commits
+ */
+
+#ifndef MNET_BENCH_H
+#define MNET_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "mnet_core.h"
+
+/* resident bytes from /proc, 0 for unsupported */
+static inline int64_t
+bench_rss_bytes(void) {
+   long pages = 0, rss = 0;
+   FILE *fp = fopen("/proc/self/statm", "r");
+   if (fp) {
+      if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+         rss = 0;
+      }
+      fclose(fp);
+   }
+   return (int64_t)rss * sysconf(_SC_PAGESIZE);
+}
+
+/* "p50":..,"p99":..,"p999":..,"max":..,"mean":.. */
+static inline void
+bench_json_hist(FILE *fp, const char *name, const mnet_hist_t *h) {
+   fprintf(fp, "\"%s\":{\"count\":%llu,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,\"mean\":%.1f}",
+           name, (unsigned long long)h->count,
+           (unsigned long long)mnet_hist_percentile(h, 50),
+           (unsigned long long)mnet_hist_percentile(h, 99),
+           (unsigned long long)mnet_hist_percentile(h, 99.9),
+           (unsigned long long)h->max,
+           h->count > 0 ? (double)h->sum / h->count : 0.0);
+}
+
+static inline void
+bench_print_hist(FILE *fp, const char *name, const char *unit, const mnet_hist_t *h) {
+   fprintf(fp, "%-12s p50 %llu %s, p99 %llu %s, p999 %llu %s, max %llu %s, mean %.1f %s\n", name,
+           (unsigned long long)mnet_hist_percentile(h, 50), unit,
+           (unsigned long long)mnet_hist_percentile(h, 99), unit,
+           (unsigned long long)mnet_hist_percentile(h, 99.9), unit,
+           (unsigned long long)h->max, unit,
+           h->count > 0 ? (double)h->sum / h->count : 0.0, unit);
+}
+
+#endif
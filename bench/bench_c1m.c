@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* C1M idle connections against one mnet loop, forked client connect with
+ * raw sockets from multiple loopback source IPs, server hold accepted channs
+ * with heartbeat timer, then report memory, poll and timer cost
+ *
+ * for 1M, run as root or raise 'ulimit -n' over 1M for both processes, and
+ * net.ipv4.ip_local_port_range for more ports each source IP
+ */
+
+#ifdef BENCH_C1M_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "mnet_core.h"
+#include "bench.h"
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24  /* Linux 4.2, share source port by 4-tuple */
+#endif
+
+#define kConnsPerIp 25000       // under default ephemeral ports range
+
+typedef struct {
+   int conns;
+   int ips;                     // client source IPs from 127.0.0.2
+   int heartbeat;               // seconds
+   int duration;                // hold seconds
+   int json;
+   chann_addr_t addr;
+} conf_t;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-a ip:port] [-n conns] [-i source_ips] [-b heartbeat_seconds] [-d hold_seconds] [-j]\n", argv[0]);
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->conns = 1000000;
+   conf->heartbeat = 30;
+   conf->duration = 30;
+   const char *ipport = "127.0.0.1:9093";
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "a:n:i:b:d:jh")) != -1) {
+      switch (opt) {
+         case 'a': ipport = optarg; break;
+         case 'n': conf->conns = atoi(optarg); break;
+         case 'i': conf->ips = atoi(optarg); break;
+         case 'b': conf->heartbeat = atoi(optarg); break;
+         case 'd': conf->duration = atoi(optarg); break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   if (conf->ips <= 0) {
+      conf->ips = (conf->conns + kConnsPerIp - 1) / kConnsPerIp;
+   }
+   return mnet_parse_ipport(ipport, &conf->addr) > 0 && conf->conns > 0 &&
+      conf->ips > 0 && conf->ips < 250 && conf->heartbeat > 0 && conf->duration > 0;
+}
+
+/* raise to hard limit, return max fds */
+static int
+_raise_nofile(int want) {
+   struct rlimit rl;
+   if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+      return 0;
+   }
+   rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > (rlim_t)want) ? (rlim_t)want : rl.rlim_max;
+   if (setrlimit(RLIMIT_NOFILE, &rl) < 0 && rl.rlim_cur < (rlim_t)want) {
+      getrlimit(RLIMIT_NOFILE, &rl);
+   }
+   return (int)rl.rlim_cur;
+}
+
+static inline double
+_cpu_us(void) {
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/* client with raw blocking connects, report connected count then wait
+ */
+
+static void
+_run_client(conf_t *conf, int report_fd) {
+   struct sockaddr_in peer;
+   memset(&peer, 0, sizeof(peer));
+   peer.sin_family = AF_INET;
+   peer.sin_port = htons(conf->addr.port);
+   peer.sin_addr.s_addr = inet_addr(conf->addr.ip);
+
+   int connected = 0;
+   for (int i=0; i<conf->conns; i++) {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (fd < 0) {
+         printf("client socket %d: %s\n", i, strerror(errno));
+         break;
+      }
+      struct sockaddr_in src;
+      memset(&src, 0, sizeof(src));
+      src.sin_family = AF_INET;
+      src.sin_addr.s_addr = htonl(0x7f000002 + i % conf->ips); // 127.0.0.2 ~
+      int on = 1;
+      setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+      if (bind(fd, (struct sockaddr *)&src, sizeof(src)) < 0 ||
+          connect(fd, (struct sockaddr *)&peer, sizeof(peer)) < 0)
+      {
+         printf("client connect %d: %s\n", i, strerror(errno));
+         close(fd);
+         break;
+      }
+      connected++;
+   }
+   if (write(report_fd, &connected, sizeof(connected)) != sizeof(connected)) {
+      perror("report connected");
+   }
+   for (;;) {
+      pause();                  // heartbeats stay in socket buffer
+   }
+}
+
+/* server loop
+ */
+
+typedef struct {
+   int accepted;
+   int connected;               // from client, -1 for not finished
+   uint64_t heartbeats;
+   int64_t rss_base;
+   int64_t rss_hold;
+   double hold_seconds;
+   double hold_cpu_us;
+   uint64_t polls;
+   mnet_mem_t mem;
+   mnet_loop_hist_t hist;
+} ctx_t;
+
+static void
+_process(ctx_t *ctx, conf_t *conf, chann_t *svr) {
+   chann_msg_t *msg = NULL;
+   while ((msg = mnet_result_next())) {
+      if (msg->n == svr) {
+         if (msg->event == CHANN_EVENT_ACCEPT) {
+            ctx->accepted += 1;
+            mnet_chann_active_event(msg->r, CHANN_EVENT_TIMER, conf->heartbeat * 1000);
+         }
+      } else if (msg->event == CHANN_EVENT_TIMER) {
+         mnet_chann_send(msg->n, "h", 1);
+         ctx->heartbeats += 1;
+      } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+         mnet_chann_close(msg->n);
+      }
+   }
+}
+
+static void
+_report(ctx_t *ctx, conf_t *conf) {
+   double conns = ctx->accepted > 0 ? ctx->accepted : 1;
+   double rss_conn = (ctx->rss_hold - ctx->rss_base) / conns;
+   double chann_size = ctx->mem.channs > 0 ? (double)ctx->mem.chann_bytes / ctx->mem.channs : 0;
+   double timer_conn = ctx->mem.timer_bytes / conns;
+   double mem_conn = (ctx->mem.total_bytes - ctx->mem.loop_bytes) / conns;
+   double poll_us = ctx->polls > 0 ? (double)ctx->hist.dispatch.sum / ctx->polls : 0;
+   double cpu_pct = ctx->hold_cpu_us / (ctx->hold_seconds * 1e6) * 100;
+   double fire_ns = ctx->heartbeats > 0 ? ctx->hold_cpu_us * 1000 / ctx->heartbeats : 0;
+   if (!conf->json) {
+      printf("c1m %d conns wanted, %d accepted, %d source IPs, heartbeat %d s, hold %.1f s\n",
+             conf->conns, ctx->accepted, conf->ips, conf->heartbeat, ctx->hold_seconds);
+      printf("memory       RSS %.1f bytes/conn, core %.1f bytes/conn, chann_t %.0f, timer %.1f bytes/conn\n",
+             rss_conn, mem_conn, chann_size, timer_conn);
+      printf("loop         %llu polls, %.1f us busy/poll, cpu %.2f%%, %llu heartbeats, %.0f ns cpu/heartbeat\n",
+             (unsigned long long)ctx->polls, poll_us, cpu_pct, (unsigned long long)ctx->heartbeats, fire_ns);
+      bench_print_hist(stdout, "busy", "us", &ctx->hist.dispatch);
+      bench_print_hist(stdout, "late", "us", &ctx->hist.timer_late);
+   }
+   printf("{\"bench\":\"c1m\",\"version\":%d,\"conns\":%d,\"accepted\":%d,\"ips\":%d,\"heartbeat\":%d,"
+          "\"seconds\":%.3f,\"rss_conn\":%.1f,\"mem_conn\":%.1f,\"chann_size\":%.0f,\"timer_conn\":%.1f,"
+          "\"polls\":%llu,\"poll_busy_us\":%.2f,\"cpu_pct\":%.3f,\"heartbeats\":%llu,\"heartbeat_cpu_ns\":%.0f,",
+          mnet_version(), conf->conns, ctx->accepted, conf->ips, conf->heartbeat, ctx->hold_seconds,
+          rss_conn, mem_conn, chann_size, timer_conn, (unsigned long long)ctx->polls, poll_us, cpu_pct,
+          (unsigned long long)ctx->heartbeats, fire_ns);
+   bench_json_hist(stdout, "busy_us", &ctx->hist.dispatch);
+   printf(",");
+   bench_json_hist(stdout, "late_us", &ctx->hist.timer_late);
+   printf("}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+   int nofile = _raise_nofile(conf.conns + 1024);
+   if (nofile < conf.conns + 64) {
+      printf("nofile limit %d, reduce conns to %d\n", nofile, nofile - 64);
+      conf.conns = nofile - 64;
+   }
+
+   ctx_t ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.connected = -1;
+   mnet_setlog(1, NULL);        // error only
+   mnet_init();
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (!mnet_chann_listen(svr, conf.addr.ip, conf.addr.port, 4096)) {
+      printf("fail to listen %s:%d\n", conf.addr.ip, conf.addr.port);
+      return 1;
+   }
+   ctx.rss_base = bench_rss_bytes();
+
+   int fds[2];
+   if (pipe(fds) < 0) {
+      return 1;
+   }
+   pid_t pid = fork();
+   if (pid == 0) {
+      close(fds[0]);
+      _run_client(&conf, fds[1]);
+      exit(0);
+   }
+   close(fds[1]);
+
+   // accept until client finished and all accepted
+   int64_t begin = mnet_tm_current();
+   while (ctx.connected < 0 || ctx.accepted < ctx.connected) {
+      if (mnet_poll(100) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      _process(&ctx, &conf, svr);
+      if (ctx.connected < 0) {
+         struct timeval tv = { 0, 0 };
+         fd_set rfds;
+         FD_ZERO(&rfds);
+         FD_SET(fds[0], &rfds);
+         if (select(fds[0] + 1, &rfds, NULL, NULL, &tv) > 0 &&
+             read(fds[0], &ctx.connected, sizeof(ctx.connected)) != sizeof(ctx.connected))
+         {
+            break;
+         }
+      }
+   }
+   if (!conf.json) {
+      printf("established %d conns in %.2f seconds\n", ctx.accepted, (mnet_tm_current() - begin) / 1e6);
+   }
+
+   // hold idle with heartbeats
+   mnet_loop_hist_enable(1);
+   mnet_loop_hist_reset();
+   ctx.heartbeats = 0;
+   double cpu = _cpu_us();
+   begin = mnet_tm_current();
+   int64_t end = begin + (int64_t)conf.duration * 1000 * 1000;
+   while (mnet_tm_current() < end) {
+      if (mnet_poll(10) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      ctx.polls += 1;
+      _process(&ctx, &conf, svr);
+   }
+   ctx.hold_seconds = (mnet_tm_current() - begin) / 1e6;
+   ctx.hold_cpu_us = _cpu_us() - cpu;
+   ctx.rss_hold = bench_rss_bytes();
+   mnet_mem_report(&ctx.mem);
+   mnet_loop_hist(&ctx.hist);
+
+   kill(pid, SIGKILL);
+   waitpid(pid, NULL, 0);
+   close(fds[0]);
+
+   _report(&ctx, &conf);
+   mnet_fini();
+   return 0;
+}
+
+#endif  /* BENCH_C1M_C */
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* connection rate benchmark, client keep 'concurrency' short lived connects,
+ * server greet 1 byte after accept then client close, server workers share
+ * listen fd with multi process accept balancer like examples/process
+ */
+
+#ifdef BENCH_CPS_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "mnet_core.h"
+#include "bench.h"
+
+#define kMaxWorkers 64
+
+typedef struct {
+   int concurrency;             // connecting or connected channs in client
+   int workers;                 // server processes
+   int duration;                // seconds
+   int graceful;                // close with FIN, or RST to skip client TIME_WAIT
+   int json;
+   chann_addr_t addr;
+} conf_t;
+
+typedef struct {
+   sem_t *sem;                  // accept lock between workers
+   chann_t *svr;
+   uint64_t accepts;
+} worker_t;
+
+typedef struct {
+   uint64_t conns;              // connection greeted then closed
+   int failed;
+   mnet_hist_t latency;         // micro seconds from connect to greeting
+} ctx_t;
+
+static volatile sig_atomic_t g_stop;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-a ip:port] [-n concurrency] [-w workers] [-d seconds] [-g] [-j]\n", argv[0]);
+   printf("  -g: graceful close, default RST to skip client TIME_WAIT\n");
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->concurrency = 64;
+   conf->workers = 1;
+   conf->duration = 5;
+   const char *ipport = "127.0.0.1:9091";
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "a:n:w:d:gjh")) != -1) {
+      switch (opt) {
+         case 'a': ipport = optarg; break;
+         case 'n': conf->concurrency = atoi(optarg); break;
+         case 'w': conf->workers = atoi(optarg); break;
+         case 'd': conf->duration = atoi(optarg); break;
+         case 'g': conf->graceful = 1; break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   return mnet_parse_ipport(ipport, &conf->addr) > 0 && conf->concurrency > 0 &&
+      conf->workers > 0 && conf->workers <= kMaxWorkers && conf->duration > 0;
+}
+
+static void
+_on_stop(int sig) {
+   g_stop = 1;
+}
+
+static inline double
+_tv_us(struct timeval *tv) {
+   return tv->tv_sec * 1e6 + tv->tv_usec;
+}
+
+/* server worker
+ */
+
+static int
+_worker_before_ac(void *ac_context, int afd) {
+   worker_t *w = (worker_t *)ac_context;
+   return (sem_trywait(w->sem) == 0) ? 1 : 0;
+}
+
+static int
+_worker_after_ac(void *ac_context, int afd) {
+   worker_t *w = (worker_t *)ac_context;
+   sem_post(w->sem);
+   return 0;
+}
+
+/* report accepts to pipe when stopped */
+static void
+_run_worker(worker_t *w, int report_fd) {
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = _on_stop;
+   sigaction(SIGTERM, &sa, NULL);
+   mnet_setlog(0, NULL);        // peer reset expected
+
+   if (w->sem) {
+      mnet_multi_accept_balancer(w, _worker_before_ac, _worker_after_ac);
+   }
+   mnet_multi_reset_event();    // kqueue/epoll for each worker
+   while (!g_stop) {
+      if (mnet_poll(100) < 0) {
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->n == w->svr) {
+            if (msg->event == CHANN_EVENT_ACCEPT) {
+               w->accepts += 1;
+               mnet_chann_send(msg->r, "g", 1);
+            }
+         } else if (msg->event == CHANN_EVENT_RECV) {
+            char buf[16];
+            mnet_chann_recv(msg->n, buf, sizeof(buf)); // EOF or RST
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            mnet_chann_close(msg->n);
+         }
+      }
+   }
+   if (write(report_fd, &w->accepts, sizeof(w->accepts)) != sizeof(w->accepts)) {
+      perror("report accepts");
+   }
+   close(report_fd);
+   mnet_fini();
+}
+
+/* client
+ */
+
+static void
+_connect(ctx_t *ctx, conf_t *conf) {
+   chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (mnet_chann_connect(n, conf->addr.ip, conf->addr.port)) {
+      int64_t *begin = (int64_t *)malloc(sizeof(int64_t));
+      *begin = mnet_tm_current();
+      mnet_chann_set_opaque(n, begin);
+   } else {
+      ctx->failed += 1;
+      mnet_chann_close(n);
+   }
+}
+
+static void
+_close(conf_t *conf, chann_msg_t *msg) {
+   if (!conf->graceful && mnet_chann_fd(msg->n) > 0) {
+      struct linger lg = { 1, 0 };
+      setsockopt(mnet_chann_fd(msg->n), SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+   }
+   free(msg->opaque);
+   mnet_chann_close(msg->n);
+}
+
+static void
+_run_client(ctx_t *ctx, conf_t *conf) {
+   mnet_init();
+   for (int i=0; i<conf->concurrency; i++) {
+      _connect(ctx, conf);
+   }
+   int64_t end = mnet_tm_current() + (int64_t)conf->duration * 1000 * 1000;
+   while (mnet_tm_current() < end) {
+      if (mnet_poll(100) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->event == CHANN_EVENT_RECV) {
+            char c = 0;
+            if (mnet_chann_recv(msg->n, &c, 1) == 1) {
+               mnet_hist_record(&ctx->latency, mnet_tm_current() - *(int64_t *)msg->opaque);
+               ctx->conns += 1;
+               _close(conf, msg);
+               _connect(ctx, conf);
+            }
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            ctx->failed += 1;
+            _close(conf, msg);
+            _connect(ctx, conf);
+         }
+      }
+   }
+   mnet_fini();
+}
+
+static void
+_report(ctx_t *ctx, conf_t *conf, double seconds, uint64_t accepts, double cnt_us, double svr_us) {
+   double cps = ctx->conns / seconds;
+   double conns = ctx->conns > 0 ? (double)ctx->conns : 1.0;
+   if (!conf->json) {
+      printf("cps %d concurrency, %d workers, %s close, %.2f seconds\n", conf->concurrency,
+             conf->workers, conf->graceful ? "graceful" : "RST", seconds);
+      printf("conns        %llu, %.0f conn/s, %llu accepted, %d failed\n",
+             (unsigned long long)ctx->conns, cps, (unsigned long long)accepts, ctx->failed);
+      printf("cpu          client %.1f us/conn, server %.1f us/conn\n", cnt_us / conns, svr_us / conns);
+      bench_print_hist(stdout, "accept", "us", &ctx->latency);
+   }
+   printf("{\"bench\":\"cps\",\"version\":%d,\"concurrency\":%d,\"workers\":%d,\"graceful\":%d,"
+          "\"seconds\":%.3f,\"conns\":%llu,\"cps\":%.1f,\"accepts\":%llu,\"failed\":%d,"
+          "\"client_cpu_us\":%.2f,\"server_cpu_us\":%.2f,",
+          mnet_version(), conf->concurrency, conf->workers, conf->graceful, seconds,
+          (unsigned long long)ctx->conns, cps, (unsigned long long)accepts, ctx->failed,
+          cnt_us / conns, svr_us / conns);
+   bench_json_hist(stdout, "accept_us", &ctx->latency);
+   printf("}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+
+   // listen before fork, workers share listen fd
+   worker_t w;
+   memset(&w, 0, sizeof(w));
+   mnet_init();
+   w.svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (!mnet_chann_listen(w.svr, conf.addr.ip, conf.addr.port, 1024)) {
+      printf("fail to listen %s:%d\n", conf.addr.ip, conf.addr.port);
+      return 1;
+   }
+   if (conf.workers > 1) {
+      char name[64];
+      sprintf(name, "/mnet.bench.cps.%d", (int)getpid());
+      w.sem = sem_open(name, O_RDWR | O_CREAT, 0644, 1);
+      if (w.sem == SEM_FAILED) {
+         perror("sem_open");
+         return 1;
+      }
+      sem_unlink(name);
+   }
+
+   int fds[2];
+   pid_t pids[kMaxWorkers];
+   if (pipe(fds) < 0) {
+      return 1;
+   }
+   for (int i=0; i<conf.workers; i++) {
+      pids[i] = fork();
+      if (pids[i] == 0) {
+         close(fds[0]);
+         _run_worker(&w, fds[1]);
+         exit(0);
+      }
+   }
+   close(fds[1]);
+   mnet_fini();                 // client with new loop
+
+   ctx_t ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   double cnt_us = -(_tv_us(&ru.ru_utime) + _tv_us(&ru.ru_stime));
+   int64_t begin = mnet_tm_current();
+   _run_client(&ctx, &conf);
+   double seconds = (mnet_tm_current() - begin) / 1e6;
+   getrusage(RUSAGE_SELF, &ru);
+   cnt_us += _tv_us(&ru.ru_utime) + _tv_us(&ru.ru_stime);
+
+   uint64_t accepts = 0;
+   for (int i=0; i<conf.workers; i++) {
+      kill(pids[i], SIGTERM);
+   }
+   for (int i=0; i<conf.workers; i++) {
+      uint64_t count = 0;
+      if (read(fds[0], &count, sizeof(count)) == sizeof(count)) {
+         accepts += count;
+      }
+   }
+   for (int i=0; i<conf.workers; i++) {
+      waitpid(pids[i], NULL, 0);
+   }
+   close(fds[0]);
+   getrusage(RUSAGE_CHILDREN, &ru);
+   double svr_us = _tv_us(&ru.ru_utime) + _tv_us(&ru.ru_stime);
+
+   _report(&ctx, &conf, seconds, accepts, cnt_us, svr_us);
+   return 0;
+}
+
+#endif  /* BENCH_CPS_C */
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* per event dispatch overhead over raw epoll loop, with same loopback TCP
+ * connections kept readable (1 byte never read, level triggered), so each
+ * round only poll and dispatch without data syscalls
+ *
+ * stages: 'poll' for epoll_wait or mnet_poll(), 'next' for user side
+ * dispatch loop or mnet_result_next(), then mnet with timers, loop histograms
+ * and trace enabled for cost of each feature
+ */
+
+#ifdef BENCH_DISPATCH_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mnet_core.h"
+#include "bench.h"
+
+#if defined(__linux__)
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define kEventSize 256          // same as mnet epoll event array
+
+typedef struct {
+   int conns;
+   int rounds;
+   int json;
+   chann_addr_t addr;
+} conf_t;
+
+typedef struct {
+   const char *name;
+   uint64_t events;
+   int64_t poll_ns;
+   int64_t next_ns;
+} result_t;
+
+typedef struct s_conn {
+   int fd;
+   uint64_t count;
+   void (*cb)(struct s_conn *);
+} conn_t;
+
+static uint64_t g_user_events;  // touched by user handler
+
+static inline int64_t
+_ns_current(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-a ip:port] [-n conns] [-r rounds] [-j]\n", argv[0]);
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->conns = 1000;
+   conf->rounds = 20000;
+   const char *ipport = "127.0.0.1:9094";
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "a:n:r:jh")) != -1) {
+      switch (opt) {
+         case 'a': ipport = optarg; break;
+         case 'n': conf->conns = atoi(optarg); break;
+         case 'r': conf->rounds = atoi(optarg); break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   return mnet_parse_ipport(ipport, &conf->addr) > 0 && conf->conns > 0 && conf->rounds > 0;
+}
+
+/* raw epoll baseline
+ */
+
+static void
+_raw_cb(conn_t *c) {
+   c->count++;
+   g_user_events++;
+}
+
+static int
+_raw_run(conf_t *conf, result_t *r) {
+   struct sockaddr_in sin;
+   memset(&sin, 0, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons(conf->addr.port);
+   sin.sin_addr.s_addr = inet_addr(conf->addr.ip);
+
+   int on = 1;
+   int lfd = socket(AF_INET, SOCK_STREAM, 0);
+   setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+   if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(lfd, 1024) < 0) {
+      printf("fail to listen %s:%d\n", conf->addr.ip, conf->addr.port);
+      return 0;
+   }
+
+   int ep = epoll_create(kEventSize);
+   int *cfds = (int *)calloc(conf->conns, sizeof(int));
+   conn_t *conns = (conn_t *)calloc(conf->conns, sizeof(conn_t));
+   for (int i=0; i<conf->conns; i++) {
+      cfds[i] = socket(AF_INET, SOCK_STREAM, 0);
+      if (connect(cfds[i], (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+          (conns[i].fd = accept(lfd, NULL, NULL)) < 0 ||
+          write(cfds[i], "r", 1) != 1)
+      {
+         printf("fail to connect %d\n", i);
+         return 0;
+      }
+      conns[i].cb = _raw_cb;
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.ptr = &conns[i];
+      epoll_ctl(ep, EPOLL_CTL_ADD, conns[i].fd, &ev);
+   }
+
+   struct epoll_event evs[kEventSize];
+   memset(r, 0, sizeof(*r));
+   r->name = "raw";
+   for (int i=0; i<conf->rounds; i++) {
+      int64_t t0 = _ns_current();
+      int count = epoll_wait(ep, evs, kEventSize, 0);
+      int64_t t1 = _ns_current();
+      for (int j=0; j<count; j++) {
+         conn_t *c = (conn_t *)evs[j].data.ptr;
+         if (evs[j].events & (EPOLLERR | EPOLLHUP)) {
+            continue;
+         }
+         if (evs[j].events & EPOLLIN) {
+            c->cb(c);
+         }
+      }
+      int64_t t2 = _ns_current();
+      r->poll_ns += t1 - t0;
+      r->next_ns += t2 - t1;
+      r->events += count > 0 ? count : 0;
+   }
+
+   for (int i=0; i<conf->conns; i++) {
+      close(conns[i].fd);
+      close(cfds[i]);
+   }
+   close(lfd);
+   close(ep);
+   free(conns);
+   free(cfds);
+   return 1;
+}
+
+/* mnet loop with feature flags
+ */
+
+enum {
+   FEATURE_TIMER = 1,           // long timer armed on each chann
+   FEATURE_HIST = 2,            // loop histograms
+   FEATURE_TRACE = 4,           // trace ring
+};
+
+static int
+_mnet_run(conf_t *conf, int features, const char *name, result_t *r) {
+   mnet_init();
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (!mnet_chann_listen(svr, conf->addr.ip, conf->addr.port, 1024)) {
+      printf("fail to listen %s:%d\n", conf->addr.ip, conf->addr.port);
+      return 0;
+   }
+   for (int i=0; i<conf->conns; i++) {
+      chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+      mnet_chann_set_opaque(n, n);   // mark as client
+      mnet_chann_connect(n, conf->addr.ip, conf->addr.port);
+   }
+
+   // setup until all server side channs readable, mark readable with svr
+   int ready = 0;
+   for (int i=0; i<10000 && ready < conf->conns; i++) {
+      mnet_poll(10);
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->event == CHANN_EVENT_CONNECTED) {
+            mnet_chann_send(msg->n, "r", 1);
+         } else if (msg->event == CHANN_EVENT_ACCEPT && (features & FEATURE_TIMER)) {
+            mnet_chann_active_event(msg->r, CHANN_EVENT_TIMER, 3600 * 1000);
+         } else if (msg->event == CHANN_EVENT_RECV && msg->opaque == NULL) {
+            mnet_chann_set_opaque(msg->n, svr);
+            ready++;
+         }
+      }
+   }
+   if (ready < conf->conns) {
+      printf("only %d channs ready\n", ready);
+   }
+
+   mnet_loop_hist_enable(features & FEATURE_HIST);
+   if (features & FEATURE_TRACE) {
+      mnet_trace_enable(64 * 1024);
+   }
+
+   memset(r, 0, sizeof(*r));
+   r->name = name;
+   for (int i=0; i<conf->rounds; i++) {
+      int64_t t0 = _ns_current();
+      mnet_poll(0);
+      int64_t t1 = _ns_current();
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         g_user_events++;
+         r->events++;
+      }
+      int64_t t2 = _ns_current();
+      r->poll_ns += t1 - t0;
+      r->next_ns += t2 - t1;
+   }
+   mnet_fini();
+   return 1;
+}
+
+static void
+_report(conf_t *conf, result_t *rs, int count) {
+   double base = rs[0].events > 0 ? (double)(rs[0].poll_ns + rs[0].next_ns) / rs[0].events : 0;
+   if (!conf->json) {
+      printf("dispatch %d readable conns, %d rounds, %d events each poll at most\n",
+             conf->conns, conf->rounds, kEventSize);
+      printf("%-12s %12s %10s %10s %10s %10s\n", "loop", "events", "poll", "next", "total", "overhead");
+      for (int i=0; i<count; i++) {
+         double ev = rs[i].events > 0 ? (double)rs[i].events : 1;
+         double total = (rs[i].poll_ns + rs[i].next_ns) / ev;
+         printf("%-12s %12llu %7.1f ns %7.1f ns %7.1f ns %7.1f ns\n", rs[i].name,
+                (unsigned long long)rs[i].events, rs[i].poll_ns / ev, rs[i].next_ns / ev, total, total - base);
+      }
+   }
+   printf("{\"bench\":\"dispatch\",\"version\":%d,\"conns\":%d,\"rounds\":%d", mnet_version(),
+          conf->conns, conf->rounds);
+   for (int i=0; i<count; i++) {
+      double ev = rs[i].events > 0 ? (double)rs[i].events : 1;
+      printf(",\"%s\":{\"events\":%llu,\"poll_ns\":%.2f,\"next_ns\":%.2f,\"total_ns\":%.2f}", rs[i].name,
+             (unsigned long long)rs[i].events, rs[i].poll_ns / ev, rs[i].next_ns / ev,
+             (rs[i].poll_ns + rs[i].next_ns) / ev);
+   }
+   printf("}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+   mnet_setlog(1, NULL);
+
+   result_t rs[5];
+   int count = 0;
+   if (_raw_run(&conf, &rs[count])) { count++; }
+   if (_mnet_run(&conf, 0, "mnet", &rs[count])) { count++; }
+   if (_mnet_run(&conf, FEATURE_TIMER, "mnet_timer", &rs[count])) { count++; }
+   if (_mnet_run(&conf, FEATURE_HIST, "mnet_hist", &rs[count])) { count++; }
+   if (_mnet_run(&conf, FEATURE_TRACE, "mnet_trace", &rs[count])) { count++; }
+   _report(&conf, rs, count);
+   return 0;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+   printf("only support epoll under Linux.\n");
+   return 0;
+}
+
+#endif  /* __linux__ */
+#endif  /* BENCH_DISPATCH_C */
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* TCP echo benchmark, client keep 'pipeline' messages in flight for each
+ * chann, message begin with 8 bytes send timestamp for round trip latency,
+ * server forked in another process by default
+ */
+
+#ifdef BENCH_ECHO_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "mnet_core.h"
+#include "bench.h"
+
+#define kBufSize (64 * 1024)
+#define kTsSize 8
+
+typedef struct {
+   int mode;                    // 0 for fork server, 's' or 'c' for only one side
+   int conns;
+   int msg_size;
+   int pipeline;
+   int duration;                // seconds
+   int warmup;                  // seconds
+   int json;                    // only JSON output
+   chann_addr_t addr;
+} conf_t;
+
+typedef struct {
+   int msg_off;                 // received offset in current message
+   uint8_t ts[kTsSize];         // send timestamp of current message
+} cnt_t;
+
+typedef struct {
+   int connected;
+   int failed;
+   uint64_t requests;
+   uint64_t bytes;
+   mnet_hist_t latency;         // micro seconds
+   uint8_t *msg;
+} ctx_t;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-s|-c] [-a ip:port] [-n conns] [-m msg_size] [-p pipeline] [-d seconds] [-w warmup] [-j]\n", argv[0]);
+   printf("  -s: only server, -c: only client, default fork server\n");
+   printf("  -j: only output JSON\n");
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->conns = 50;
+   conf->msg_size = 64;
+   conf->pipeline = 1;
+   conf->duration = 10;
+   conf->warmup = 1;
+   const char *ipport = "127.0.0.1:9090";
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "sca:n:m:p:d:w:jh")) != -1) {
+      switch (opt) {
+         case 's': case 'c': conf->mode = opt; break;
+         case 'a': ipport = optarg; break;
+         case 'n': conf->conns = atoi(optarg); break;
+         case 'm': conf->msg_size = atoi(optarg); break;
+         case 'p': conf->pipeline = atoi(optarg); break;
+         case 'd': conf->duration = atoi(optarg); break;
+         case 'w': conf->warmup = atoi(optarg); break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   if (conf->msg_size < kTsSize) {
+      conf->msg_size = kTsSize;
+   }
+   return mnet_parse_ipport(ipport, &conf->addr) > 0 && conf->conns > 0 &&
+      conf->pipeline > 0 && conf->duration > 0 && conf->warmup >= 0;
+}
+
+/* server
+ */
+
+static int
+_run_server(conf_t *conf, int ready_fd) {
+   mnet_init();
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (!mnet_chann_listen(svr, conf->addr.ip, conf->addr.port, 1024)) {
+      printf("fail to listen %s:%d\n", conf->addr.ip, conf->addr.port);
+      return 1;
+   }
+   if (ready_fd >= 0) {
+      if (write(ready_fd, "r", 1) != 1) {
+         return 1;
+      }
+      close(ready_fd);
+   }
+
+   uint8_t *buf = (uint8_t *)malloc(kBufSize);
+   for (;;) {
+      if (mnet_poll(MNET_MILLI_SECOND) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->n == svr) {
+            continue;
+         }
+         if (msg->event == CHANN_EVENT_RECV) {
+            int ret = mnet_chann_recv(msg->n, buf, kBufSize);
+            if (ret > 0) {
+               mnet_chann_send(msg->n, buf, ret);
+            }
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            mnet_chann_close(msg->n);
+         }
+      }
+   }
+   free(buf);
+   mnet_fini();
+   return 0;
+}
+
+/* client
+ */
+
+static inline int
+_min_int(int a, int b) {
+   return a < b ? a : b;
+}
+
+static void
+_send_msg(ctx_t *ctx, conf_t *conf, chann_t *n) {
+   int64_t ts = mnet_tm_current();
+   memcpy(ctx->msg, &ts, kTsSize);
+   mnet_chann_send(n, ctx->msg, conf->msg_size);
+}
+
+/* walk through received bytes by message boundary */
+static void
+_on_recv(ctx_t *ctx, conf_t *conf, chann_t *n, cnt_t *c, const uint8_t *buf, int len) {
+   while (len > 0) {
+      int step = _min_int(len, conf->msg_size - c->msg_off);
+      if (c->msg_off < kTsSize) {
+         int ts_len = _min_int(step, kTsSize - c->msg_off);
+         memcpy(&c->ts[c->msg_off], buf, ts_len);
+      }
+      c->msg_off += step;
+      buf += step;
+      len -= step;
+      if (c->msg_off >= conf->msg_size) {
+         int64_t ts = 0;
+         memcpy(&ts, c->ts, kTsSize);
+         mnet_hist_record(&ctx->latency, mnet_tm_current() - ts);
+         ctx->requests += 1;
+         ctx->bytes += conf->msg_size;
+         c->msg_off = 0;
+         _send_msg(ctx, conf, n);
+      }
+   }
+}
+
+static void
+_report(ctx_t *ctx, conf_t *conf, double seconds) {
+   double rps = ctx->requests / seconds;
+   double mbps = ctx->bytes / seconds / (1024 * 1024);
+   if (!conf->json) {
+      printf("echo %d conns, %d bytes message, pipeline %d, %.2f seconds\n",
+             conf->conns, conf->msg_size, conf->pipeline, seconds);
+      printf("requests     %llu, %.0f req/s, %.2f MB/s\n", (unsigned long long)ctx->requests, rps, mbps);
+      bench_print_hist(stdout, "latency", "us", &ctx->latency);
+   }
+   printf("{\"bench\":\"echo\",\"version\":%d,\"conns\":%d,\"msg_size\":%d,\"pipeline\":%d,"
+          "\"seconds\":%.3f,\"requests\":%llu,\"rps\":%.1f,\"mbps\":%.3f,\"connected\":%d,\"failed\":%d,",
+          mnet_version(), conf->conns, conf->msg_size, conf->pipeline, seconds,
+          (unsigned long long)ctx->requests, rps, mbps, ctx->connected, ctx->failed);
+   bench_json_hist(stdout, "latency_us", &ctx->latency);
+   printf("}\n");
+}
+
+static int
+_run_client(conf_t *conf) {
+   ctx_t ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.msg = (uint8_t *)calloc(1, conf->msg_size);
+   uint8_t *buf = (uint8_t *)malloc(kBufSize);
+   cnt_t *cnts = (cnt_t *)calloc(conf->conns, sizeof(cnt_t));
+
+   mnet_init();
+   for (int i=0; i<conf->conns; i++) {
+      chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+      mnet_chann_set_opaque(n, &cnts[i]);
+      if (!mnet_chann_connect(n, conf->addr.ip, conf->addr.port)) {
+         ctx.failed += 1;
+         mnet_chann_close(n);
+      }
+   }
+
+   int64_t begin = mnet_tm_current();
+   int64_t warmup_end = begin + (int64_t)conf->warmup * 1000 * 1000;
+   int64_t end = warmup_end + (int64_t)conf->duration * 1000 * 1000;
+   int warming = conf->warmup > 0;
+   int64_t now = begin;
+   while ((now = mnet_tm_current()) < end) {
+      if (warming && now >= warmup_end) {
+         warming = 0;
+         ctx.requests = ctx.bytes = 0;
+         mnet_hist_reset(&ctx.latency);
+         begin = now;
+      }
+      if (mnet_poll(100) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->event == CHANN_EVENT_CONNECTED) {
+            ctx.connected += 1;
+            for (int i=0; i<conf->pipeline; i++) {
+               _send_msg(&ctx, conf, msg->n);
+            }
+         } else if (msg->event == CHANN_EVENT_RECV) {
+            int ret = mnet_chann_recv(msg->n, buf, kBufSize);
+            if (ret > 0) {
+               _on_recv(&ctx, conf, msg->n, (cnt_t *)msg->opaque, buf, ret);
+            }
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            ctx.failed += 1;
+            mnet_chann_close(msg->n);
+         }
+      }
+   }
+
+   _report(&ctx, conf, (now - begin) / 1000000.0);
+
+   mnet_fini();
+   free(cnts);
+   free(buf);
+   free(ctx.msg);
+   return ctx.failed ? 1 : 0;
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+
+   if (conf.mode == 's') {
+      return _run_server(&conf, -1);
+   }
+   if (conf.mode == 'c') {
+      return _run_client(&conf);
+   }
+
+   // fork server, wait listen ready
+   int fds[2];
+   if (pipe(fds) < 0) {
+      return 1;
+   }
+   pid_t pid = fork();
+   if (pid == 0) {
+      close(fds[0]);
+      exit(_run_server(&conf, fds[1]));
+   }
+   close(fds[1]);
+   char c = 0;
+   if (pid < 0 || read(fds[0], &c, 1) != 1) {
+      printf("fail to start server\n");
+      return 1;
+   }
+   close(fds[0]);
+   int ret = _run_client(&conf);
+   kill(pid, SIGTERM);
+   waitpid(pid, NULL, 0);
+   return ret;
+}
+
+#endif  /* BENCH_ECHO_C */
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* timer benchmark with channs without socket, arm/update/cancel in churn
+ * pattern, then fire heavy pattern with short intervals in loop
+ */
+
+#ifdef BENCH_TIMER_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mnet_core.h"
+#include "bench.h"
+
+typedef struct {
+   int timers;                  // channs with timer
+   int rounds;                  // churn rounds over all timers
+   int fire_timers;             // channs in fire heavy pattern
+   int fire_ms;                 // max interval in fire heavy pattern
+   int duration;                // seconds for fire heavy pattern
+   int json;
+} conf_t;
+
+typedef struct {
+   const char *name;
+   uint64_t ops;
+   int64_t ns;
+   uint64_t allocs;
+} phase_t;
+
+static uint64_t g_allocs;
+static uint64_t g_frees;
+static uint32_t g_seed = 2463534242u;
+
+static void*
+_count_malloc(int n) {
+   g_allocs++;
+   return malloc(n);
+}
+
+static void*
+_count_realloc(void *p, int n) {
+   g_allocs++;
+   return realloc(p, n);
+}
+
+static void
+_count_free(void *p) {
+   g_frees++;
+   free(p);
+}
+
+/* xorshift for same sequence in each run */
+static inline uint32_t
+_rand_next(void) {
+   g_seed ^= g_seed << 13;
+   g_seed ^= g_seed >> 17;
+   g_seed ^= g_seed << 5;
+   return g_seed;
+}
+
+static inline int64_t
+_ns_current(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-n timers] [-r churn_rounds] [-f fire_timers] [-i fire_max_ms] [-d seconds] [-j]\n", argv[0]);
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->timers = 1000000;
+   conf->rounds = 3;
+   conf->fire_timers = 100000;
+   conf->fire_ms = 1000;
+   conf->duration = 5;
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "n:r:f:i:d:jh")) != -1) {
+      switch (opt) {
+         case 'n': conf->timers = atoi(optarg); break;
+         case 'r': conf->rounds = atoi(optarg); break;
+         case 'f': conf->fire_timers = atoi(optarg); break;
+         case 'i': conf->fire_ms = atoi(optarg); break;
+         case 'd': conf->duration = atoi(optarg); break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   if (conf->fire_timers > conf->timers) {
+      conf->fire_timers = conf->timers;
+   }
+   return conf->timers > 0 && conf->rounds >= 0 && conf->fire_ms > 0 && conf->duration > 0;
+}
+
+static void
+_phase_begin(phase_t *p, const char *name) {
+   p->name = name;
+   p->allocs = g_allocs;
+   p->ns = _ns_current();
+}
+
+static void
+_phase_end(phase_t *p, uint64_t ops) {
+   p->ns = _ns_current() - p->ns;
+   p->allocs = g_allocs - p->allocs;
+   p->ops = ops;
+}
+
+/* long intervals never fired in churn pattern */
+static inline int64_t
+_long_interval(void) {
+   return 60000 + _rand_next() % 60000;
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+
+   mnet_allocator(_count_malloc, _count_realloc, _count_free);
+   mnet_init();
+
+   chann_t **channs = (chann_t **)malloc(conf.timers * sizeof(chann_t *));
+   phase_t phases[5];
+   int count = 0;
+   uint64_t ops = 0;
+
+   _phase_begin(&phases[count], "open");
+   for (int i=0; i<conf.timers; i++) {
+      channs[i] = mnet_chann_open(CHANN_TYPE_STREAM);
+   }
+   _phase_end(&phases[count++], conf.timers);
+
+   _phase_begin(&phases[count], "arm");
+   for (int i=0; i<conf.timers; i++) {
+      mnet_chann_active_event(channs[i], CHANN_EVENT_TIMER, _long_interval());
+   }
+   _phase_end(&phases[count++], conf.timers);
+
+   _phase_begin(&phases[count], "update");
+   for (int i=0; i<conf.timers; i++) {
+      mnet_chann_active_event(channs[i], CHANN_EVENT_TIMER, _long_interval());
+   }
+   _phase_end(&phases[count++], conf.timers);
+
+   // cancel and re-arm random chann
+   _phase_begin(&phases[count], "churn");
+   ops = (uint64_t)conf.rounds * conf.timers;
+   for (uint64_t i=0; i<ops; i++) {
+      chann_t *n = channs[_rand_next() % conf.timers];
+      mnet_chann_active_event(n, CHANN_EVENT_TIMER, 0);
+      mnet_chann_active_event(n, CHANN_EVENT_TIMER, _long_interval());
+   }
+   _phase_end(&phases[count++], ops * 2);
+
+   _phase_begin(&phases[count], "cancel");
+   for (int i=0; i<conf.timers; i++) {
+      mnet_chann_active_event(channs[i], CHANN_EVENT_TIMER, 0);
+   }
+   _phase_end(&phases[count++], conf.timers);
+
+   // fire heavy, intervals spread in [1, fire_ms]
+   for (int i=0; i<conf.fire_timers; i++) {
+      mnet_chann_active_event(channs[i], CHANN_EVENT_TIMER, 1 + _rand_next() % conf.fire_ms);
+   }
+   mnet_loop_hist_enable(1);
+   uint64_t fires = 0;
+   uint64_t fire_allocs = g_allocs;
+   int64_t begin = _ns_current();
+   int64_t end = begin + (int64_t)conf.duration * 1000000000;
+   while (_ns_current() < end) {
+      if (mnet_poll(1) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      while (mnet_result_next()) {
+         fires++;
+      }
+   }
+   int64_t elapsed = _ns_current() - begin;
+   fire_allocs = g_allocs - fire_allocs;
+   mnet_loop_hist_t hist;
+   mnet_loop_hist(&hist);
+   int64_t busy = elapsed - (int64_t)hist.poll_block.sum * 1000;
+   double fire_ns = fires > 0 ? (double)busy / fires : 0;
+
+   if (!conf.json) {
+      printf("timer %d channs, %d churn rounds, %d fire heavy channs in %d ms\n",
+             conf.timers, conf.rounds, conf.fire_timers, conf.fire_ms);
+      for (int i=0; i<count; i++) {
+         printf("%-12s %.1f ns/op, %.2f allocs/op\n", phases[i].name,
+                (double)phases[i].ns / phases[i].ops, (double)phases[i].allocs / phases[i].ops);
+      }
+      printf("%-12s %llu fires, %.0f fires/s, %.1f ns/fire, %.2f allocs/fire\n", "fire",
+             (unsigned long long)fires, fires / (elapsed / 1e9), fire_ns,
+             fires > 0 ? (double)fire_allocs / fires : 0.0);
+      bench_print_hist(stdout, "late", "us", &hist.timer_late);
+   }
+   printf("{\"bench\":\"timer\",\"version\":%d,\"timers\":%d,\"rounds\":%d,\"fire_timers\":%d,\"fire_ms\":%d,",
+          mnet_version(), conf.timers, conf.rounds, conf.fire_timers, conf.fire_ms);
+   for (int i=0; i<count; i++) {
+      printf("\"%s\":{\"ns_op\":%.1f,\"allocs_op\":%.3f},", phases[i].name,
+             (double)phases[i].ns / phases[i].ops, (double)phases[i].allocs / phases[i].ops);
+   }
+   printf("\"fire\":{\"fires\":%llu,\"ns_op\":%.1f,\"allocs_op\":%.3f},",
+          (unsigned long long)fires, fire_ns, fires > 0 ? (double)fire_allocs / fires : 0.0);
+   bench_json_hist(stdout, "late_us", &hist.timer_late);
+   printf("}\n");
+
+   mnet_fini();
+   free(channs);
+   return 0;
+}
+
+#endif  /* BENCH_TIMER_C */
@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* DGRAM packets per second benchmark, sender blast fixed size datagrams over
+ * loopback to forked receiver like examples/echo_udp_svr.c, with string
+ * address, binary address or batch API, for each socket buffer size given
+ */
+
+#ifdef BENCH_UDP_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "mnet_core.h"
+#include "bench.h"
+
+#if defined(__linux__)
+#include <linux/sock_diag.h>    // SK_MEMINFO_DROPS
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55           // since Linux 4.6
+#endif
+#endif
+
+#define kBurst 64               // datagrams each round, same as MNET_DGRAM_BATCH_MAX
+#define kMaxBufs 8
+#define kMaxSize 65507
+
+enum {
+   API_STRING = 0,              // mnet_dgram_send/mnet_dgram_recv
+   API_BINARY,                  // mnet_dgram_sendto/mnet_dgram_recvfrom
+   API_BATCH,                   // mnet_dgram_send_batch/mnet_dgram_recv_batch
+};
+
+static const char *g_api_names[] = { "string", "binary", "batch" };
+
+typedef struct {
+   int msg_size;
+   int duration;                // seconds
+   int api;
+   int bufs[kMaxBufs];          // socket buffer sizes, 0 for system default
+   int buf_count;
+   int json;
+   chann_addr_t addr;
+} conf_t;
+
+/* receiver report through pipe */
+typedef struct {
+   uint64_t packets;
+   uint64_t drops;              // kernel drops on receive queue
+   int rcvbuf;                  // actual SO_RCVBUF
+   double cpu_us;
+} recv_report_t;
+
+typedef struct {
+   int bufsize;
+   uint64_t sent;
+   double seconds;
+   double cpu_us;
+   recv_report_t r;
+} result_t;
+
+static volatile sig_atomic_t g_stop;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-a ip:port] [-m msg_size] [-d seconds] [-x string|binary|batch] [-b buf1,buf2,...] [-j]\n", argv[0]);
+   printf("  -b: socket buffer sizes for each run, 0 for system default\n");
+}
+
+static int
+_parse_bufs(conf_t *conf, char *list) {
+   conf->buf_count = 0;
+   for (char *s = strtok(list, ","); s && conf->buf_count < kMaxBufs; s = strtok(NULL, ",")) {
+      conf->bufs[conf->buf_count++] = atoi(s);
+   }
+   return conf->buf_count > 0;
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->msg_size = 64;
+   conf->duration = 3;
+   conf->api = API_BATCH;
+   conf->buf_count = 1;
+   const char *ipport = "127.0.0.1:9095";
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "a:m:d:x:b:jh")) != -1) {
+      switch (opt) {
+         case 'a': ipport = optarg; break;
+         case 'm': conf->msg_size = atoi(optarg); break;
+         case 'd': conf->duration = atoi(optarg); break;
+         case 'x':
+            conf->api = -1;
+            for (int i=0; i<3; i++) {
+               if (strcmp(optarg, g_api_names[i]) == 0) {
+                  conf->api = i;
+               }
+            }
+            break;
+         case 'b':
+            if (!_parse_bufs(conf, optarg)) {
+               return 0;
+            }
+            break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   return mnet_parse_ipport(ipport, &conf->addr) > 0 && conf->api >= 0 &&
+      conf->msg_size > 0 && conf->msg_size <= kMaxSize && conf->duration > 0;
+}
+
+static void
+_on_stop(int sig) {
+   g_stop = 1;
+}
+
+static double
+_cpu_us(int who) {
+   struct rusage ru;
+   getrusage(who, &ru);
+   return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/* kernel drops from SO_MEMINFO, as mnet recv API not expose SO_RXQ_OVFL
+ * ancillary data
+ */
+static uint64_t
+_socket_drops(int fd) {
+#if defined(__linux__) && defined(SO_MEMINFO)
+   uint32_t mem[SK_MEMINFO_VARS];
+   socklen_t len = sizeof(mem);
+   if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, mem, &len) == 0 && len > SK_MEMINFO_DROPS * sizeof(uint32_t)) {
+      return mem[SK_MEMINFO_DROPS];
+   }
+#endif
+   return 0;
+}
+
+/* receiver
+ */
+
+static int
+_recv_burst(conf_t *conf, chann_t *n, chann_dgram_t *msgs) {
+   if (conf->api == API_BATCH) {
+      return mnet_dgram_recv_batch(n, msgs, kBurst);
+   }
+   int count = 0;
+   for (int i=0; i<kBurst; i++) {
+      int ret = 0;
+      if (conf->api == API_STRING) {
+         chann_addr_t addr;
+         ret = mnet_dgram_recv(n, &addr, msgs[0].buf, msgs[0].size);
+      } else {
+         ret = mnet_dgram_recvfrom(n, &msgs[0].addr, msgs[0].buf, msgs[0].size);
+      }
+      if (ret <= 0) {
+         break;
+      }
+      count++;
+   }
+   return count;
+}
+
+static void
+_run_receiver(conf_t *conf, int bufsize, int ready_fd, int report_fd) {
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = _on_stop;
+   sigaction(SIGTERM, &sa, NULL);
+
+   mnet_init();
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_DGRAM);
+   if (bufsize > 0) {
+      mnet_chann_socket_set_bufsize(svr, bufsize);
+   }
+   recv_report_t r;
+   memset(&r, 0, sizeof(r));
+   if (!mnet_chann_listen(svr, conf->addr.ip, conf->addr.port, 1)) {
+      printf("fail to listen %s:%d\n", conf->addr.ip, conf->addr.port);
+      exit(1);
+   }
+   socklen_t len = sizeof(r.rcvbuf);
+   getsockopt(mnet_chann_fd(svr), SOL_SOCKET, SO_RCVBUF, &r.rcvbuf, &len);
+   if (write(ready_fd, "r", 1) != 1) {
+      exit(1);
+   }
+   close(ready_fd);
+
+   chann_dgram_t msgs[kBurst];
+   uint8_t *buf = (uint8_t *)malloc(kBurst * conf->msg_size);
+   for (int i=0; i<kBurst; i++) {
+      msgs[i].buf = &buf[i * conf->msg_size];
+      msgs[i].size = conf->msg_size;
+   }
+
+   double cpu_us = _cpu_us(RUSAGE_SELF);
+   while (!g_stop) {
+      if (mnet_poll(100) < 0) {
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->event == CHANN_EVENT_RECV) {
+            r.packets += _recv_burst(conf, msg->n, msgs);
+         }
+      }
+   }
+   r.cpu_us = _cpu_us(RUSAGE_SELF) - cpu_us;
+   r.drops = _socket_drops(mnet_chann_fd(svr));
+   if (write(report_fd, &r, sizeof(r)) != sizeof(r)) {
+      perror("report packets");
+   }
+   close(report_fd);
+   free(buf);
+   mnet_fini();
+}
+
+/* sender
+ */
+
+static int
+_send_burst(conf_t *conf, chann_t *n, chann_dgram_t *msgs) {
+   if (conf->api == API_BATCH) {
+      int ret = mnet_dgram_send_batch(n, msgs, kBurst);
+      return ret > 0 ? ret : 0;
+   }
+   int count = 0;
+   for (int i=0; i<kBurst; i++) {
+      int ret = 0;
+      if (conf->api == API_STRING) {
+         ret = mnet_dgram_send(n, &conf->addr, msgs[i].buf, conf->msg_size);
+      } else {
+         ret = mnet_dgram_sendto(n, &msgs[i].addr, msgs[i].buf, conf->msg_size);
+      }
+      if (ret != conf->msg_size || mnet_chann_cached(n) > 0) {
+         break;
+      }
+      count++;
+   }
+   return count;
+}
+
+static void
+_run_sender(conf_t *conf, result_t *res) {
+   mnet_init();
+   chann_t *n = mnet_chann_open(CHANN_TYPE_DGRAM);
+   if (res->bufsize > 0) {
+      mnet_chann_socket_set_bufsize(n, res->bufsize);
+   }
+
+   chann_dgram_t msgs[kBurst];
+   uint8_t *buf = (uint8_t *)calloc(1, conf->msg_size);
+   for (int i=0; i<kBurst; i++) {
+      mnet_sockaddr_set(&msgs[i].addr, conf->addr.ip, conf->addr.port);
+      msgs[i].buf = buf;
+      msgs[i].len = conf->msg_size;
+   }
+
+   double cpu_us = _cpu_us(RUSAGE_SELF);
+   int64_t begin = mnet_tm_current();
+   int64_t end = begin + (int64_t)conf->duration * 1000 * 1000;
+   int64_t now = begin;
+   while ((now = mnet_tm_current()) < end) {
+      if (mnet_chann_cached(n) <= 0) {
+         res->sent += _send_burst(conf, n, msgs);
+      }
+      if (mnet_poll(mnet_chann_cached(n) > 0 ? 1 : 0) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      while (mnet_result_next()) {
+      }
+   }
+   res->seconds = (now - begin) / 1e6;
+   res->cpu_us = _cpu_us(RUSAGE_SELF) - cpu_us;
+   free(buf);
+   mnet_fini();
+}
+
+static int
+_run(conf_t *conf, result_t *res) {
+   int ready[2], report[2];
+   if (pipe(ready) < 0 || pipe(report) < 0) {
+      return 0;
+   }
+   pid_t pid = fork();
+   if (pid == 0) {
+      close(ready[0]);
+      close(report[0]);
+      _run_receiver(conf, res->bufsize, ready[1], report[1]);
+      exit(0);
+   }
+   close(ready[1]);
+   close(report[1]);
+   char c = 0;
+   if (pid < 0 || read(ready[0], &c, 1) != 1) {
+      printf("fail to start receiver\n");
+      return 0;
+   }
+   close(ready[0]);
+
+   _run_sender(conf, res);
+   struct timespec ts = { 0, 100 * 1000 * 1000 };
+   nanosleep(&ts, NULL);        // receiver drain queue
+   kill(pid, SIGTERM);
+   int ok = read(report[0], &res->r, sizeof(res->r)) == sizeof(res->r);
+   close(report[0]);
+   waitpid(pid, NULL, 0);
+   return ok;
+}
+
+static void
+_report(conf_t *conf, result_t *rs, int count) {
+   if (!conf->json) {
+      printf("udp %d bytes datagram, %s API, %d seconds\n", conf->msg_size, g_api_names[conf->api], conf->duration);
+      printf("%-10s %10s %12s %12s %10s %10s %10s %10s\n", "bufsize", "rcvbuf", "sent pps", "recv pps",
+             "lost", "drops", "send cpu", "recv cpu");
+      for (int i=0; i<count; i++) {
+         result_t *s = &rs[i];
+         double sent = s->sent > 0 ? (double)s->sent : 1;
+         double recv = s->r.packets > 0 ? (double)s->r.packets : 1;
+         printf("%-10d %10d %12.0f %12.0f %9.2f%% %10llu %7.0f ns %7.0f ns\n", s->bufsize, s->r.rcvbuf,
+                s->sent / s->seconds, s->r.packets / s->seconds,
+                (s->sent - s->r.packets) * 100.0 / sent, (unsigned long long)s->r.drops,
+                s->cpu_us * 1000 / sent, s->r.cpu_us * 1000 / recv);
+      }
+   }
+   printf("{\"bench\":\"udp\",\"version\":%d,\"msg_size\":%d,\"api\":\"%s\",\"duration\":%d,\"runs\":[",
+          mnet_version(), conf->msg_size, g_api_names[conf->api], conf->duration);
+   for (int i=0; i<count; i++) {
+      result_t *s = &rs[i];
+      double sent = s->sent > 0 ? (double)s->sent : 1;
+      double recv = s->r.packets > 0 ? (double)s->r.packets : 1;
+      printf("%s{\"bufsize\":%d,\"rcvbuf\":%d,\"sent\":%llu,\"received\":%llu,\"drops\":%llu,"
+             "\"send_pps\":%.1f,\"recv_pps\":%.1f,\"send_cpu_ns\":%.1f,\"recv_cpu_ns\":%.1f}",
+             i > 0 ? "," : "", s->bufsize, s->r.rcvbuf, (unsigned long long)s->sent,
+             (unsigned long long)s->r.packets, (unsigned long long)s->r.drops,
+             s->sent / s->seconds, s->r.packets / s->seconds,
+             s->cpu_us * 1000 / sent, s->r.cpu_us * 1000 / recv);
+   }
+   printf("]}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+
+   result_t rs[kMaxBufs];
+   int count = 0;
+   memset(rs, 0, sizeof(rs));
+   for (int i=0; i<conf.buf_count; i++) {
+      rs[count].bufsize = conf.bufs[i];
+      if (_run(&conf, &rs[count])) {
+         count++;
+      }
+   }
+   _report(&conf, rs, count);
+   return 0;
+}
+
+#endif  /* BENCH_UDP_C */
@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* TLS benchmark over extension/openssl, with self signed cert generated by
+ * 'make bench_openssl', forked server for each phase:
+ *
+ * - full: handshake without session cache and ticket
+ * - resume: reconnect with session offered by client, ticket or cache
+ * - bulk: client keep sending to server after handshake
+ * - idle: connections held after greeting, for memory per connection
+ *
+ * server greet 1 byte after accept, handshake counted when client got it,
+ * '-k' try kernel TLS, bulk phase reports client TX and server RX offloaded,
+ * '-t' server handshake threads, server loop dispatch p99 shows handshake stall,
+ * '-s' bulk message size, client writes 16KB in messages for each SEND event,
+ * '-r' for record each message, without client write coalescing,
+ * memory per connection in bulk and idle phases from RSS and counted OpenSSL
+ * heap, '-m' without SSL pool and idle buffer release, '-N' keeps Nagle on both
+ * sides, default TCP_NODELAY, or resumed handshakes measure delayed ACK stall
+ */
+
+#ifdef BENCH_TLS_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "mnet_tls.h"
+#include "bench.h"
+
+#define kBulkSize (16 * 1024)   // one TLS record
+
+enum {
+   PHASE_FULL = 0,
+   PHASE_RESUME,
+   PHASE_BULK,
+   PHASE_IDLE,
+   PHASE_COUNT,
+};
+
+static const char *g_phase_names[] = { "full", "resume", "bulk", "idle" };
+
+typedef struct {
+   int concurrency;
+   int duration;                // seconds for each phase
+   int tls12;                   // max TLS 1.2
+   int ktls;                    // try kernel TLS
+   int threads;                 // server handshake threads
+   int msg_size;                // bulk message size
+   int no_coalesce;             // record each message
+   int no_release;              // without SSL pool and buffer release
+   int nagle;                   // without TCP_NODELAY
+   int json;
+   const char *cert;
+   const char *key;
+   chann_addr_t addr;
+} conf_t;
+
+/* memory for open channs, delta from phase begin */
+typedef struct {
+   int64_t conns;
+   int64_t rss;
+   int64_t crypto;              // OpenSSL heap
+   int64_t ext;                 // TLS ud and coalesce buffers
+} mem_t;
+
+/* server report through pipe */
+typedef struct {
+   uint64_t accepts;
+   uint64_t reused;
+   uint64_t bytes;
+   uint64_t ktls;               // kernel TLS RX
+   uint64_t loop_p99;           // micro seconds for dispatch
+   uint64_t loop_max;
+   uint64_t offloaded;          // handshake steps in threads
+   mem_t mem;
+   double cpu_us;
+} svr_report_t;
+
+typedef struct {
+   int64_t begin;               // connect time
+   int greeted;
+} cnt_t;
+
+typedef struct {
+   const char *name;
+   uint64_t handshakes;
+   uint64_t reused;
+   uint64_t bytes;
+   uint64_t ktls;               // kernel TLS TX
+   uint64_t records;            // client coalesced records
+   uint64_t flushes;
+   mem_t mem;
+   int failed;
+   double seconds;
+   double cpu_us;
+   mnet_hist_t latency;         // micro seconds from connect to greeting
+   svr_report_t s;
+} result_t;
+
+static volatile sig_atomic_t g_stop;
+static uint8_t g_buf[kBulkSize];
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-a ip:port] [-n concurrency] [-d seconds] [-C cert] [-K key] [-2] [-k] [-t threads] [-s size] [-r] [-m] [-N] [-j]\n", argv[0]);
+   printf("  -2: max TLS 1.2, default TLS 1.3\n");
+   printf("  -k: try kernel TLS, requires tls module\n");
+   printf("  -t: server handshake threads, default in loop\n");
+   printf("  -s: bulk message size, default 16384\n");
+   printf("  -r: record each bulk message, without write coalescing\n");
+   printf("  -m: without SSL pool and idle buffer release\n");
+   printf("  -N: keep Nagle, without TCP_NODELAY on both sides\n");
+}
+
+static int
+_parse_conf(conf_t *conf, int argc, char *argv[]) {
+   conf->concurrency = 16;
+   conf->duration = 3;
+   conf->msg_size = kBulkSize;
+   conf->cert = "build/bench_tls.crt";
+   conf->key = "build/bench_tls.key";
+   const char *ipport = "127.0.0.1:9443";
+   int opt = 0;
+   while ((opt = getopt(argc, argv, "a:n:d:C:K:2kt:s:rmNjh")) != -1) {
+      switch (opt) {
+         case 'a': ipport = optarg; break;
+         case 'n': conf->concurrency = atoi(optarg); break;
+         case 'd': conf->duration = atoi(optarg); break;
+         case 'C': conf->cert = optarg; break;
+         case 'K': conf->key = optarg; break;
+         case '2': conf->tls12 = 1; break;
+         case 'k': conf->ktls = 1; break;
+         case 't': conf->threads = atoi(optarg); break;
+         case 's': conf->msg_size = atoi(optarg); break;
+         case 'r': conf->no_coalesce = 1; break;
+         case 'm': conf->no_release = 1; break;
+         case 'N': conf->nagle = 1; break;
+         case 'j': conf->json = 1; break;
+         default: return 0;
+      }
+   }
+   return mnet_parse_ipport(ipport, &conf->addr) > 0 && conf->concurrency > 0 && conf->duration > 0 &&
+      conf->msg_size > 0 && conf->msg_size <= kBulkSize;
+}
+
+static void
+_on_stop(int sig) {
+   g_stop = 1;
+}
+
+static double
+_cpu_us(void) {
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/* begin with sample, end with delta */
+static void
+_mem_sample(mem_t *m, int end) {
+   mnet_tls_mem_t tm;
+   memset(&tm, 0, sizeof(tm));
+   mnet_tls_mem_report(&tm);
+   mem_t cur = { tm.channs, bench_rss_bytes(), tm.crypto_bytes, tm.ud_bytes };
+   if (end) {
+      m->conns = cur.conns;
+      m->rss = cur.rss - m->rss;
+      m->crypto = cur.crypto - m->crypto;
+      m->ext = cur.ext - m->ext;
+   } else {
+      *m = cur;
+   }
+}
+
+static void
+_tls_options(conf_t *conf) {
+   // set on both sides, tickets or greeting not waiting for delayed ACK
+   mnet_tls_option(MNET_TLS_OPT_NODELAY, !conf->nagle);
+   if (conf->no_release) {
+      mnet_tls_option(MNET_TLS_OPT_SSL_POOL, 0);
+      mnet_tls_option(MNET_TLS_OPT_RELEASE_BUFFERS, 0);
+   }
+}
+
+static SSL_CTX*
+_ssl_ctx(conf_t *conf, int server) {
+   SSL_CTX *ctx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+   if (conf->tls12) {
+      SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+   }
+   if (server) {
+      if (SSL_CTX_use_certificate_file(ctx, conf->cert, SSL_FILETYPE_PEM) != 1 ||
+          SSL_CTX_use_PrivateKey_file(ctx, conf->key, SSL_FILETYPE_PEM) != 1)
+      {
+         printf("fail to load %s, %s, try 'make bench_openssl'\n", conf->cert, conf->key);
+         SSL_CTX_free(ctx);
+         return NULL;
+      }
+   } else {
+      SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+   }
+   return ctx;
+}
+
+/* server
+ */
+
+static void
+_run_server(conf_t *conf, int phase, int ready_fd, int report_fd) {
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = _on_stop;
+   sigaction(SIGTERM, &sa, NULL);
+
+   mnet_init();
+   mnet_setlog(0, NULL);        // peer closed without TLS shutdown
+   SSL_CTX *ctx = _ssl_ctx(conf, 1);
+   if (ctx == NULL || !mnet_tls_config(ctx)) {
+      exit(1);
+   }
+   if (phase == PHASE_FULL) {
+      mnet_tls_option(MNET_TLS_OPT_SESSION_CACHE, 0);
+      mnet_tls_option(MNET_TLS_OPT_TICKET_ROTATE, 0);
+   }
+   if (conf->ktls) {
+      mnet_tls_option(MNET_TLS_OPT_KTLS, 1);
+   }
+   if (conf->threads > 0 && !mnet_tls_option(MNET_TLS_OPT_HANDSHAKE_THREADS, conf->threads)) {
+      exit(1);
+   }
+   _tls_options(conf);
+   mnet_loop_hist_enable(1);
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_TLS);
+   if (!mnet_chann_listen(svr, conf->addr.ip, conf->addr.port, 1024)) {
+      printf("fail to listen %s:%d\n", conf->addr.ip, conf->addr.port);
+      exit(1);
+   }
+   svr_report_t r;
+   memset(&r, 0, sizeof(r));
+   _mem_sample(&r.mem, 0);
+   if (write(ready_fd, "r", 1) != 1) {
+      exit(1);
+   }
+   close(ready_fd);
+
+   double cpu_us = _cpu_us();
+   while (!g_stop) {
+      if (mnet_poll(100) < 0) {
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->n == svr) {
+            if (msg->event == CHANN_EVENT_ACCEPT) {
+               r.accepts++;
+               r.reused += SSL_session_reused(mnet_tls_chann_ssl(msg->r));
+               mnet_chann_send(msg->r, "g", 1);
+            }
+         } else if (msg->event == CHANN_EVENT_RECV) {
+            int ret = mnet_chann_recv(msg->n, g_buf, kBulkSize);
+            if (ret > 0) {
+               r.bytes += ret;
+            }
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            mnet_chann_close(msg->n);
+         }
+      }
+   }
+   r.cpu_us = _cpu_us() - cpu_us;
+   _mem_sample(&r.mem, 1);
+   mnet_tls_stats_t st;
+   mnet_tls_stats(&st);
+   r.ktls = st.ktls_recv;
+   r.offloaded = st.offloaded;
+   mnet_loop_hist_t hist;
+   if (mnet_loop_hist(&hist)) {
+      r.loop_p99 = mnet_hist_percentile(&hist.dispatch, 99);
+      r.loop_max = hist.dispatch.max;
+   }
+   if (write(report_fd, &r, sizeof(r)) != sizeof(r)) {
+      perror("report server");
+   }
+   close(report_fd);
+   mnet_fini();
+   SSL_CTX_free(ctx);
+}
+
+/* client
+ */
+
+static void
+_connect(conf_t *conf, result_t *res, cnt_t *c) {
+   chann_t *n = mnet_chann_open(CHANN_TYPE_TLS);
+   c->begin = mnet_tm_current();
+   c->greeted = 0;
+   mnet_chann_set_opaque(n, c);
+   if (!mnet_chann_connect(n, conf->addr.ip, conf->addr.port)) {
+      res->failed++;
+      mnet_chann_close(n);
+   }
+}
+
+/* 16KB in messages, return bytes accepted */
+static int
+_send_bulk(conf_t *conf, chann_t *n) {
+   int sent = 0;
+   for (; sent + conf->msg_size <= kBulkSize; sent += conf->msg_size) {
+      if (mnet_chann_send(n, g_buf, conf->msg_size) <= 0) {
+         break;
+      }
+   }
+   return sent;
+}
+
+static void
+_on_greeting(conf_t *conf, int phase, result_t *res, chann_msg_t *msg) {
+   cnt_t *c = (cnt_t *)msg->opaque;
+   c->greeted = 1;
+   res->handshakes++;
+   res->reused += SSL_session_reused(mnet_tls_chann_ssl(msg->n));
+   mnet_hist_record(&res->latency, mnet_tm_current() - c->begin);
+   if (phase == PHASE_BULK) {
+      mnet_chann_active_event(msg->n, CHANN_EVENT_SEND, 1);
+      _send_bulk(conf, msg->n);
+   } else if (phase != PHASE_IDLE) {
+      mnet_chann_close(msg->n);
+      _connect(conf, res, c);
+   }
+}
+
+/* server stopped and reported before client channs closed */
+static int
+_run_client(conf_t *conf, int phase, result_t *res, pid_t pid, int report_fd) {
+   mnet_init();
+   mnet_setlog(1, NULL);
+   SSL_CTX *ctx = _ssl_ctx(conf, 0);
+   if (!mnet_tls_config(ctx)) {
+      kill(pid, SIGTERM);
+      return 0;
+   }
+   _tls_options(conf);
+   if (phase == PHASE_FULL) {
+      mnet_tls_option(MNET_TLS_OPT_CLIENT_SESSIONS, 0);
+   }
+   if (conf->no_coalesce) {
+      mnet_tls_option(MNET_TLS_OPT_WRITE_COALESCE, 0);
+   }
+   if (conf->ktls && !mnet_tls_option(MNET_TLS_OPT_KTLS, 1) && phase == PHASE_BULK && !conf->json) {
+      printf("kernel TLS not available, fallback to user space\n");
+      fflush(stdout);
+   }
+   _mem_sample(&res->mem, 0);
+   cnt_t *cnts = (cnt_t *)calloc(conf->concurrency, sizeof(cnt_t));
+   for (int i=0; i<conf->concurrency; i++) {
+      _connect(conf, res, &cnts[i]);
+   }
+
+   double cpu_us = _cpu_us();
+   int64_t begin = mnet_tm_current();
+   int64_t end = begin + (int64_t)conf->duration * 1000 * 1000;
+   int64_t now = begin;
+   while ((now = mnet_tm_current()) < end) {
+      if (mnet_poll(100) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         cnt_t *c = (cnt_t *)msg->opaque;
+         if (msg->event == CHANN_EVENT_RECV) {
+            char buf[16];
+            if (mnet_chann_recv(msg->n, buf, sizeof(buf)) > 0 && !c->greeted) {
+               _on_greeting(conf, phase, res, msg);
+            }
+         } else if (msg->event == CHANN_EVENT_SEND) {
+            res->bytes += _send_bulk(conf, msg->n);
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            res->failed++;
+            mnet_chann_close(msg->n);
+            _connect(conf, res, c);
+         }
+      }
+   }
+   res->seconds = (now - begin) / 1e6;
+   res->cpu_us = _cpu_us() - cpu_us;
+   mnet_tls_stats_t st;
+   mnet_tls_stats(&st);
+   res->ktls = st.ktls_send;
+   res->records = st.records;
+   res->flushes = st.flushes;
+   _mem_sample(&res->mem, 1);
+   kill(pid, SIGTERM);
+   int ok = read(report_fd, &res->s, sizeof(res->s)) == sizeof(res->s);
+   mnet_fini();
+   SSL_CTX_free(ctx);
+   free(cnts);
+   return ok;
+}
+
+static int
+_run(conf_t *conf, int phase, result_t *res) {
+   int ready[2], report[2];
+   if (pipe(ready) < 0 || pipe(report) < 0) {
+      return 0;
+   }
+   pid_t pid = fork();
+   if (pid == 0) {
+      close(ready[0]);
+      close(report[0]);
+      _run_server(conf, phase, ready[1], report[1]);
+      exit(0);
+   }
+   close(ready[1]);
+   close(report[1]);
+   char c = 0;
+   if (pid < 0 || read(ready[0], &c, 1) != 1) {
+      printf("fail to start server\n");
+      waitpid(pid, NULL, 0);
+      return 0;
+   }
+   close(ready[0]);
+
+   res->name = g_phase_names[phase];
+   int ok = _run_client(conf, phase, res, pid, report[0]);
+   close(report[0]);
+   waitpid(pid, NULL, 0);
+   return ok;
+}
+
+static void
+_print_mem(const char *name, const mem_t *m) {
+   double conns = m->conns > 0 ? (double)m->conns : 1;
+   printf(" %s %lld conns, RSS %.0f, OpenSSL %.0f, ext %.0f bytes/conn", name, (long long)m->conns,
+          m->rss / conns, m->crypto / conns, m->ext / conns);
+}
+
+static void
+_json_mem(const char *name, const mem_t *m) {
+   double conns = m->conns > 0 ? (double)m->conns : 1;
+   printf("\"%s\":{\"conns\":%lld,\"rss_per_conn\":%.0f,\"crypto_per_conn\":%.0f,\"ext_per_conn\":%.0f}",
+          name, (long long)m->conns, m->rss / conns, m->crypto / conns, m->ext / conns);
+}
+
+static void
+_report(conf_t *conf, result_t *rs, int count) {
+   if (!conf->json) {
+      printf("tls %d concurrency, %s, TCP_NODELAY %s, %d seconds each phase\n", conf->concurrency,
+             conf->tls12 ? "TLS 1.2" : "TLS 1.3", conf->nagle ? "off" : "on", conf->duration);
+      for (int i=0; i<count; i++) {
+         result_t *r = &rs[i];
+         double hs = r->handshakes > 0 ? (double)r->handshakes : 1;
+         if (i == PHASE_BULK) {
+            double mb = r->s.bytes / (1024.0 * 1024.0);
+            printf("%-8s %.2f MB/s, client %.1f us/MB, server %.1f us/MB, kTLS %llu tx %llu rx, %d failed\n",
+                   r->name, mb / r->seconds, r->cpu_us / (mb > 0 ? mb : 1), r->s.cpu_us / (mb > 0 ? mb : 1),
+                   (unsigned long long)r->ktls, (unsigned long long)r->s.ktls, r->failed);
+            printf("  client %d bytes messages, %llu coalesced records, %llu flushes\n", conf->msg_size,
+                   (unsigned long long)r->records, (unsigned long long)r->flushes);
+         }
+         if (i == PHASE_BULK || i == PHASE_IDLE) {
+            printf("%-8s", i == PHASE_IDLE ? r->name : "  memory");
+            _print_mem("client", &r->mem);
+            printf(";");
+            _print_mem("server", &r->s.mem);
+            printf("\n");
+         } else {
+            printf("%-8s %llu handshakes, %.0f hs/s, %llu reused, client %.1f us/hs, server %.1f us/hs, %d failed\n",
+                   r->name, (unsigned long long)r->handshakes, r->handshakes / r->seconds,
+                   (unsigned long long)r->reused, r->cpu_us / hs, r->s.cpu_us / hs, r->failed);
+            printf("  server loop dispatch p99 %llu us, max %llu us, %llu steps in threads\n",
+                   (unsigned long long)r->s.loop_p99, (unsigned long long)r->s.loop_max,
+                   (unsigned long long)r->s.offloaded);
+            bench_print_hist(stdout, "  latency", "us", &r->latency);
+         }
+      }
+   }
+   printf("{\"bench\":\"tls\",\"version\":%d,\"concurrency\":%d,\"tls\":\"%s\",\"duration\":%d,"
+          "\"msg_size\":%d,\"coalesce\":%d,\"nodelay\":%d", mnet_version(), conf->concurrency,
+          conf->tls12 ? "1.2" : "1.3", conf->duration, conf->msg_size, !conf->no_coalesce, !conf->nagle);
+   // CPU in total of phase
+   for (int i=0; i<count; i++) {
+      result_t *r = &rs[i];
+      printf(",\"%s\":{\"seconds\":%.3f,\"handshakes\":%llu,\"hs_per_sec\":%.1f,\"reused\":%llu,"
+             "\"server_reused\":%llu,\"bytes\":%llu,\"mbps\":%.3f,\"client_cpu_us\":%.0f,\"server_cpu_us\":%.0f,"
+             "\"ktls_tx\":%llu,\"ktls_rx\":%llu,\"loop_p99_us\":%llu,\"loop_max_us\":%llu,\"offloaded\":%llu,"
+             "\"records\":%llu,\"flushes\":%llu,\"failed\":%d,",
+             r->name, r->seconds, (unsigned long long)r->handshakes, r->handshakes / r->seconds,
+             (unsigned long long)r->reused, (unsigned long long)r->s.reused, (unsigned long long)r->s.bytes,
+             r->s.bytes / (1024.0 * 1024.0) / r->seconds, r->cpu_us, r->s.cpu_us,
+             (unsigned long long)r->ktls, (unsigned long long)r->s.ktls, (unsigned long long)r->s.loop_p99,
+             (unsigned long long)r->s.loop_max, (unsigned long long)r->s.offloaded,
+             (unsigned long long)r->records, (unsigned long long)r->flushes, r->failed);
+      _json_mem("client_mem", &r->mem);
+      printf(",");
+      _json_mem("server_mem", &r->s.mem);
+      printf(",");
+      bench_json_hist(stdout, "latency_us", &r->latency);
+      printf("}");
+   }
+   printf("}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+   conf_t conf;
+   memset(&conf, 0, sizeof(conf));
+   if (!_parse_conf(&conf, argc, argv)) {
+      _print_help(argv);
+      return 0;
+   }
+   mnet_tls_mem_track();
+   SSL_library_init();
+   signal(SIGPIPE, SIG_IGN);
+
+   result_t rs[PHASE_COUNT];
+   memset(rs, 0, sizeof(rs));
+   int count = 0;
+   for (int i=0; i<PHASE_COUNT; i++) {
+      if (!_run(&conf, i, &rs[count])) {
+         break;
+      }
+      count++;
+   }
+   _report(&conf, rs, count);
+   return 0;
+}
+
+#endif  /* BENCH_TLS_C */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* decode binary trace from mnet_trace_dump(), one record each line
+ */
+
+#ifdef EXAMPLE_TRACE_DECODE_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnet_core.h"
+
+static const char*
+_op_name(int op) {
+   static const char *names[] = {
+      "?", "event", "recv", "send", "accept", "connect", "close",
+   };
+   return (op > 0 && op <= MNET_TRACE_CLOSE) ? names[op] : names[0];
+}
+
+static const char*
+_event_name(int event) {
+   static const char *names[] = {
+      "?", "recv", "send", "accept", "connected", "disconnect", "timer",
+   };
+   return (event >= CHANN_EVENT_RECV && event <= CHANN_EVENT_TIMER) ? names[event] : names[0];
+}
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: dump_file [chann_id]\n", argv[0]);
+}
+
+int
+main(int argc, char *argv[]) {
+   if (argc < 2) {
+      _print_help(argv);
+      return 0;
+   }
+
+   FILE *fp = fopen(argv[1], "rb");
+   if (fp == NULL) {
+      printf("fail to open %s\n", argv[1]);
+      return 1;
+   }
+   uint64_t filter = argc > 2 ? strtoull(argv[2], NULL, 10) : 0;
+
+   mnet_trace_hdr_t hdr;
+   if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+       hdr.magic != MNET_TRACE_MAGIC ||
+       hdr.version != MNET_TRACE_VERSION ||
+       hdr.rec_size != sizeof(mnet_trace_rec_t))
+   {
+      printf("invalid trace dump, or dumped from different byte order\n");
+      fclose(fp);
+      return 1;
+   }
+
+   printf("# pid %u, %u records, %llu overwritten\n", hdr.pid, hdr.count,
+          (unsigned long long)(hdr.total - hdr.count));
+   printf("# %16s %8s %6s %-8s %-10s %8s %6s\n", "micro_seconds", "chann", "fd", "op", "event", "bytes", "err");
+
+   mnet_trace_rec_t r;
+   int64_t first = 0;
+   uint32_t i = 0;
+   for (; i<hdr.count && fread(&r, sizeof(r), 1, fp) == 1; i++) {
+      if (i == 0) {
+         first = r.ts;
+      }
+      if (filter && r.chann_id != filter) {
+         continue;
+      }
+      printf("%+18lld %8llu %6d %-8s %-10s %8d %6d\n", (long long)(r.ts - first),
+             (unsigned long long)r.chann_id, r.fd, _op_name(r.op),
+             r.op == MNET_TRACE_EVENT ? _event_name(r.event) : "-", r.bytes, r.err);
+   }
+   fclose(fp);
+
+   if (i < hdr.count) {
+      printf("# truncated, %u of %u records\n", i, hdr.count);
+      return 1;
+   }
+   return 0;
+}
+
+#endif  /* EXAMPLE_TRACE_DECODE_C */
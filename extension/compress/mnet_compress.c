@@ -0,0 +1,682 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "mnet_compress.h"
+
+#define MNET_COMPRESS_CHUNK (32 * 1024)     /* recv buffer, and send buffer step */
+#define MNET_COMPRESS_BACKLOG (256 * 1024)  /* compressed bytes before chann cached */
+#define MNET_COMPRESS_POOL 64               /* pooled contexts for new channs */
+#define MNET_COMPRESS_LEVEL 1               /* fast level for in loop compressing */
+#define MNET_COMPRESS_ZLIB_MAGIC 0x78       /* zlib header with 32K window */
+#define MNET_COMPRESS_ZSTD_MAGIC 0x28       /* first byte of zstd frame magic */
+
+chann_type_t const CHANN_TYPE_COMPRESS = 6;
+
+typedef struct s_compress_ud {
+    int algo;                           /* for sending */
+    int level;
+    int flush;                          /* flush policy */
+    int dirty;                          /* sended data not flushed */
+    int sended;                         /* stream started, algo fixed */
+    int ralgo;                          /* detected from first byte received, 0 for unknown */
+    int rmore;                          /* decoder output full, more data inside */
+    int zd_init;                        /* deflate stream */
+    int zi_init;                        /* inflate stream */
+    z_stream zd;
+    z_stream zi;
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+    ZSTD_CCtx *cz;
+    ZSTD_DCtx *dz;
+#endif
+    uint8_t *obuf;                      /* compressed data for lower layer */
+    int ocap;
+    int opos;
+    int olen;
+    uint8_t *ibuf;                      /* compressed data from lower layer */
+    int ipos;
+    int ilen;
+    struct s_compress_ud *free_next;
+} mnet_compress_ud_t;
+
+typedef struct {
+    int init;
+    chann_type_t lower;
+    int algo;                           /* defaults for new channs */
+    int level;
+    int flush;
+    int pool_size;
+    int pool_count;
+    mnet_compress_ud_t *free_uds;
+    mnet_compress_stats_t stats;
+} mnet_compress_t;
+
+static mnet_compress_t g_cm;
+
+static inline mnet_compress_ud_t*
+_cm_ud(chann_t *n) {
+    return (mnet_compress_ud_t *)mnet_ext_chann_layer_ud(n, CHANN_TYPE_COMPRESS);
+}
+
+/** contexts and buffers
+ */
+
+static int
+_ud_level(mnet_compress_ud_t *cu, int level);
+
+static void
+_ud_reset(mnet_compress_ud_t *cu) {
+    if (cu->zd_init) {
+        deflateReset(&cu->zd);
+    }
+    if (cu->zi_init) {
+        inflateReset(&cu->zi);
+    }
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+    if (cu->cz) {
+        ZSTD_CCtx_reset(cu->cz, ZSTD_reset_session_only);
+    }
+    if (cu->dz) {
+        ZSTD_DCtx_reset(cu->dz, ZSTD_reset_session_only);
+    }
+#endif
+    cu->dirty = 0;
+    cu->sended = 0;
+    cu->ralgo = 0;
+    cu->rmore = 0;
+    cu->opos = cu->olen = 0;
+    cu->ipos = cu->ilen = 0;
+}
+
+static void
+_ud_destroy(mnet_compress_ud_t *cu) {
+    if (cu->zd_init) {
+        deflateEnd(&cu->zd);
+    }
+    if (cu->zi_init) {
+        inflateEnd(&cu->zi);
+    }
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+    ZSTD_freeCCtx(cu->cz);
+    ZSTD_freeDCtx(cu->dz);
+#endif
+    free(cu->obuf);
+    free(cu->ibuf);
+    free(cu);
+}
+
+/** pooled ud keep contexts, reset instead of init again for new chann */
+static mnet_compress_ud_t*
+_ud_new(mnet_compress_t *cm) {
+    mnet_compress_ud_t *cu = cm->free_uds;
+    if (cu) {
+        cm->free_uds = cu->free_next;
+        cm->pool_count -= 1;
+        cu->free_next = NULL;
+        cm->stats.pool_hits += 1;
+    } else {
+        cu = (mnet_compress_ud_t *)calloc(1, sizeof(mnet_compress_ud_t));
+        if (cu == NULL) {
+            return NULL;
+        }
+        cu->level = cm->level;
+    }
+    cu->algo = cm->algo;
+    cu->flush = cm->flush;
+    if (cu->level != cm->level && !_ud_level(cu, cm->level)) {
+        _ud_destroy(cu);
+        return NULL;
+    }
+    return cu;
+}
+
+static void
+_ud_free(mnet_compress_t *cm, mnet_compress_ud_t *cu) {
+    if (cu == NULL) {
+        return;
+    }
+    if (cm->pool_count >= cm->pool_size) {
+        _ud_destroy(cu);
+        return;
+    }
+    _ud_reset(cu);
+    free(cu->obuf);
+    free(cu->ibuf);
+    cu->obuf = cu->ibuf = NULL;
+    cu->ocap = 0;
+    cu->free_next = cm->free_uds;
+    cm->free_uds = cu;
+    cm->pool_count += 1;
+}
+
+static void
+_uds_free(mnet_compress_t *cm, int keep) {
+    while (cm->free_uds && cm->pool_count > keep) {
+        mnet_compress_ud_t *cu = cm->free_uds;
+        cm->free_uds = cu->free_next;
+        cm->pool_count -= 1;
+        _ud_destroy(cu);
+    }
+}
+
+/** free space in send buffer, sent bytes compacted first */
+static int
+_obuf_reserve(mnet_compress_ud_t *cu, int size) {
+    if (cu->opos > 0) {
+        memmove(cu->obuf, cu->obuf + cu->opos, cu->olen - cu->opos);
+        cu->olen -= cu->opos;
+        cu->opos = 0;
+    }
+    if (cu->ocap - cu->olen >= size) {
+        return 1;
+    }
+    int cap = cu->ocap > 0 ? cu->ocap : MNET_COMPRESS_CHUNK;
+    while (cap - cu->olen < size) {
+        cap *= 2;
+    }
+    uint8_t *buf = (uint8_t *)realloc(cu->obuf, cap);
+    if (buf == NULL) {
+        return 0;
+    }
+    cu->obuf = buf;
+    cu->ocap = cap;
+    return 1;
+}
+
+/** level for next sending, zstd only before first send */
+static int
+_ud_level(mnet_compress_ud_t *cu, int level) {
+    if (cu->zd_init) {
+        if (!_obuf_reserve(cu, MNET_COMPRESS_CHUNK)) {
+            return 0;
+        }
+        cu->zd.next_out = cu->obuf + cu->olen;
+        cu->zd.avail_out = cu->ocap - cu->olen;
+        int ret = deflateParams(&cu->zd, level, Z_DEFAULT_STRATEGY);
+        cu->olen = cu->ocap - cu->zd.avail_out;
+        if (ret != Z_OK) {
+            return 0;
+        }
+    }
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+    if (cu->cz && ZSTD_isError(ZSTD_CCtx_setParameter(cu->cz, ZSTD_c_compressionLevel, level))) {
+        return 0;
+    }
+#endif
+    cu->level = level;
+    return 1;
+}
+
+/** compress into send buffer, with sync flush at last
+ */
+
+static int
+_zlib_encode(mnet_compress_ud_t *cu, void *buf, int len, int flush) {
+    z_stream *zs = &cu->zd;
+    if (!cu->zd_init) {
+        if (deflateInit(zs, cu->level) != Z_OK) {
+            return 0;
+        }
+        cu->zd_init = 1;
+    }
+    zs->next_in = (Bytef *)buf;
+    zs->avail_in = len;
+    do {
+        if (!_obuf_reserve(cu, MNET_COMPRESS_CHUNK)) {
+            return 0;
+        }
+        zs->next_out = cu->obuf + cu->olen;
+        zs->avail_out = cu->ocap - cu->olen;
+        int ret = deflate(zs, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+        cu->olen = cu->ocap - zs->avail_out;
+        if (ret == Z_STREAM_ERROR) {
+            return 0;
+        }
+    } while (zs->avail_in > 0 || zs->avail_out == 0);
+    return 1;
+}
+
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+static int
+_zstd_encode(mnet_compress_ud_t *cu, void *buf, int len, int flush) {
+    if (cu->cz == NULL) {
+        cu->cz = ZSTD_createCCtx();
+        if (cu->cz == NULL ||
+            ZSTD_isError(ZSTD_CCtx_setParameter(cu->cz, ZSTD_c_compressionLevel, cu->level)))
+        {
+            return 0;
+        }
+    }
+    ZSTD_inBuffer in = { buf, (size_t)len, 0 };
+    size_t remain = 0;
+    do {
+        if (!_obuf_reserve(cu, MNET_COMPRESS_CHUNK)) {
+            return 0;
+        }
+        ZSTD_outBuffer out = { cu->obuf + cu->olen, (size_t)(cu->ocap - cu->olen), 0 };
+        remain = ZSTD_compressStream2(cu->cz, &out, &in, flush ? ZSTD_e_flush : ZSTD_e_continue);
+        cu->olen += (int)out.pos;
+        if (ZSTD_isError(remain)) {
+            return 0;
+        }
+    } while (in.pos < in.size || (flush && remain > 0));
+    return 1;
+}
+#endif
+
+static int
+_encode(mnet_compress_t *cm, mnet_compress_ud_t *cu, void *buf, int len, int flush) {
+    if (flush) {
+        cm->stats.flushes += 1;
+    }
+    cu->sended = 1;
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+    if (cu->algo == MNET_COMPRESS_ZSTD) {
+        return _zstd_encode(cu, buf, len, flush);
+    }
+#endif
+    return _zlib_encode(cu, buf, len, flush);
+}
+
+/** decompress from recv buffer, return bytes or -1 for error
+ */
+
+static int
+_zlib_decode(mnet_compress_ud_t *cu, void *buf, int len) {
+    z_stream *zs = &cu->zi;
+    if (!cu->zi_init) {
+        if (inflateInit(zs) != Z_OK) {
+            return -1;
+        }
+        cu->zi_init = 1;
+    }
+    zs->next_in = cu->ibuf + cu->ipos;
+    zs->avail_in = cu->ilen - cu->ipos;
+    zs->next_out = (Bytef *)buf;
+    zs->avail_out = len;
+    int ret = inflate(zs, Z_SYNC_FLUSH);
+    cu->ipos = cu->ilen - zs->avail_in;
+    cu->rmore = zs->avail_out == 0;
+    if (ret == Z_STREAM_END) {
+        // peer may start next stream, nothing more from this one
+        inflateReset(zs);
+        cu->ralgo = 0;
+        cu->rmore = 0;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return -1;
+    }
+    return len - zs->avail_out;
+}
+
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+static int
+_zstd_decode(mnet_compress_ud_t *cu, void *buf, int len) {
+    if (cu->dz == NULL) {
+        cu->dz = ZSTD_createDCtx();
+        if (cu->dz == NULL) {
+            return -1;
+        }
+    }
+    ZSTD_inBuffer in = { cu->ibuf, (size_t)cu->ilen, (size_t)cu->ipos };
+    ZSTD_outBuffer out = { buf, (size_t)len, 0 };
+    size_t ret = ZSTD_decompressStream(cu->dz, &out, &in);
+    if (ZSTD_isError(ret)) {
+        return -1;
+    }
+    cu->ipos = (int)in.pos;
+    cu->rmore = out.pos == out.size;
+    return (int)out.pos;
+}
+#endif
+
+static int
+_decode(mnet_compress_ud_t *cu, void *buf, int len) {
+    if (cu->ralgo == 0) {
+        if (cu->ipos >= cu->ilen) {
+            // magic of next stream not received
+            return 0;
+        }
+        uint8_t magic = cu->ibuf[cu->ipos];
+        if (magic == MNET_COMPRESS_ZLIB_MAGIC) {
+            cu->ralgo = MNET_COMPRESS_ZLIB;
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+        } else if (magic == MNET_COMPRESS_ZSTD_MAGIC) {
+            cu->ralgo = MNET_COMPRESS_ZSTD;
+#endif
+        } else {
+            return -1;
+        }
+    }
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+    if (cu->ralgo == MNET_COMPRESS_ZSTD) {
+        return _zstd_decode(cu, buf, len);
+    }
+#endif
+    return _zlib_decode(cu, buf, len);
+}
+
+/** compressed data to lower layer, return 1 for drained, 0 for blocked */
+static int
+_cm_send_lower(mnet_compress_t *cm, chann_t *n, mnet_compress_ud_t *cu) {
+    while (cu->opos < cu->olen) {
+        int ret = mnet_ext_lower_send(n, cu->obuf + cu->opos, cu->olen - cu->opos);
+        if (ret <= 0) {
+            return ret;
+        }
+        cu->opos += ret;
+        cm->stats.send_bytes += ret;
+    }
+    cu->opos = cu->olen = 0;
+    return 1;
+}
+
+/** mnet ext callbacks
+ */
+
+static int
+_cm_type_fn(void *ext_ctx, chann_type_t ctype) {
+    return CHANN_TYPE_STREAM;
+}
+
+static int
+_cm_filter_fn(void *ext_ctx, chann_msg_t *msg) {
+    return 1;
+}
+
+static void
+_cm_open_cb(void *ext_ctx, chann_t *n) {
+    mnet_ext_chann_set_ud(n, _ud_new((mnet_compress_t *)ext_ctx));
+}
+
+static void
+_cm_close_cb(void *ext_ctx, chann_t *n) {
+    _ud_free((mnet_compress_t *)ext_ctx, mnet_ext_chann_get_ud(n));
+    mnet_ext_chann_set_ud(n, NULL);
+}
+
+static void
+_cm_listen_cb(void *ext_ctx, chann_t *n) {
+    // listen chann without contexts
+    _cm_close_cb(ext_ctx, n);
+}
+
+static void
+_cm_accept_cb(void *ext_ctx, chann_t *n) {
+    mnet_compress_ud_t *cu = _ud_new((mnet_compress_t *)ext_ctx);
+    mnet_ext_chann_set_ud(n, cu);
+    if (cu == NULL) {
+        mnet_chann_disconnect(n);
+    }
+}
+
+static void
+_cm_connect_cb(void *ext_ctx, chann_t *n) {
+}
+
+/** flush sended data best effort, lower layer disconnect after, and reset
+ * contexts for reconnect
+ */
+static void
+_cm_disconnect_cb(void *ext_ctx, chann_t *n) {
+    mnet_compress_t *cm = (mnet_compress_t *)ext_ctx;
+    mnet_compress_ud_t *cu = mnet_ext_chann_get_ud(n);
+    if (cu == NULL) {
+        return;
+    }
+    if (cu->dirty) {
+        cu->dirty = 0;
+        _encode(cm, cu, NULL, 0, 1);
+    }
+    _cm_send_lower(cm, n, cu);
+    _ud_reset(cu);
+}
+
+static int
+_cm_state_fn(void *ext_ctx, chann_t *n, int state) {
+    return state;
+}
+
+/** decode from recv buffer, read lower layer when decoder need more, mark
+ * pending with data left in buffer or decoder
+ */
+static int
+_cm_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+    mnet_compress_t *cm = (mnet_compress_t *)ext_ctx;
+    mnet_compress_ud_t *cu = mnet_ext_chann_get_ud(n);
+    if (cu == NULL) {
+        return -1;
+    }
+    if (cu->ibuf == NULL) {
+        cu->ibuf = (uint8_t *)malloc(MNET_COMPRESS_CHUNK);
+        if (cu->ibuf == NULL) {
+            return -1;
+        }
+    }
+    for (;;) {
+        if (cu->ipos < cu->ilen || cu->rmore) {
+            int ret = _decode(cu, buf, len);
+            if (ret < 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            if (ret > 0) {
+                cm->stats.recv_plain += ret;
+                mnet_ext_chann_pending(n, cu->ipos < cu->ilen || cu->rmore);
+                return ret;
+            }
+            cu->rmore = 0;
+        }
+        if (cu->ipos > 0) {
+            memmove(cu->ibuf, cu->ibuf + cu->ipos, cu->ilen - cu->ipos);
+            cu->ilen -= cu->ipos;
+            cu->ipos = 0;
+        }
+        if (cu->ilen >= MNET_COMPRESS_CHUNK) {
+            errno = EPROTO;
+            return -1;
+        }
+        int ret = mnet_ext_lower_recv(n, cu->ibuf + cu->ilen, MNET_COMPRESS_CHUNK - cu->ilen);
+        if (ret <= 0) {
+            mnet_ext_chann_pending(n, 0);
+            return ret;
+        }
+        cu->ilen += ret;
+        cm->stats.recv_bytes += ret;
+    }
+}
+
+/** compress into send buffer, flushed in pass or each send, return 0 to
+ * cache in chann when compressed backlog not drained
+ */
+static int
+_cm_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+    mnet_compress_t *cm = (mnet_compress_t *)ext_ctx;
+    mnet_compress_ud_t *cu = mnet_ext_chann_get_ud(n);
+    if (cu == NULL) {
+        return -1;
+    }
+    if (cu->olen - cu->opos >= MNET_COMPRESS_BACKLOG) {
+        if (_cm_send_lower(cm, n, cu) < 0) {
+            return -1;
+        }
+        if (cu->olen - cu->opos >= MNET_COMPRESS_BACKLOG) {
+            mnet_ext_chann_flush(n);
+            return 0;
+        }
+    }
+    int flush = cu->flush == MNET_COMPRESS_FLUSH_SEND;
+    if (!_encode(cm, cu, buf, len, flush)) {
+        errno = EPROTO;
+        return -1;
+    }
+    cm->stats.send_plain += len;
+    if (flush) {
+        cu->dirty = 0;
+        int ret = _cm_send_lower(cm, n, cu);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            mnet_ext_chann_flush(n);
+        }
+    } else {
+        cu->dirty = 1;
+        mnet_ext_chann_flush(n);
+    }
+    return len;
+}
+
+/** sync flush sends in pass, 1 for drained, 0 for blocked */
+static int
+_cm_flush_fn(void *ext_ctx, chann_t *n) {
+    mnet_compress_t *cm = (mnet_compress_t *)ext_ctx;
+    mnet_compress_ud_t *cu = mnet_ext_chann_get_ud(n);
+    if (cu == NULL) {
+        return 1;
+    }
+    if (cu->dirty) {
+        cu->dirty = 0;
+        if (!_encode(cm, cu, NULL, 0, 1)) {
+            errno = EPROTO;
+            return -1;
+        }
+    }
+    return _cm_send_lower(cm, n, cu);
+}
+
+/** public interface
+ */
+
+int
+mnet_compress_config(chann_type_t lower) {
+    mnet_compress_t *cm = &g_cm;
+    mnet_ext_t ext = {
+        .ext_ctx = cm,
+        .type_fn = _cm_type_fn,
+        .filter_fn = _cm_filter_fn,
+        .open_cb = _cm_open_cb,
+        .close_cb = _cm_close_cb,
+        .listen_cb = _cm_listen_cb,
+        .accept_cb = _cm_accept_cb,
+        .connect_cb = _cm_connect_cb,
+        .disconnect_cb = _cm_disconnect_cb,
+        .state_fn = _cm_state_fn,
+        .recv_fn = _cm_recv_fn,
+        .send_fn = _cm_send_fn,
+        .flush_fn = _cm_flush_fn,
+        .lower = lower,
+    };
+    if (!mnet_ext_register(CHANN_TYPE_COMPRESS, &ext)) {
+        // registered before mnet_fini()
+        return cm->init && cm->lower == lower;
+    }
+    if (!cm->init) {
+        cm->init = 1;
+        cm->algo = MNET_COMPRESS_ZLIB;
+        cm->level = MNET_COMPRESS_LEVEL;
+        cm->flush = MNET_COMPRESS_FLUSH_PASS;
+        cm->pool_size = MNET_COMPRESS_POOL;
+    }
+    cm->lower = lower;
+    return 1;
+}
+
+int
+mnet_compress_option(mnet_compress_option_t opt, int value) {
+    mnet_compress_t *cm = &g_cm;
+    if (!cm->init || value < 0) {
+        return 0;
+    }
+    switch (opt) {
+        case MNET_COMPRESS_OPT_ALGO: {
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+            if (value != MNET_COMPRESS_ZLIB && value != MNET_COMPRESS_ZSTD) {
+                return 0;
+            }
+#else
+            if (value != MNET_COMPRESS_ZLIB) {
+                return 0;
+            }
+#endif
+            cm->algo = value;
+            return 1;
+        }
+        case MNET_COMPRESS_OPT_LEVEL: {
+            cm->level = value;
+            return 1;
+        }
+        case MNET_COMPRESS_OPT_FLUSH: {
+            if (value > MNET_COMPRESS_FLUSH_SEND) {
+                return 0;
+            }
+            cm->flush = value;
+            return 1;
+        }
+        case MNET_COMPRESS_OPT_POOL: {
+            cm->pool_size = value;
+            _uds_free(cm, value);
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+int
+mnet_compress_chann_option(chann_t *n, mnet_compress_option_t opt, int value) {
+    mnet_compress_ud_t *cu = n ? _cm_ud(n) : NULL;
+    if (cu == NULL || value < 0) {
+        return 0;
+    }
+    switch (opt) {
+        case MNET_COMPRESS_OPT_ALGO: {
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+            if (value != MNET_COMPRESS_ZLIB && value != MNET_COMPRESS_ZSTD) {
+                return 0;
+            }
+#else
+            if (value != MNET_COMPRESS_ZLIB) {
+                return 0;
+            }
+#endif
+            if (cu->sended && value != cu->algo) {
+                return 0;
+            }
+            cu->algo = value;
+            return 1;
+        }
+        case MNET_COMPRESS_OPT_LEVEL: {
+            if (cu->sended && cu->algo == MNET_COMPRESS_ZSTD) {
+                return 0;
+            }
+            return _ud_level(cu, value);
+        }
+        case MNET_COMPRESS_OPT_FLUSH: {
+            if (value > MNET_COMPRESS_FLUSH_SEND) {
+                return 0;
+            }
+            cu->flush = value;
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+void
+mnet_compress_stats(mnet_compress_stats_t *stats) {
+    if (stats) {
+        *stats = g_cm.stats;
+    }
+}
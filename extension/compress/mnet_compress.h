@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef MNET_COMPRESS_H
+#define MNET_COMPRESS_H
+
+#include "mnet_core.h"
+
+extern chann_type_t const CHANN_TYPE_COMPRESS;
+
+typedef enum {
+    MNET_COMPRESS_ZLIB = 1,             /* deflate with zlib header */
+    MNET_COMPRESS_ZSTD,                 /* zstd frame, built with MNET_COMPRESS_HAVE_ZSTD */
+} mnet_compress_algo_t;
+
+typedef enum {
+    MNET_COMPRESS_FLUSH_PASS = 0,       /* sync flush sends in dispatch pass before next poll wait */
+    MNET_COMPRESS_FLUSH_SEND,           /* sync flush each send */
+} mnet_compress_flush_t;
+
+typedef enum {
+    MNET_COMPRESS_OPT_ALGO = 1,         /* algorithm for sending, peer detect from stream, default zlib */
+    MNET_COMPRESS_OPT_LEVEL,            /* zlib 0 ~ 9, or zstd 1 ~ 19, default 1 */
+    MNET_COMPRESS_OPT_FLUSH,            /* flush policy, default MNET_COMPRESS_FLUSH_PASS */
+    MNET_COMPRESS_OPT_POOL,             /* reset contexts kept for new channs, 0 to free, default 64, not for chann */
+} mnet_compress_option_t;
+
+typedef struct {
+    uint64_t send_plain;                /* bytes from mnet_chann_send() */
+    uint64_t send_bytes;                /* compressed bytes to lower layer */
+    uint64_t recv_bytes;                /* compressed bytes from lower layer */
+    uint64_t recv_plain;                /* bytes to mnet_chann_recv() */
+    uint64_t flushes;                   /* sync flush points */
+    uint64_t pool_hits;                 /* channs with pooled contexts */
+} mnet_compress_stats_t;
+
+/* register CHANN_TYPE_COMPRESS over lower, 0 for STREAM, or registered
+ * stream ext like CHANN_TYPE_TLS, return 1 for ok
+ */
+int mnet_compress_config(chann_type_t lower);
+
+/* set default option for new channs after config, return 1 for ok */
+int mnet_compress_option(mnet_compress_option_t opt, int value);
+
+/* set option for chann, algo only before first send, zstd level only before
+ * first send, return 1 for ok
+ */
+int mnet_compress_chann_option(chann_t *n, mnet_compress_option_t opt, int value);
+
+/* compressed and plain bytes counters */
+void mnet_compress_stats(mnet_compress_stats_t *stats);
+
+#endif
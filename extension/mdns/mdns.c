@@ -118,9 +118,12 @@ _response_check_header(const uint8_t *buf) {
        (rh->rd != 1) ||
        (rh->z != 0) ||
        (rh->qdcount != htons(1)) ||
-       (rh->ancount == 0 && code == 0) ||
        (code >= 6 && code <= 15))
    {
+      return -20;
+   }
+
+   if (rh->ancount == 0 && code == 0) {
       return -10;
    }
 
@@ -165,7 +168,8 @@ static int
 _response_fetch_res(const uint8_t *buf,
                     int content_len,
                     int query_size,
-                    uint8_t *out_ipv4)
+                    uint8_t *out_ipv4,
+                    uint32_t *out_ttl)
 {
    const dns_header_t *rh = (dns_header_t*)buf;
    int aname_size = 0;
@@ -210,6 +214,9 @@ _response_fetch_res(const uint8_t *buf,
          int offset = prev_size + aname_size + _sizeof_dns_rr_data();
          uint8_t *result = (uint8_t*)&buf[offset];
          memcpy(out_ipv4, result, 4);
+         if (out_ttl) {
+            *out_ttl = ntohl(rsp_answer->ttl);
+         }
          return 1;
       }
 
@@ -285,14 +292,28 @@ mdns_response_parse(uint8_t *buf,
                     int query_size,
                     const char *domain,
                     uint8_t *out_ipv4)
+{
+   return mdns_response_parse_ttl(buf, content_len, query_size, domain, out_ipv4, NULL);
+}
+
+int
+mdns_response_parse_ttl(uint8_t *buf,
+                        int content_len,
+                        int query_size,
+                        const char *domain,
+                        uint8_t *out_ipv4,
+                        uint32_t *out_ttl)
 {
    if (!buf || content_len<=0 || query_size<=0 || !domain || !out_ipv4) {
       return 0;
    }
+   if (content_len < query_size) {
+      return -30;
+   }
 
    int ret_header = _response_check_header(buf);
    int ret_question = _response_check_question(buf, query_size, domain);
-   int ret_res = _response_fetch_res(buf, content_len, query_size, out_ipv4);
+   int ret_res = _response_fetch_res(buf, content_len, query_size, out_ipv4, out_ttl);
    if (ret_header > 0 && ret_question > 0 && ret_res > 0) {
       return 1;
    }
@@ -40,4 +40,17 @@ int mdns_response_parse(uint8_t *buf,
                         const char *domain,
                         uint8_t *out_ipv4);
 
+/* -- same as mdns_response_parse, also output answer TTL
+ * out_ttl: TTL seconds for the answer, can be NULL
+ * --
+ * return: 1 for ok, -10 for no answer, -13 for domain not exist,
+ * -20 for malformed header, other <= 0 for error
+ */
+int mdns_response_parse_ttl(uint8_t *buf,
+                            int content_len,
+                            int query_size,
+                            const char *domain,
+                            uint8_t *out_ipv4,
+                            uint32_t *out_ttl);
+
 #endif
@@ -0,0 +1,814 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#if defined(_WIN32) || defined(_WIN64)
+#define _CRT_RAND_S             /* rand_s for qid */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "mdns.h"
+#include "mdns_resolver.h"
+#if defined(_WIN32) || defined(_WIN64)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+#endif
+
+chann_type_t const CHANN_TYPE_MDNS = 5;
+
+#define MDNS_BUF_SIZE 1024      /* required by mdns_query_build */
+#define MDNS_DOMAIN_LEN 256
+#define MDNS_NS_MAX 3           /* same as resolv.conf MAXNS */
+#define MDNS_HASH_SIZE 1024     /* domain hash buckets */
+#define MDNS_QID_SIZE 256       /* qid hash buckets */
+
+enum {
+   ENTRY_PENDING = 0,           /* query in flight */
+   ENTRY_POSITIVE,              /* cached address */
+   ENTRY_NEGATIVE,              /* cached NXDOMAIN */
+   ENTRY_HOSTS,                 /* from hosts file, never expire */
+};
+
+typedef struct s_waiter {
+   mdns_resolve_cb cb;
+   void *ud;
+   struct s_waiter *next;
+} waiter_t;
+
+typedef struct s_entry entry_t;
+
+typedef struct s_query {
+   uint16_t qid;
+   int query_size;
+   int tries;                   /* sended count */
+   int ns_sent;                 /* bit mask of queried nameservers */
+   int64_t deadline;            /* micro seconds for next try */
+   entry_t *entry;
+   waiter_t *waiters;
+   struct s_query *qnext;       /* qid bucket chain */
+   struct s_query *prev;        /* in flight list */
+   struct s_query *next;
+} query_t;
+
+struct s_entry {
+   char *domain;                /* lower case key */
+   uint32_t hash;
+   int state;
+   uint8_t ipv4[4];
+   int64_t expire;              /* micro seconds */
+   query_t *query;              /* for ENTRY_PENDING */
+   entry_t *hnext;              /* hash bucket chain */
+   entry_t *prev;               /* LRU list, not for ENTRY_HOSTS */
+   entry_t *next;
+};
+
+typedef struct {
+   int init;
+   int registered;
+   chann_t *chann;              /* opened when query in flight */
+
+   struct sockaddr_in ns[MDNS_NS_MAX];
+   int ns_count;
+   int ns_index;                /* nameserver for next send */
+   int ns_from;                 /* nameserver of last received datagram */
+
+   int timeout_ms;
+   int attempts;
+   int cache_size;
+   int negative_ttl;
+
+   int entry_count;             /* entries in LRU */
+   entry_t lru;                 /* LRU sentinel, next for newest */
+   entry_t *htable[MDNS_HASH_SIZE];
+
+   int query_count;             /* queries in flight */
+   query_t *queries;
+   query_t *qtable[MDNS_QID_SIZE];
+
+   uint8_t buf[MDNS_BUF_SIZE];
+} resolver_t;
+
+static resolver_t g_resolver;
+
+static inline int64_t
+_sec_to_us(int64_t sec) {
+   return sec * 1000000;
+}
+
+static inline int
+_sock_would_block(void) {
+#if defined(_WIN32) || defined(_WIN64)
+   return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+   return errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+}
+
+static uint32_t
+_domain_hash(const char *domain) {
+   uint32_t h = 2166136261u;
+   for (; *domain; domain++) {
+      h = (h ^ (uint8_t)*domain) * 16777619u;
+   }
+   return h;
+}
+
+/* lower case without last dot, return length, 0 for invalid */
+static int
+_domain_key(char *key, const char *domain) {
+   int len = 0;
+   for (; domain[len] && len<MDNS_DOMAIN_LEN-1; len++) {
+      key[len] = tolower((unsigned char)domain[len]);
+   }
+   if (domain[len]) {
+      return 0;
+   }
+   if (len>0 && key[len-1]=='.') {
+      len -= 1;
+   }
+   key[len] = 0;
+   return len;
+}
+
+/* domain entry
+ */
+
+static inline void
+_lru_unlink(entry_t *e) {
+   if (e->prev) {
+      e->prev->next = e->next;
+      e->next->prev = e->prev;
+      e->prev = e->next = NULL;
+   }
+}
+
+static inline void
+_lru_push(resolver_t *r, entry_t *e) {
+   e->next = r->lru.next;
+   e->prev = &r->lru;
+   r->lru.next->prev = e;
+   r->lru.next = e;
+}
+
+static entry_t*
+_entry_find(resolver_t *r, const char *key, uint32_t hash) {
+   entry_t *e = r->htable[hash & (MDNS_HASH_SIZE - 1)];
+   for (; e; e = e->hnext) {
+      if (e->hash == hash && strcmp(e->domain, key) == 0) {
+         return e;
+      }
+   }
+   return NULL;
+}
+
+static void
+_entry_remove(resolver_t *r, entry_t *e) {
+   entry_t **pe = &r->htable[e->hash & (MDNS_HASH_SIZE - 1)];
+   for (; *pe; pe = &(*pe)->hnext) {
+      if (*pe == e) {
+         *pe = e->hnext;
+         break;
+      }
+   }
+   if (e->prev) {
+      _lru_unlink(e);
+      r->entry_count -= 1;
+   }
+   free(e->domain);
+   free(e);
+}
+
+/* evict oldest entry not in flight */
+static void
+_entry_evict(resolver_t *r) {
+   entry_t *e = r->lru.prev;
+   while (r->entry_count > r->cache_size && e != &r->lru) {
+      entry_t *prev = e->prev;
+      if (e->state != ENTRY_PENDING) {
+         _entry_remove(r, e);
+      }
+      e = prev;
+   }
+}
+
+static entry_t*
+_entry_create(resolver_t *r, const char *key, uint32_t hash, int state) {
+   entry_t *e = (entry_t *)calloc(1, sizeof(entry_t));
+   if (e == NULL) {
+      return NULL;
+   }
+   int len = (int)strlen(key);
+   e->domain = (char *)malloc(len + 1);
+   if (e->domain == NULL) {
+      free(e);
+      return NULL;
+   }
+   memcpy(e->domain, key, len + 1);
+   e->hash = hash;
+   e->state = state;
+   e->hnext = r->htable[hash & (MDNS_HASH_SIZE - 1)];
+   r->htable[hash & (MDNS_HASH_SIZE - 1)] = e;
+   if (state != ENTRY_HOSTS) {
+      _lru_push(r, e);
+      r->entry_count += 1;
+      _entry_evict(r);
+   }
+   return e;
+}
+
+/* unpredictable qid against off-path spoofing, rand() sequence is the same
+ * in each run
+ */
+static uint16_t
+_qid_random(void) {
+   uint16_t qid = 0;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+   qid = (uint16_t)arc4random();
+#elif defined(_WIN32) || defined(_WIN64)
+   unsigned int v = 0;
+   rand_s(&v);
+   qid = (uint16_t)v;
+#else
+#if defined(__linux__)
+   if (getrandom(&qid, sizeof(qid), 0) == sizeof(qid)) {
+      return qid;
+   }
+#endif
+   FILE *fp = fopen("/dev/urandom", "rb");
+   if (fp) {
+      if (fread(&qid, sizeof(qid), 1, fp) != 1) {
+         qid = 0;
+      }
+      fclose(fp);
+   }
+   if (qid == 0) {
+      qid = (uint16_t)rand();   /* without urandom */
+   }
+#endif
+   return qid;
+}
+
+/* query in flight
+ */
+
+static query_t*
+_query_find(resolver_t *r, uint16_t qid) {
+   query_t *q = r->qtable[qid & (MDNS_QID_SIZE - 1)];
+   for (; q; q = q->qnext) {
+      if (q->qid == qid) {
+         return q;
+      }
+   }
+   return NULL;
+}
+
+static query_t*
+_query_create(resolver_t *r, entry_t *e) {
+   query_t *q = (query_t *)calloc(1, sizeof(query_t));
+   if (q == NULL) {
+      return NULL;
+   }
+   do {
+      q->qid = _qid_random();
+   } while (q->qid == 0 || _query_find(r, q->qid));
+   q->query_size = mdns_query_build(r->buf, q->qid, e->domain);
+   if (q->query_size <= 0) {
+      free(q);
+      return NULL;
+   }
+   q->entry = e;
+   q->qnext = r->qtable[q->qid & (MDNS_QID_SIZE - 1)];
+   r->qtable[q->qid & (MDNS_QID_SIZE - 1)] = q;
+   q->next = r->queries;
+   if (r->queries) {
+      r->queries->prev = q;
+   }
+   r->queries = q;
+   r->query_count += 1;
+   e->state = ENTRY_PENDING;
+   e->query = q;
+   return q;
+}
+
+static void
+_query_destroy(resolver_t *r, query_t *q) {
+   query_t **pq = &r->qtable[q->qid & (MDNS_QID_SIZE - 1)];
+   for (; *pq; pq = &(*pq)->qnext) {
+      if (*pq == q) {
+         *pq = q->qnext;
+         break;
+      }
+   }
+   if (q->next) { q->next->prev = q->prev; }
+   if (q->prev) { q->prev->next = q->next; }
+   else { r->queries = q->next; }
+   r->query_count -= 1;
+   free(q);
+}
+
+static int
+_query_add_waiter(query_t *q, mdns_resolve_cb cb, void *ud) {
+   waiter_t *w = (waiter_t *)calloc(1, sizeof(waiter_t));
+   if (w) {
+      w->cb = cb;
+      w->ud = ud;
+      w->next = q->waiters;
+      q->waiters = w;
+      return 1;
+   }
+   return 0;
+}
+
+/* finish query and invoke waiters, entry kept as cache for OK/NXDOMAIN */
+static void
+_query_finish(resolver_t *r, query_t *q, int err) {
+   entry_t *e = q->entry;
+   waiter_t *w = q->waiters;
+   char domain[MDNS_DOMAIN_LEN];
+   uint8_t ipv4[4];
+
+   memcpy(domain, e->domain, strlen(e->domain) + 1);
+   memcpy(ipv4, e->ipv4, 4);
+   e->query = NULL;
+   _query_destroy(r, q);
+   if (err==MDNS_RESOLVE_TIMEOUT || err==MDNS_RESOLVE_FAILED) {
+      _entry_remove(r, e);
+   }
+
+   while (w) {
+      waiter_t *next = w->next;
+      w->cb(w->ud, domain, (err == MDNS_RESOLVE_OK) ? ipv4 : NULL, err);
+      free(w);
+      w = next;
+   }
+}
+
+/* resolver chann
+ */
+
+static int
+_resolver_open(resolver_t *r) {
+   if (r->chann) {
+      return 1;
+   }
+   chann_t *n = mnet_chann_open(CHANN_TYPE_MDNS);
+   if (n) {
+      char ip[INET_ADDRSTRLEN] = {0};
+      inet_ntop(AF_INET, &r->ns[0].sin_addr, ip, sizeof(ip));
+      if (mnet_chann_connect(n, ip, ntohs(r->ns[0].sin_port))) {
+         int tick = r->timeout_ms / 5;
+         tick = tick < 10 ? 10 : (tick > 200 ? 200 : tick);
+         mnet_chann_active_event(n, CHANN_EVENT_TIMER, tick);
+         r->chann = n;
+         return 1;
+      }
+      mnet_chann_close(n);
+   }
+   return 0;
+}
+
+static void
+_resolver_close_idle(resolver_t *r) {
+   if (r->chann && r->query_count <= 0) {
+      mnet_chann_close(r->chann);
+      r->chann = NULL;
+   }
+}
+
+/* send query to next nameserver, rotate for each try */
+static int
+_query_send(resolver_t *r, query_t *q) {
+   r->ns_index = q->tries % r->ns_count;
+   q->ns_sent |= 1 << r->ns_index;
+   q->tries += 1;
+   q->deadline = mnet_tm_current() + r->timeout_ms * 1000;
+   if (!_resolver_open(r)) {
+      return 0;
+   }
+   int size = mdns_query_build(r->buf, q->qid, q->entry->domain);
+   return mnet_chann_send(r->chann, r->buf, size) == size;
+}
+
+static void
+_resolver_on_response(resolver_t *r, int len) {
+   uint16_t qid = (uint16_t)mdns_response_fetch_qid(r->buf, len);
+   query_t *q = _query_find(r, qid);
+   if (q == NULL || !(q->ns_sent & (1 << r->ns_from))) {
+      return;                   /* late or spoofed response */
+   }
+   entry_t *e = q->entry;
+   uint32_t ttl = 0;
+   int ret = mdns_response_parse_ttl(r->buf, len, q->query_size, e->domain, e->ipv4, &ttl);
+   if (ret == 1) {
+      e->state = ENTRY_POSITIVE;
+      e->expire = mnet_tm_current() + _sec_to_us(ttl);
+      _query_finish(r, q, MDNS_RESOLVE_OK);
+   } else if (ret == -10 || ret == -13 || ret == -34) {
+      /* NODATA or NXDOMAIN, malformed header retry as server failure */
+      e->state = ENTRY_NEGATIVE;
+      e->expire = mnet_tm_current() + _sec_to_us(r->negative_ttl);
+      _query_finish(r, q, MDNS_RESOLVE_NXDOMAIN);
+   } else if (ret == -30 || ret == -23) {
+      return;                   /* question mismatch, keep waiting */
+   } else if (q->tries < r->attempts * r->ns_count) {
+      _query_send(r, q);        /* server failure, try next nameserver */
+   } else {
+      _query_finish(r, q, MDNS_RESOLVE_FAILED);
+   }
+}
+
+static void
+_resolver_on_timer(resolver_t *r) {
+   int64_t now = mnet_tm_current();
+   query_t *q = r->queries;
+   while (q) {
+      query_t *next = q->next;
+      if (q->deadline <= now) {
+         if (q->tries < r->attempts * r->ns_count) {
+            _query_send(r, q);
+         } else {
+            _query_finish(r, q, MDNS_RESOLVE_TIMEOUT);
+            next = r->queries;  /* waiters may changed the list */
+         }
+      }
+      q = next;
+   }
+}
+
+/* resend all queries after chann error */
+static void
+_resolver_on_disconnect(resolver_t *r) {
+   mnet_chann_close(r->chann);
+   r->chann = NULL;
+   for (query_t *q = r->queries; q; q = q->next) {
+      q->deadline = 0;
+   }
+   if (r->query_count <= 0) {
+      return;
+   }
+   if (_resolver_open(r)) {
+      _resolver_on_timer(r);
+   } else {
+      while (r->queries) {
+         _query_finish(r, r->queries, MDNS_RESOLVE_FAILED);
+      }
+   }
+}
+
+/* ext
+ */
+
+static int
+_resolver_type_fn(void *ext_ctx, chann_type_t ctype) {
+   return CHANN_TYPE_DGRAM;
+}
+
+/* consume all events for resolver chann */
+static int
+_resolver_filter_fn(void *ext_ctx, chann_msg_t *msg) {
+   resolver_t *r = (resolver_t *)ext_ctx;
+   if (msg->n != r->chann) {
+      return 0;
+   }
+   switch (msg->event) {
+      case CHANN_EVENT_RECV: {
+         int len = 0;
+         while (r->chann == msg->n && (len = mnet_chann_recv(msg->n, r->buf, MDNS_BUF_SIZE)) > 0) {
+            _resolver_on_response(r, len);
+         }
+         break;
+      }
+      case CHANN_EVENT_TIMER: {
+         _resolver_on_timer(r);
+         break;
+      }
+      case CHANN_EVENT_DISCONNECT: {
+         _resolver_on_disconnect(r);
+         break;
+      }
+      default:
+         break;
+   }
+   _resolver_close_idle(r);
+   return 0;
+}
+
+static void
+_resolver_op_cb(void *ext_ctx, chann_t *n) {
+}
+
+static int
+_resolver_state_fn(void *ext_ctx, chann_t *n, int state) {
+   return state;
+}
+
+/* only accept datagram from nameserver */
+static int
+_resolver_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   resolver_t *r = (resolver_t *)ext_ctx;
+   for (;;) {
+      struct sockaddr_in from;
+      socklen_t from_len = sizeof(from);
+      int ret = (int)recvfrom(mnet_chann_fd(n), buf, len, 0, (struct sockaddr *)&from, &from_len);
+      if (ret < 0) {
+         return _sock_would_block() ? 0 : ret;
+      }
+      for (int i=0; i<r->ns_count; i++) {
+         if (from.sin_port == r->ns[i].sin_port &&
+             from.sin_addr.s_addr == r->ns[i].sin_addr.s_addr)
+         {
+            r->ns_from = i;
+            return ret;
+         }
+      }
+   }
+}
+
+static int
+_resolver_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   resolver_t *r = (resolver_t *)ext_ctx;
+   struct sockaddr_in *to = &r->ns[r->ns_index];
+   int ret = (int)sendto(mnet_chann_fd(n), buf, len, 0, (struct sockaddr *)to, sizeof(*to));
+   if (ret<0 && _sock_would_block()) {
+      ret = 0;
+   }
+   return ret;
+}
+
+/* config
+ */
+
+static int
+_resolver_add_ns(resolver_t *r, const char *ip, int port) {
+   if (r->ns_count < MDNS_NS_MAX) {
+      struct sockaddr_in *in = &r->ns[r->ns_count];
+      memset(in, 0, sizeof(*in));
+      if (inet_pton(AF_INET, ip, &in->sin_addr) == 1) {
+         in->sin_family = AF_INET;
+         in->sin_port = htons(port);
+         r->ns_count += 1;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+static inline char*
+_skip_space(char *p) {
+   while (*p && isspace((unsigned char)*p)) {
+      p++;
+   }
+   return p;
+}
+
+static inline char*
+_next_token(char **pp) {
+   char *p = _skip_space(*pp);
+   char *t = p;
+   while (*p && !isspace((unsigned char)*p) && *p!='#') {
+      p++;
+   }
+   if (*p && *p!='#') {
+      *p++ = 0;
+   } else {
+      *p = 0;
+   }
+   *pp = p;
+   return *t ? t : NULL;
+}
+
+/* nameserver, options timeout:n attempts:n */
+static void
+_resolver_load_conf(resolver_t *r, const char *path, int with_ns) {
+   FILE *fp = fopen(path, "r");
+   if (fp == NULL) {
+      return;
+   }
+   char line[512];
+   while (fgets(line, sizeof(line), fp)) {
+      char *p = line;
+      char *key = _next_token(&p);
+      if (key == NULL || key[0]==';') {
+         continue;
+      }
+      if (with_ns && strcmp(key, "nameserver") == 0) {
+         char *ip = _next_token(&p);
+         if (ip) {
+            _resolver_add_ns(r, ip, 53);
+         }
+      } else if (strcmp(key, "options") == 0) {
+         char *opt = NULL;
+         while ((opt = _next_token(&p))) {
+            if (strncmp(opt, "timeout:", 8) == 0) {
+               r->timeout_ms = atoi(opt + 8) * 1000;
+            } else if (strncmp(opt, "attempts:", 9) == 0) {
+               r->attempts = atoi(opt + 9);
+            }
+         }
+      }
+   }
+   fclose(fp);
+}
+
+/* 'ip name [alias ...]', only IPv4 */
+static void
+_resolver_load_hosts(resolver_t *r, const char *path) {
+   FILE *fp = fopen(path, "r");
+   if (fp == NULL) {
+      return;
+   }
+   char line[1024];
+   while (fgets(line, sizeof(line), fp)) {
+      char *p = line;
+      char *ip = _next_token(&p);
+      uint8_t ipv4[4];
+      if (ip == NULL || inet_pton(AF_INET, ip, ipv4) != 1) {
+         continue;
+      }
+      char *name = NULL;
+      while ((name = _next_token(&p))) {
+         char key[MDNS_DOMAIN_LEN];
+         if (_domain_key(key, name) > 0) {
+            uint32_t hash = _domain_hash(key);
+            if (_entry_find(r, key, hash) == NULL) {
+               entry_t *e = _entry_create(r, key, hash, ENTRY_HOSTS);
+               if (e) {
+                  memcpy(e->ipv4, ipv4, 4);
+               }
+            }
+         }
+      }
+   }
+   fclose(fp);
+}
+
+/* Public Interface
+ */
+
+int
+mdns_resolver_init(mdns_resolver_conf_t *conf) {
+   resolver_t *r = &g_resolver;
+   if (r->init) {
+      return 1;
+   }
+
+   mnet_ext_t ext = {
+      .ext_ctx = r,
+      .type_fn = _resolver_type_fn,
+      .filter_fn = _resolver_filter_fn,
+      .open_cb = _resolver_op_cb,
+      .close_cb = _resolver_op_cb,
+      .listen_cb = _resolver_op_cb,
+      .accept_cb = _resolver_op_cb,
+      .connect_cb = _resolver_op_cb,
+      .disconnect_cb = _resolver_op_cb,
+      .state_fn = _resolver_state_fn,
+      .recv_fn = _resolver_recv_fn,
+      .send_fn = _resolver_send_fn,
+   };
+   if (!mnet_ext_register(CHANN_TYPE_MDNS, &ext) && !r->registered) {
+      return 0;
+   }
+   r->registered = 1;
+
+   mdns_resolver_conf_t def;
+   memset(&def, 0, sizeof(def));
+   conf = conf ? conf : &def;
+
+   r->lru.prev = r->lru.next = &r->lru;
+   r->timeout_ms = 1000;
+   r->attempts = 2;
+   r->cache_size = conf->cache_size > 0 ? conf->cache_size : 1024;
+   r->negative_ttl = conf->negative_ttl > 0 ? conf->negative_ttl : 30;
+
+   int with_ns = 1;
+   if (conf->nameserver) {
+      chann_addr_t addr;
+      if (mnet_parse_ipport(conf->nameserver, &addr) && _resolver_add_ns(r, addr.ip, addr.port)) {
+         with_ns = 0;
+      }
+   }
+   _resolver_load_conf(r, conf->resolv_conf ? conf->resolv_conf : "/etc/resolv.conf", with_ns);
+   if (r->ns_count <= 0) {
+      _resolver_add_ns(r, "127.0.0.1", 53);
+   }
+   if (conf->timeout_ms > 0) {
+      r->timeout_ms = conf->timeout_ms;
+   }
+   if (conf->attempts > 0) {
+      r->attempts = conf->attempts;
+   }
+   r->timeout_ms = r->timeout_ms > 0 ? r->timeout_ms : 1000;
+   r->attempts = r->attempts > 0 ? r->attempts : 1;
+
+   _resolver_load_hosts(r, conf->hosts ? conf->hosts : "/etc/hosts");
+
+   r->init = 1;
+   return 1;
+}
+
+void
+mdns_resolver_fini(void) {
+   resolver_t *r = &g_resolver;
+   if (!r->init) {
+      return;
+   }
+   while (r->queries) {
+      query_t *q = r->queries;
+      while (q->waiters) {
+         waiter_t *w = q->waiters;
+         q->waiters = w->next;
+         free(w);
+      }
+      q->entry->query = NULL;
+      _query_destroy(r, q);
+   }
+   for (int i=0; i<MDNS_HASH_SIZE; i++) {
+      while (r->htable[i]) {
+         _entry_remove(r, r->htable[i]);
+      }
+   }
+   if (r->chann) {
+      mnet_chann_close(r->chann);
+   }
+   int registered = r->registered;
+   memset(r, 0, sizeof(*r));
+   r->registered = registered;
+}
+
+int
+mdns_resolve(const char *domain, mdns_resolve_cb cb, void *ud) {
+   resolver_t *r = &g_resolver;
+   char key[MDNS_DOMAIN_LEN];
+   if (!r->init || !domain || !cb || _domain_key(key, domain) <= 0) {
+      return -1;
+   }
+
+   uint8_t ipv4[4];
+   if (inet_pton(AF_INET, key, ipv4) == 1) {
+      cb(ud, domain, ipv4, MDNS_RESOLVE_OK);
+      return 1;
+   }
+
+   uint32_t hash = _domain_hash(key);
+   entry_t *e = _entry_find(r, key, hash);
+   if (e) {
+      if (e->state == ENTRY_PENDING) {
+         return _query_add_waiter(e->query, cb, ud) ? 0 : -1;
+      }
+      if (e->state == ENTRY_HOSTS || e->expire > mnet_tm_current()) {
+         if (e->prev) {
+            _lru_unlink(e);
+            _lru_push(r, e);
+         }
+         memcpy(ipv4, e->ipv4, 4);
+         if (e->state == ENTRY_NEGATIVE) {
+            cb(ud, domain, NULL, MDNS_RESOLVE_NXDOMAIN);
+         } else {
+            cb(ud, domain, ipv4, MDNS_RESOLVE_OK);
+         }
+         return 1;
+      }
+   }
+   if (!_resolver_open(r)) {
+      return -1;
+   }
+   if (e == NULL) {
+      e = _entry_create(r, key, hash, ENTRY_PENDING);
+      if (e == NULL) {
+         return -1;
+      }
+   }
+
+   query_t *q = _query_create(r, e);
+   if (q == NULL || !_query_add_waiter(q, cb, ud)) {
+      if (q) {
+         _query_destroy(r, q);
+      }
+      _entry_remove(r, e);
+      return -1;
+   }
+   _query_send(r, q);           /* resend in timer when failed */
+   return 0;
+}
+
+#undef MDNS_BUF_SIZE
+#undef MDNS_DOMAIN_LEN
+#undef MDNS_NS_MAX
+#undef MDNS_HASH_SIZE
+#undef MDNS_QID_SIZE
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef _MDNS_RESOLVER_H
+#define _MDNS_RESOLVER_H
+
+#include "mnet_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* async DNS resolver in mnet event loop, with an internal DGRAM chann
+ * typed CHANN_TYPE_MDNS, its events will be consumed by the resolver
+ */
+extern chann_type_t const CHANN_TYPE_MDNS;
+
+enum {
+   MDNS_RESOLVE_OK = 0,
+   MDNS_RESOLVE_NXDOMAIN = -1,  /* domain not exist or without IPv4 record */
+   MDNS_RESOLVE_TIMEOUT = -2,   /* no response after all attempts */
+   MDNS_RESOLVE_FAILED = -3,    /* server failure or invalid response */
+};
+
+typedef struct {
+   const char *resolv_conf;     /* nameserver/options file, default '/etc/resolv.conf' */
+   const char *hosts;           /* static hosts file, default '/etc/hosts' */
+   const char *nameserver;      /* 'ip:port' to override resolv.conf nameserver, can be NULL */
+   int timeout_ms;              /* timeout for each try, default 'options timeout' or 1000 */
+   int attempts;                /* rounds for all nameserver, default 'options attempts' or 2 */
+   int cache_size;              /* max cached domain, default 1024 */
+   int negative_ttl;            /* seconds to cache NXDOMAIN, default 30 */
+} mdns_resolver_conf_t;
+
+/* -- resolve result
+ * ud: user data for mdns_resolve
+ * domain: domain for mdns_resolve
+ * ipv4: 4 bytes address, NULL for error
+ * err: MDNS_RESOLVE_OK or error
+ */
+typedef void (*mdns_resolve_cb)(void *ud, const char *domain, const uint8_t *ipv4, int err);
+
+/* -- init resolver after mnet_init
+ * conf: NULL for default
+ * --
+ * return: 1 for ok
+ */
+int mdns_resolver_init(mdns_resolver_conf_t *conf);
+
+/* -- release cached domain and queries in flight before mnet_fini */
+void mdns_resolver_fini(void);
+
+/* -- resolve domain, hit in hosts or cache will invoke cb before return,
+ * or cb will be invoked in mnet_result_next() when response or timeout,
+ * queries for the same domain will be merged
+ * --
+ * return: 1 for cb invoked, 0 for query in flight, -1 for error
+ */
+int mdns_resolve(const char *domain, mdns_resolve_cb cb, void *ud);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
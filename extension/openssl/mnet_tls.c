@@ -7,16 +7,137 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <openssl/rand.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/buffer.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 #include "mnet_tls.h"
 
+#define MNET_TLS_SESSION_CACHE 1024     /* server session cache size */
+#define MNET_TLS_TICKET_ROTATE 3600     /* ticket key rotate seconds */
+#define MNET_TLS_TICKET_KEYS 3          /* current key and previous keys for decrypt */
+#define MNET_TLS_CLIENT_SESSIONS 256    /* client sessions for host:port */
+#define MNET_TLS_SENDFILE_CHUNK (16 * 1024) /* one TLS record for read and send */
+#define MNET_TLS_HANDSHAKE_THREADS 64   /* max handshake threads */
+#define MNET_TLS_RECORD_SIZE (16 * 1024) /* max plaintext in one record */
+#define MNET_TLS_WRITE_BACKLOG (64 * 1024) /* sealed records before chann cached */
+#define MNET_TLS_SSL_POOL 1024          /* pooled SSL for new channs */
+#define MNET_TLS_RELEASE_IDLE 1000000   /* micro seconds without recv/send before buffers released */
+#define MNET_TLS_MEM_HEADER 16          /* size before OpenSSL block, keep alignment */
+
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define MNET_TLS_KTLS 1
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
+enum {
+    KTLS_SEND = 1,
+    KTLS_RECV = 2,
+};
+
+/* handshake step in worker thread */
+enum {
+    JOB_IDLE = 0,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
 chann_type_t const CHANN_TYPE_TLS = 4;
 
-typedef struct {
+typedef struct s_tls_ud {
     chann_t *ln;    /* listen chann for next ACCEPT EVENT */
     int state;      /* TLS state */
     SSL *ssl;
+    int ktls;           /* kernel TLS TX/RX after handshake */
+    uint32_t peer_hash; /* client session slot for host:port */
+    char peer[24];      /* host:port */
+    int job;            /* handshake job state, under pool lock */
+    int job_ret;        /* SSL_accept/SSL_connect return */
+    int job_err;        /* SSL_get_error in worker thread */
+    chann_t *chann;     /* for wakeup from worker, and idle check in flush */
+    struct s_tls_ud *job_next;
+    BIO *wbio;          /* sealed records for coalesced writes, owned by SSL */
+    uint8_t *wbuf;      /* plaintext for next record */
+    int wlen;
+    int released;       /* buffers released, SSL_MODE_RELEASE_BUFFERS until recv/send */
+    int64_t active;     /* last recv/send, micro seconds, 0 for not in active list */
+    struct s_tls_ud *active_prev;
+    struct s_tls_ud *active_next;
+    struct s_tls_ud *free_next; /* in ud pool with cleared SSL */
 } mnet_tls_ud_t;
 
+typedef struct {
+    uint8_t name[16];
+    uint8_t aes_key[32];
+    uint8_t hmac_key[32];
+    int64_t created;    /* micro seconds */
+} mnet_tls_ticket_key_t;
+
+typedef struct {
+    char peer[24];
+    SSL_SESSION *sess;
+} mnet_tls_session_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* job queued or stop */
+    pthread_cond_t done;        /* job done, for cancel */
+    int stop;
+    int count;                  /* worker threads, 0 for inline handshake */
+    pthread_t threads[MNET_TLS_HANDSHAKE_THREADS];
+    mnet_tls_ud_t *head;        /* job queue */
+    mnet_tls_ud_t *tail;
+} mnet_tls_pool_t;
+
+typedef struct {
+    SSL_CTX *ctx;
+    pthread_mutex_t lock;       /* sessions and ticket keys, used in workers */
+    int ticket_rotate;  /* seconds, 0 for no ticket */
+    int key_count;
+    mnet_tls_ticket_key_t keys[MNET_TLS_TICKET_KEYS]; /* first for encrypt */
+    int ktls;           /* try kernel TLS */
+    int coalesce;       /* coalesce writes in dispatch pass */
+    int release;        /* release buffers when idle */
+    int nodelay;        /* TCP_NODELAY for handshake flights and coalesced records */
+    mnet_tls_ud_t *active_head; /* connected ud ordered by last recv/send */
+    mnet_tls_ud_t *active_tail;
+    int pool_size;      /* max pooled ud with SSL */
+    int pool_count;
+    mnet_tls_ud_t *free_uds;
+    int64_t ud_count;   /* ud in use */
+    int64_t wbuf_count; /* coalesce buffers allocated */
+    int session_count;  /* direct mapped client sessions */
+    mnet_tls_session_t *sessions;
+    mnet_tls_stats_t stats;
+    mnet_tls_pool_t pool;
+} mnet_tls_t;
+
+static mnet_tls_t g_tls;
+static int g_mem_track;                 /* OpenSSL heap counted */
+static volatile int64_t g_crypto_bytes; /* also from handshake threads */
+
+/** TLS layer ud, also under stacked ext or from handshake threads
+ */
+static inline mnet_tls_ud_t*
+_tls_ud(chann_t *n) {
+    return (mnet_tls_ud_t *)mnet_ext_chann_layer_ud(n, CHANN_TYPE_TLS);
+}
+
 /** man SSL_accept/SSL_connect/SSL_read/SSL_write
  */
 static inline int
@@ -34,9 +155,751 @@ static inline void
 _ssl_set_fd(SSL *ssl, int fd) {
     SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
     SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // pooled SSL may be released when idle
+    SSL_clear_mode(ssl, SSL_MODE_RELEASE_BUFFERS);
     SSL_set_fd(ssl, fd);
 }
 
+/** OpenSSL heap counter, block size kept in header
+ */
+static void*
+_mem_malloc(size_t num, const char *file, int line) {
+    uint8_t *p = (uint8_t *)malloc(num + MNET_TLS_MEM_HEADER);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t *)p = num;
+    __sync_fetch_and_add(&g_crypto_bytes, (int64_t)num);
+    return p + MNET_TLS_MEM_HEADER;
+}
+
+static void
+_mem_free(void *ptr, const char *file, int line) {
+    if (ptr) {
+        uint8_t *p = (uint8_t *)ptr - MNET_TLS_MEM_HEADER;
+        __sync_fetch_and_sub(&g_crypto_bytes, (int64_t)*(size_t *)p);
+        free(p);
+    }
+}
+
+static void*
+_mem_realloc(void *ptr, size_t num, const char *file, int line) {
+    if (ptr == NULL) {
+        return _mem_malloc(num, file, line);
+    }
+    if (num == 0) {
+        _mem_free(ptr, file, line);
+        return NULL;
+    }
+    uint8_t *p = (uint8_t *)ptr - MNET_TLS_MEM_HEADER;
+    size_t old = *(size_t *)p;
+    p = (uint8_t *)realloc(p, num + MNET_TLS_MEM_HEADER);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t *)p = num;
+    __sync_fetch_and_add(&g_crypto_bytes, (int64_t)num - (int64_t)old);
+    return p + MNET_TLS_MEM_HEADER;
+}
+
+/** ud pool, SSL cleared without session and BIO, for accept/connect churn
+ */
+static mnet_tls_ud_t*
+_ud_new(mnet_tls_t *tls) {
+    mnet_tls_ud_t *tu = tls->free_uds;
+    if (tu) {
+        tls->free_uds = tu->free_next;
+        tls->pool_count -= 1;
+        tls->stats.pool_hits += 1;
+        SSL *ssl = tu->ssl;
+        memset(tu, 0, sizeof(*tu));
+        tu->ssl = ssl;
+    } else {
+        tu = (mnet_tls_ud_t *)calloc(1, sizeof(mnet_tls_ud_t));
+    }
+    if (tu) {
+        tls->ud_count += 1;
+    }
+    return tu;
+}
+
+/** SSL for accept or connect, pooled or reconnect one cleared */
+static int
+_ud_ssl(mnet_tls_t *tls, mnet_tls_ud_t *tu, chann_t *n, int server) {
+    if (tu->ssl && !SSL_clear(tu->ssl)) {
+        SSL_free(tu->ssl);
+        tu->ssl = NULL;
+    }
+    if (tu->ssl) {
+        SSL_set_session(tu->ssl, NULL);
+    } else if ((tu->ssl = SSL_new(tls->ctx)) == NULL) {
+        return 0;
+    }
+    if (tls->nodelay) {
+        // tickets after last flight not holding first records for ACK
+        int opt = 1;
+        setsockopt(mnet_chann_fd(n), IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    _ssl_set_fd(tu->ssl, mnet_chann_fd(n));
+    // client chann for new session, role not reset by SSL_clear
+    SSL_set_app_data(tu->ssl, server ? NULL : n);
+    if (server) {
+        SSL_set_accept_state(tu->ssl);
+    } else {
+        SSL_set_connect_state(tu->ssl);
+    }
+    return 1;
+}
+
+static void
+_ud_free(mnet_tls_t *tls, mnet_tls_ud_t *tu) {
+    tls->ud_count -= 1;
+    if (tu->wbuf) {
+        free(tu->wbuf);
+        tls->wbuf_count -= 1;
+    }
+    // kernel TLS state not pooled
+    if (tu->ssl && (tls->pool_count >= tls->pool_size || tls->ktls || !SSL_clear(tu->ssl))) {
+        SSL_free(tu->ssl);
+        tu->ssl = NULL;
+    }
+    if (tu->ssl == NULL) {
+        free(tu);
+        return;
+    }
+    SSL_set_session(tu->ssl, NULL);
+    SSL_set_bio(tu->ssl, NULL, NULL);
+    SSL_set_app_data(tu->ssl, NULL);
+    tu->free_next = tls->free_uds;
+    tls->free_uds = tu;
+    tls->pool_count += 1;
+}
+
+static void
+_uds_free(mnet_tls_t *tls, int keep) {
+    while (tls->pool_count > keep) {
+        mnet_tls_ud_t *tu = tls->free_uds;
+        tls->free_uds = tu->free_next;
+        tls->pool_count -= 1;
+        SSL_free(tu->ssl);
+        free(tu);
+    }
+}
+
+/** client sessions for host:port
+ */
+static uint32_t
+_peer_hash(const char *peer) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    while (*peer) {
+        h = (h ^ (uint8_t)*peer++) * 16777619u;
+    }
+    return h;
+}
+
+static void
+_sessions_free(mnet_tls_t *tls) {
+    for (int i=0; i<tls->session_count; i++) {
+        if (tls->sessions[i].sess) {
+            SSL_SESSION_free(tls->sessions[i].sess);
+        }
+    }
+    free(tls->sessions);
+    tls->sessions = NULL;
+    tls->session_count = 0;
+}
+
+static mnet_tls_session_t*
+_session_slot(mnet_tls_t *tls, mnet_tls_ud_t *tu) {
+    if (tls->session_count <= 0 || tu->peer[0] == 0) {
+        return NULL;
+    }
+    return &tls->sessions[tu->peer_hash % tls->session_count];
+}
+
+/** offer session stored for host:port before SSL_connect */
+static void
+_session_offer(mnet_tls_t *tls, chann_t *n, mnet_tls_ud_t *tu) {
+    chann_addr_t addr;
+    tu->peer[0] = 0;
+    if (tls->session_count <= 0 || !mnet_chann_socket_addr(n, &addr)) {
+        return;
+    }
+    snprintf(tu->peer, sizeof(tu->peer), "%s:%d", addr.ip, addr.port);
+    tu->peer_hash = _peer_hash(tu->peer);
+    pthread_mutex_lock(&tls->lock);
+    mnet_tls_session_t *slot = _session_slot(tls, tu);
+    if (slot->sess && strcmp(slot->peer, tu->peer) == 0 && SSL_SESSION_is_resumable(slot->sess)) {
+        SSL_set_session(tu->ssl, slot->sess);
+    }
+    pthread_mutex_unlock(&tls->lock);
+}
+
+/** client got new session, in handshake for TLS 1.2 or after for TLS 1.3 */
+static int
+_session_new_cb(SSL *ssl, SSL_SESSION *sess) {
+    mnet_tls_t *tls = &g_tls;
+    chann_t *n = (chann_t *)SSL_get_app_data(ssl);
+    mnet_tls_ud_t *tu = n ? _tls_ud(n) : NULL;
+    if (tu == NULL || !SSL_SESSION_is_resumable(sess)) {
+        return 0;
+    }
+    pthread_mutex_lock(&tls->lock);
+    mnet_tls_session_t *slot = _session_slot(tls, tu);
+    if (slot) {
+        if (slot->sess) {
+            SSL_SESSION_free(slot->sess);
+        }
+        strcpy(slot->peer, tu->peer);
+        slot->sess = sess;
+    }
+    pthread_mutex_unlock(&tls->lock);
+    return slot ? 1 : 0;    /* take the reference */
+}
+
+/** ticket keys, rotate in encrypt, previous keys still decrypt with ticket renew
+ */
+static int
+_ticket_key_new(mnet_tls_t *tls) {
+    int count = tls->key_count < MNET_TLS_TICKET_KEYS ? tls->key_count + 1 : MNET_TLS_TICKET_KEYS;
+    memmove(&tls->keys[1], &tls->keys[0], sizeof(tls->keys[0]) * (count - 1));
+    mnet_tls_ticket_key_t *k = &tls->keys[0];
+    if (RAND_bytes(k->name, sizeof(k->name)) != 1 ||
+        RAND_bytes(k->aes_key, sizeof(k->aes_key)) != 1 ||
+        RAND_bytes(k->hmac_key, sizeof(k->hmac_key)) != 1)
+    {
+        return 0;
+    }
+    k->created = mnet_tm_current();
+    tls->key_count = count;
+    tls->stats.ticket_rotated += 1;
+    return 1;
+}
+
+static mnet_tls_ticket_key_t*
+_ticket_key_find(mnet_tls_t *tls, const uint8_t *name, int *idx) {
+    for (int i=0; i<tls->key_count; i++) {
+        if (memcmp(tls->keys[i].name, name, sizeof(tls->keys[i].name)) == 0) {
+            *idx = i;
+            return &tls->keys[i];
+        }
+    }
+    return NULL;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX mnet_tls_hmac_t;
+
+static int
+_ticket_hmac_init(mnet_tls_hmac_t *hctx, mnet_tls_ticket_key_t *k) {
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, k->hmac_key, sizeof(k->hmac_key)),
+        OSSL_PARAM_construct_end(),
+    };
+    return EVP_MAC_CTX_set_params(hctx, params);
+}
+#else
+typedef HMAC_CTX mnet_tls_hmac_t;
+
+static int
+_ticket_hmac_init(mnet_tls_hmac_t *hctx, mnet_tls_ticket_key_t *k) {
+    return HMAC_Init_ex(hctx, k->hmac_key, sizeof(k->hmac_key), EVP_sha256(), NULL);
+}
+#endif
+
+/** return 1 for ok, 2 for ticket renew, 0 for full handshake, -1 for error,
+ * always renew under TLS 1.3, or client only got ticket in full handshake
+ */
+static int
+_ticket_key_step(SSL *ssl, unsigned char *name, unsigned char *iv,
+                 EVP_CIPHER_CTX *ectx, mnet_tls_hmac_t *hctx, int enc)
+{
+    mnet_tls_t *tls = &g_tls;
+    if (enc) {
+        int64_t expired = mnet_tm_current() - (int64_t)tls->ticket_rotate * 1000000;
+        if ((tls->key_count <= 0 || tls->keys[0].created <= expired) && !_ticket_key_new(tls)) {
+            return -1;
+        }
+        mnet_tls_ticket_key_t *k = &tls->keys[0];
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+        memcpy(name, k->name, sizeof(k->name));
+        if (EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, k->aes_key, iv) != 1 ||
+            _ticket_hmac_init(hctx, k) != 1)
+        {
+            return -1;
+        }
+        return 1;
+    } else {
+        int idx = 0;
+        mnet_tls_ticket_key_t *k = _ticket_key_find(tls, name, &idx);
+        if (k == NULL) {
+            return 0;
+        }
+        if (EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, k->aes_key, iv) != 1 ||
+            _ticket_hmac_init(hctx, k) != 1)
+        {
+            return -1;
+        }
+        return (idx == 0 && SSL_version(ssl) < TLS1_3_VERSION) ? 1 : 2;
+    }
+}
+
+static int
+_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+               EVP_CIPHER_CTX *ectx, mnet_tls_hmac_t *hctx, int enc)
+{
+    pthread_mutex_lock(&g_tls.lock);
+    int ret = _ticket_key_step(ssl, name, iv, ectx, hctx, enc);
+    pthread_mutex_unlock(&g_tls.lock);
+    return ret;
+}
+
+#ifdef MNET_TLS_KTLS
+/** probe tls module before SSL_OP_ENABLE_KTLS, for OpenSSL flush each record
+ * in handshake when enabled, even kernel unsupported
+ */
+static int
+_ktls_probe(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    // ENOTCONN for tls module loaded, ENOENT for not
+    int ret = setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
+    int ok = ret == 0 || errno != ENOENT;
+    close(fd);
+    return ok;
+}
+#endif
+
+/** free plaintext buffer and sealed records buffer, and OpenSSL record
+ * buffers, with SSL_MODE_RELEASE_BUFFERS till next recv/send
+ */
+static void
+_tls_release(mnet_tls_ud_t *tu) {
+    if (tu->wbuf) {
+        free(tu->wbuf);
+        tu->wbuf = NULL;
+        g_tls.wbuf_count -= 1;
+    }
+    BUF_MEM *bm = NULL;
+    if (tu->wbio) {
+        BIO_get_mem_ptr(tu->wbio, &bm);
+    }
+    if (bm && bm->max > 0) {
+        BIO *wbio = BIO_new(BIO_s_mem());
+        if (wbio) {
+            SSL_set0_wbio(tu->ssl, wbio);
+            tu->wbio = wbio;
+        }
+    }
+    SSL_set_mode(tu->ssl, SSL_MODE_RELEASE_BUFFERS);
+    // fails with unread records, then freed after drained
+    (void)SSL_free_buffers(tu->ssl);
+    tu->released = 1;
+}
+
+/** active list, connected channs ordered by last recv/send, only head checked
+ * in its flush for MNET_TLS_RELEASE_IDLE, then queued again for next pass
+ */
+static void
+_active_del(mnet_tls_t *tls, mnet_tls_ud_t *tu) {
+    if (tu->active <= 0) {
+        return;
+    }
+    if (tu->active_prev) {
+        tu->active_prev->active_next = tu->active_next;
+    } else {
+        tls->active_head = tu->active_next;
+    }
+    if (tu->active_next) {
+        tu->active_next->active_prev = tu->active_prev;
+    } else {
+        tls->active_tail = tu->active_prev;
+    }
+    tu->active_prev = tu->active_next = NULL;
+    tu->active = 0;
+}
+
+static void
+_active_add(mnet_tls_t *tls, mnet_tls_ud_t *tu, int64_t now) {
+    mnet_tls_ud_t *head = tls->active_head;
+    _active_del(tls, tu);
+    tu->active = now;
+    tu->active_prev = tls->active_tail;
+    if (tls->active_tail) {
+        tls->active_tail->active_next = tu;
+    } else {
+        tls->active_head = tu;
+    }
+    tls->active_tail = tu;
+    if (tls->active_head != head) {
+        mnet_ext_chann_flush(tls->active_head->chann);
+    }
+}
+
+/** remove before disconnect or close, new head checked in next flush */
+static void
+_active_remove(mnet_tls_t *tls, mnet_tls_ud_t *tu) {
+    mnet_tls_ud_t *head = tls->active_head;
+    _active_del(tls, tu);
+    if (tls->active_head && tls->active_head != head) {
+        mnet_ext_chann_flush(tls->active_head->chann);
+    }
+}
+
+/** chann recv/send, keep OpenSSL buffers between records while busy */
+static void
+_active_touch(mnet_tls_t *tls, chann_t *n, mnet_tls_ud_t *tu) {
+    if (!tls->release) {
+        return;
+    }
+    if (tu->released) {
+        SSL_clear_mode(tu->ssl, SSL_MODE_RELEASE_BUFFERS);
+        tu->released = 0;
+    }
+    int64_t now = mnet_tm_current();
+    if (tu == tls->active_tail) {
+        // still ordered
+        tu->active = now;
+        return;
+    }
+    tu->chann = n;
+    _active_add(tls, tu, now);
+}
+
+/** release channs without recv/send for MNET_TLS_RELEASE_IDLE from head,
+ * sealed records not sent yet keep chann active
+ */
+static void
+_active_sweep(mnet_tls_t *tls) {
+    int64_t now = mnet_tm_current();
+    mnet_tls_ud_t *tu = NULL;
+    while ((tu = tls->active_head) && now - tu->active >= MNET_TLS_RELEASE_IDLE) {
+        if (tu->wlen > 0 || (tu->wbio && BIO_pending(tu->wbio) > 0)) {
+            _active_add(tls, tu, now);
+            continue;
+        }
+        _active_del(tls, tu);
+        if (tls->release) {
+            _tls_release(tu);
+        }
+    }
+    if (tls->active_head) {
+        mnet_ext_chann_flush(tls->active_head->chann);
+    }
+}
+
+static void
+_tls_handshake_done(chann_t *n, mnet_tls_ud_t *tu) {
+    mnet_tls_stats_t *st = &g_tls.stats;
+    int reused = SSL_session_reused(tu->ssl);
+    if (reused) {
+        st->resumed += 1;
+    } else {
+        st->full += 1;
+    }
+    if (tu->state == CHANN_STATE_CONNECTING) {
+        if (reused) {
+            st->client_hits += 1;
+        } else {
+            st->client_misses += 1;
+        }
+    }
+    tu->ktls = 0;
+#ifdef MNET_TLS_KTLS
+    // OpenSSL falls back to user space when cipher or kernel module unsupported
+    if (BIO_get_ktls_send(SSL_get_wbio(tu->ssl))) {
+        tu->ktls |= KTLS_SEND;
+        st->ktls_send += 1;
+    }
+    if (BIO_get_ktls_recv(SSL_get_rbio(tu->ssl))) {
+        tu->ktls |= KTLS_RECV;
+        st->ktls_recv += 1;
+    }
+#endif
+    if (g_tls.coalesce && !(tu->ktls & KTLS_SEND)) {
+        // records sealed in memory, sent before poll wait
+        tu->wbio = BIO_new(BIO_s_mem());
+        if (tu->wbio) {
+            SSL_set0_wbio(tu->ssl, tu->wbio);
+        }
+    }
+    tu->state = CHANN_STATE_CONNECTED;
+    _active_touch(&g_tls, n, tu);
+    // application data may arrive with last handshake flight
+    mnet_ext_chann_pending(n, SSL_has_pending(tu->ssl));
+}
+
+/** handshake step result, return 1 to emit event
+ */
+static int
+_tls_handshake_result(chann_msg_t *msg, mnet_tls_ud_t *tu, int ret, int err) {
+    if (ret == 1) {
+        chann_t *n = msg->n;
+        if (tu->state == CHANN_STATE_LISTENING) {
+            msg->event = CHANN_EVENT_ACCEPT;
+            msg->r = msg->n;
+            msg->n = tu->ln;
+            tu->ln = NULL;
+        } else {
+            msg->event = CHANN_EVENT_CONNECTED;
+        }
+        _tls_handshake_done(n, tu);
+        // emit accept/connected event
+        return 1;
+    }
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        // read/write in process, block event
+        return 0;
+    } else {
+        if (tu->state == CHANN_STATE_LISTENING) {
+            mnet_chann_disconnect(msg->n);
+            // block listening event
+            return 0;
+        } else {
+            msg->event = CHANN_EVENT_DISCONNECT;
+            mnet_chann_disconnect(msg->n);
+            // emit disconnect event
+            return 1;
+        }
+    }
+}
+
+/** handshake thread pool, worker owns SSL and fd between QUEUED and DONE,
+ * chann read paused, result back to loop with mnet_ext_chann_wakeup()
+ */
+static void*
+_pool_worker(void *arg) {
+    mnet_tls_pool_t *pool = (mnet_tls_pool_t *)arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->head == NULL) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        mnet_tls_ud_t *tu = pool->head;
+        pool->head = tu->job_next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        tu->job = JOB_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        ERR_clear_error();
+        int ret = tu->state == CHANN_STATE_LISTENING ? SSL_accept(tu->ssl) : SSL_connect(tu->ssl);
+        int err = ret == 1 ? SSL_ERROR_NONE : SSL_get_error(tu->ssl, ret);
+
+        pthread_mutex_lock(&pool->lock);
+        tu->job_ret = ret;
+        tu->job_err = err;
+        tu->job = JOB_DONE;
+        // wakeup in lock, chann not closed before cancel returned
+        mnet_ext_chann_wakeup(tu->chann);
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void
+_pool_submit(mnet_tls_t *tls, chann_t *n, mnet_tls_ud_t *tu) {
+    mnet_tls_pool_t *pool = &tls->pool;
+    mnet_ext_chann_pause(n, 1);
+    tu->chann = n;
+    tu->job_next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    tu->job = JOB_QUEUED;
+    if (pool->tail) {
+        pool->tail->job_next = tu;
+    } else {
+        pool->head = tu;
+    }
+    pool->tail = tu;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    tls->stats.offloaded += 1;
+}
+
+/** remove queued job or wait running one, before SSL shutdown or free */
+static void
+_pool_cancel(mnet_tls_pool_t *pool, mnet_tls_ud_t *tu) {
+    if (tu->job == JOB_IDLE) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (tu->job == JOB_QUEUED) {
+        mnet_tls_ud_t **pp = &pool->head;
+        pool->tail = NULL;
+        while (*pp) {
+            if (*pp == tu) {
+                *pp = tu->job_next;
+            } else {
+                pool->tail = *pp;
+                pp = &(*pp)->job_next;
+            }
+        }
+    }
+    while (tu->job == JOB_RUNNING) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    tu->job = JOB_IDLE;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+_pool_stop(mnet_tls_pool_t *pool) {
+    if (pool->count <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i=0; i<pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->count = 0;
+    pool->stop = 0;
+}
+
+static int
+_pool_start(mnet_tls_pool_t *pool, int count) {
+    _pool_stop(pool);
+    for (int i=0; i<count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, _pool_worker, pool) != 0) {
+            _pool_stop(pool);
+            return 0;
+        }
+        pool->count = i + 1;
+    }
+    return 1;
+}
+
+/** handshake step in worker, or result from worker */
+static int
+_tls_handshake_async(mnet_tls_t *tls, chann_msg_t *msg, mnet_tls_ud_t *tu) {
+    mnet_tls_pool_t *pool = &tls->pool;
+    pthread_mutex_lock(&pool->lock);
+    int job = tu->job;
+    if (job == JOB_DONE) {
+        tu->job = JOB_IDLE;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (job == JOB_QUEUED || job == JOB_RUNNING) {
+        // fd event before paused
+        return 0;
+    }
+    if (job == JOB_IDLE) {
+        _pool_submit(tls, msg->n, tu);
+        return 0;
+    }
+    mnet_ext_chann_pending(msg->n, 0);
+    mnet_ext_chann_pause(msg->n, 0);
+    if (tu->job_ret != 1 && tu->job_err == SSL_ERROR_WANT_WRITE) {
+        _pool_submit(tls, msg->n, tu);
+        return 0;
+    }
+    return _tls_handshake_result(msg, tu, tu->job_ret, tu->job_err);
+}
+
+/** coalesced writes, plaintext buffered to full record, records sealed into
+ * memory BIO, then one send for all before poll wait or backlog full
+ */
+static int
+_tls_seal(mnet_tls_ud_t *tu, const uint8_t *buf, int len) {
+    // memory BIO never blocks, partial write mode returns each record
+    for (int sent = 0; sent < len; ) {
+        int ret = SSL_write(tu->ssl, buf + sent, len - sent);
+        if (ret <= 0) {
+            return 0;
+        }
+        sent += ret;
+    }
+    g_tls.stats.records += (len + MNET_TLS_RECORD_SIZE - 1) / MNET_TLS_RECORD_SIZE;
+    return 1;
+}
+
+/** return 1 for all sealed records sent, 0 for blocked, <0 for error
+ */
+static int
+_tls_flush_wbio(chann_t *n, mnet_tls_ud_t *tu) {
+    char *data = NULL;
+    long len = BIO_get_mem_data(tu->wbio, &data);
+    if (len <= 0) {
+        return 1;
+    }
+    g_tls.stats.flushes += 1;
+    ssize_t ret = send(mnet_chann_fd(n), data, (size_t)len, 0);
+    if (ret < 0) {
+        return errno == EWOULDBLOCK ? 0 : -1;
+    }
+    if (ret >= len) {
+        (void)BIO_reset(tu->wbio);
+        return 1;
+    }
+    // drop sent part, rare under backpressure
+    uint8_t drop[4096];
+    for (long left = ret; left > 0; ) {
+        int count = BIO_read(tu->wbio, drop, left < (long)sizeof(drop) ? (int)left : (int)sizeof(drop));
+        if (count <= 0) {
+            return -1;
+        }
+        left -= count;
+    }
+    return 0;
+}
+
+static int
+_tls_send_coalesce(chann_t *n, mnet_tls_ud_t *tu, const uint8_t *buf, int len) {
+    if (BIO_pending(tu->wbio) >= MNET_TLS_WRITE_BACKLOG && _tls_flush_wbio(n, tu) < 0) {
+        return -1;
+    }
+    int sent = 0;
+    while (sent < len && BIO_pending(tu->wbio) < MNET_TLS_WRITE_BACKLOG) {
+        int left = len - sent;
+        if (tu->wlen == 0 && left >= MNET_TLS_RECORD_SIZE) {
+            // full records from caller buffer, no copy
+            int count = left - left % MNET_TLS_RECORD_SIZE;
+            count = count < MNET_TLS_WRITE_BACKLOG ? count : MNET_TLS_WRITE_BACKLOG;
+            if (!_tls_seal(tu, buf + sent, count)) {
+                return -1;
+            }
+            sent += count;
+        } else {
+            if (tu->wbuf == NULL) {
+                if ((tu->wbuf = (uint8_t *)malloc(MNET_TLS_RECORD_SIZE)) == NULL) {
+                    return -1;
+                }
+                g_tls.wbuf_count += 1;
+            }
+            int count = MNET_TLS_RECORD_SIZE - tu->wlen;
+            count = left < count ? left : count;
+            memcpy(tu->wbuf + tu->wlen, buf + sent, count);
+            tu->wlen += count;
+            sent += count;
+            if (tu->wlen >= MNET_TLS_RECORD_SIZE) {
+                if (!_tls_seal(tu, tu->wbuf, tu->wlen)) {
+                    return -1;
+                }
+                tu->wlen = 0;
+            }
+        }
+    }
+    if (BIO_pending(tu->wbio) >= MNET_TLS_WRITE_BACKLOG && _tls_flush_wbio(n, tu) < 0) {
+        return -1;
+    }
+    // partial record and sealed ones before poll wait, less than backlog
+    mnet_ext_chann_flush(n);
+    return sent;
+}
+
 static int
 _tls_type_fn(void *ext_ctx, chann_type_t ctype) {
     return CHANN_TYPE_STREAM;
@@ -46,52 +909,32 @@ _tls_type_fn(void *ext_ctx, chann_type_t ctype) {
  */
 static int
 _tls_filter_fn(void *ext_ctx, chann_msg_t *msg) {
-    //printf("event:%d, n:%p, r:%p, tu:%p\n", msg->event, msg->n, msg->r, mnet_ext_chann_get_ud(msg->n));
+    //printf("event:%d, n:%p, r:%p, tu:%p\n", msg->event, msg->n, msg->r, _tls_ud(msg->n));
     switch (msg->event) {
         case CHANN_EVENT_ACCEPT: {
-            mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(msg->r);
-            if (tu) {
-                tu->ln = msg->n;
+            mnet_tls_ud_t *tu = _tls_ud(msg->r);
+            if (tu == NULL || tu->state == CHANN_STATE_CONNECTED) {
+                // handshake finished in accept_cb, emit event
+                return 1;
             }
+            tu->ln = msg->n;
             return 0;
         }
         case CHANN_EVENT_CONNECTED:
         case CHANN_EVENT_RECV: {
-            mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(msg->n);
+            mnet_tls_ud_t *tu = _tls_ud(msg->n);
             if (tu == NULL || tu->state == CHANN_STATE_CONNECTED) {
                 // no need handshake or just TLS connected, emit event
                 return 1;
             }
             //printf("tu:%p, ssl:%p, state:%d\n", tu, tu->ssl, tu->state);
-            int ret = tu->state == CHANN_STATE_LISTENING ? SSL_accept(tu->ssl) : SSL_connect(tu->ssl);
-            if (ret == 1) {
-                if (tu->state == CHANN_STATE_LISTENING) {
-                    msg->event = CHANN_EVENT_ACCEPT;
-                    msg->r = msg->n;
-                    msg->n = tu->ln;
-                    tu->ln = NULL;
-                } else {
-                    msg->event = CHANN_EVENT_CONNECTED;
-                }
-                tu->state = CHANN_STATE_CONNECTED;
-                // emit accept/connected event
-                return 1;
-            }
-            if (_ssl_is_rw(tu->ssl, ret)) {
-                // read/write in process, block event
-                return 0;
-            } else {
-                if (tu->state == CHANN_STATE_LISTENING) {
-                    mnet_chann_disconnect(msg->n);
-                    // block listening event
-                    return 0;
-                } else {
-                    msg->event = CHANN_EVENT_DISCONNECT;
-                    mnet_chann_disconnect(msg->n);
-                    // emit disconnect event
-                    return 1;
-                }
+            mnet_tls_t *tls = (mnet_tls_t *)ext_ctx;
+            if (tls->pool.count > 0) {
+                return _tls_handshake_async(tls, msg, tu);
             }
+            int ret = tu->state == CHANN_STATE_LISTENING ? SSL_accept(tu->ssl) : SSL_connect(tu->ssl);
+            int err = ret == 1 ? SSL_ERROR_NONE : SSL_get_error(tu->ssl, ret);
+            return _tls_handshake_result(msg, tu, ret, err);
         }
         default:
             break;
@@ -104,7 +947,7 @@ _tls_filter_fn(void *ext_ctx, chann_msg_t *msg) {
 static void
 _tls_open_cb(void *ext_ctx, chann_t *n) {
     //printf("open %p\n", n);
-    mnet_tls_ud_t *tu = (mnet_tls_ud_t *)calloc(1, sizeof(mnet_tls_ud_t));
+    mnet_tls_ud_t *tu = _ud_new((mnet_tls_t *)ext_ctx);
     if (tu) {
         tu->state = CHANN_STATE_DISCONNECT;
         mnet_ext_chann_set_ud(n, tu);
@@ -116,13 +959,12 @@ _tls_open_cb(void *ext_ctx, chann_t *n) {
 static void
 _tls_close_cb(void *ext_ctx, chann_t *n) {
     //printf("close %p\n", n);
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
+    mnet_tls_ud_t *tu = _tls_ud(n);
     if (tu && tu->state > CHANN_STATE_CLOSED) {
+        _pool_cancel(&((mnet_tls_t *)ext_ctx)->pool, tu);
         tu->state = CHANN_STATE_CLOSED;
-        if (tu->ssl) {
-            SSL_free(tu->ssl);
-        }
-        free(tu);
+        _active_remove((mnet_tls_t *)ext_ctx, tu);
+        _ud_free((mnet_tls_t *)ext_ctx, tu);
         mnet_ext_chann_set_ud(n, NULL);
     }
 }
@@ -130,11 +972,11 @@ _tls_close_cb(void *ext_ctx, chann_t *n) {
 static void
 _tls_listen_cb(void *ext_ctx, chann_t *n) {
     //printf("listen %p\n", n);
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
+    mnet_tls_ud_t *tu = _tls_ud(n);
     if (tu) {
         // listen chann no need TLS handshake
         mnet_ext_chann_set_ud(n, NULL);
-        free(tu);
+        _ud_free((mnet_tls_t *)ext_ctx, tu);
     }
 }
 
@@ -143,16 +985,26 @@ _tls_listen_cb(void *ext_ctx, chann_t *n) {
 static void
 _tls_accept_cb(void *ext_ctx, chann_t *n) {
     //printf("accept %p\n", n);
-    mnet_tls_ud_t *tu = (mnet_tls_ud_t *)calloc(1, sizeof(mnet_tls_ud_t));
+    mnet_tls_ud_t *tu = _ud_new((mnet_tls_t *)ext_ctx);
+    if (tu == NULL) {
+        mnet_chann_disconnect(n);
+        return;
+    }
     mnet_ext_chann_set_ud(n, tu);
     tu->state = CHANN_STATE_LISTENING;
 
-    tu->ssl = SSL_new((SSL_CTX *)ext_ctx);
-    _ssl_set_fd(tu->ssl, mnet_chann_fd(n));
+    if (!_ud_ssl((mnet_tls_t *)ext_ctx, tu, n, 1)) {
+        mnet_chann_disconnect(n);
+        return;
+    }
+    if (((mnet_tls_t *)ext_ctx)->pool.count > 0) {
+        // ClientHello in first RECV event
+        return;
+    }
 
     int ret = SSL_accept(tu->ssl);
     if (ret == 1) {
-        tu->state = CHANN_STATE_CONNECTED;
+        _tls_handshake_done(n, tu);
     } else if (!_ssl_is_rw(tu->ssl, ret)) {
         mnet_chann_disconnect(n);
     }
@@ -163,18 +1015,26 @@ _tls_accept_cb(void *ext_ctx, chann_t *n) {
 static void
 _tls_connect_cb(void *ext_ctx, chann_t *n) {
     //printf("connect %p\n", n);
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
+    mnet_tls_ud_t *tu = _tls_ud(n);
     if (tu == NULL) {
         return;
     }
     tu->state = CHANN_STATE_CONNECTING;
 
-    tu->ssl = SSL_new((SSL_CTX *)ext_ctx);
-    _ssl_set_fd(tu->ssl, mnet_chann_fd(n));
+    // cleared SSL reused in reconnect
+    if (!_ud_ssl((mnet_tls_t *)ext_ctx, tu, n, 0)) {
+        mnet_chann_disconnect(n);
+        return;
+    }
+    _session_offer((mnet_tls_t *)ext_ctx, n, tu);
+    if (((mnet_tls_t *)ext_ctx)->pool.count > 0) {
+        // ClientHello after CONNECTED event
+        return;
+    }
 
     int ret = SSL_connect(tu->ssl);
     if (ret == 1) {
-        tu->state = CHANN_STATE_CONNECTED;
+        _tls_handshake_done(n, tu);
     } else if (!_ssl_is_rw(tu->ssl, ret)) {
         mnet_chann_disconnect(n);
     }
@@ -185,10 +1045,22 @@ _tls_connect_cb(void *ext_ctx, chann_t *n) {
 static void
 _tls_disconnect_cb(void *ext_ctx, chann_t *n) {
     //printf("disconnect %p\n", n);
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
+    mnet_tls_ud_t *tu = _tls_ud(n);
     if (tu && tu->state > CHANN_STATE_DISCONNECT) {
+        _pool_cancel(&((mnet_tls_t *)ext_ctx)->pool, tu);
         tu->state = CHANN_STATE_DISCONNECT;
+        tu->ktls = 0;
+        _active_remove((mnet_tls_t *)ext_ctx, tu);
+        if (tu->wbio && tu->wlen > 0) {
+            _tls_seal(tu, tu->wbuf, tu->wlen);
+        }
         SSL_shutdown(tu->ssl);
+        if (tu->wbio) {
+            // best effort for coalesced data and close_notify
+            _tls_flush_wbio(n, tu);
+            tu->wbio = NULL;
+        }
+        tu->wlen = 0;
         SSL_clear(tu->ssl);
     }
 }
@@ -197,17 +1069,25 @@ _tls_disconnect_cb(void *ext_ctx, chann_t *n) {
  */
 static int
 _tls_state_fn(void *ext_ctx, chann_t *n, int state) {
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
+    mnet_tls_ud_t *tu = _tls_ud(n);
     return tu ? tu->state : state;
 }
 
 static int
 _tls_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
     //printf("recv %p\n", n);
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
+    mnet_tls_ud_t *tu = _tls_ud(n);
     if (tu) {
+        // under kernel TLS RX still SSL_read, for alert or ticket in control message
         int ret = SSL_read(tu->ssl, buf, len);
+        // decrypted or read ahead records left, no fd readable for them
+        mnet_ext_chann_pending(n, SSL_has_pending(tu->ssl));
+        if (tu->wbio && BIO_pending(tu->wbio) > 0) {
+            // key update or alert sealed in SSL_read
+            mnet_ext_chann_flush(n);
+        }
         if (ret > 0) {
+            _active_touch((mnet_tls_t *)ext_ctx, n, tu);
             return ret;
         }
         if (_ssl_is_rw(tu->ssl, ret)) {
@@ -219,11 +1099,43 @@ _tls_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
     }
 }
 
+/** seal partial record, then send sealed records
+ */
+static int
+_tls_flush_fn(void *ext_ctx, chann_t *n) {
+    mnet_tls_ud_t *tu = _tls_ud(n);
+    if (tu && tu == ((mnet_tls_t *)ext_ctx)->active_head) {
+        _active_sweep((mnet_tls_t *)ext_ctx);
+    }
+    if (tu == NULL || tu->wbio == NULL) {
+        return 1;
+    }
+    if (tu->wlen > 0) {
+        if (!_tls_seal(tu, tu->wbuf, tu->wlen)) {
+            return -1;
+        }
+        tu->wlen = 0;
+    }
+    return _tls_flush_wbio(n, tu);
+}
+
 static int
 _tls_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
     //printf("send %p: %p,%d\n", n, buf, len);
-    mnet_tls_ud_t *tu = mnet_ext_chann_get_ud(n);
-    if (tu) {
+    mnet_tls_ud_t *tu = _tls_ud(n);
+    if (tu && tu->state == CHANN_STATE_CONNECTED) {
+        _active_touch((mnet_tls_t *)ext_ctx, n, tu);
+    }
+    if (tu && (tu->ktls & KTLS_SEND)) {
+        // kernel builds records, plain send as STREAM chann
+        int ret = (int)send(mnet_chann_fd(n), buf, len, 0);
+        if (ret<0 && errno==EWOULDBLOCK) {
+            ret = 0;
+        }
+        return ret;
+    } else if (tu && tu->wbio) {
+        return _tls_send_coalesce(n, tu, (const uint8_t *)buf, len);
+    } else if (tu) {
         int ret = SSL_write(tu->ssl, buf, len);
         if (ret > 0) {
             return ret;
@@ -238,10 +1150,39 @@ _tls_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
 }
 
 int
-mnet_tls_config(SSL_CTX *ext_ctx) {
-    if (ext_ctx) {
+mnet_tls_config(SSL_CTX *ssl_ctx) {
+    if (ssl_ctx) {
+        mnet_tls_t *tls = &g_tls;
+        if (tls->ctx) {
+            _pool_stop(&tls->pool);
+            pthread_mutex_destroy(&tls->lock);
+            pthread_mutex_destroy(&tls->pool.lock);
+            pthread_cond_destroy(&tls->pool.cond);
+            pthread_cond_destroy(&tls->pool.done);
+        }
+        _sessions_free(tls);
+        _uds_free(tls, 0);
+        memset(tls, 0, sizeof(*tls));
+        pthread_mutex_init(&tls->lock, NULL);
+        pthread_mutex_init(&tls->pool.lock, NULL);
+        pthread_cond_init(&tls->pool.cond, NULL);
+        pthread_cond_init(&tls->pool.done, NULL);
+        tls->ctx = ssl_ctx;
+        SSL_CTX_sess_set_new_cb(ssl_ctx, _session_new_cb);
+        // one recv for multiple records, left records drained by pending RECV
+        SSL_CTX_set_read_ahead(ssl_ctx, 1);
+        if (!mnet_tls_option(MNET_TLS_OPT_SESSION_CACHE, MNET_TLS_SESSION_CACHE) ||
+            !mnet_tls_option(MNET_TLS_OPT_TICKET_ROTATE, MNET_TLS_TICKET_ROTATE) ||
+            !mnet_tls_option(MNET_TLS_OPT_CLIENT_SESSIONS, MNET_TLS_CLIENT_SESSIONS) ||
+            !mnet_tls_option(MNET_TLS_OPT_WRITE_COALESCE, 1) ||
+            !mnet_tls_option(MNET_TLS_OPT_SSL_POOL, MNET_TLS_SSL_POOL) ||
+            !mnet_tls_option(MNET_TLS_OPT_RELEASE_BUFFERS, 1) ||
+            !mnet_tls_option(MNET_TLS_OPT_NODELAY, 1))
+        {
+            return 0;
+        }
         mnet_ext_t ext = {
-            .ext_ctx = ext_ctx,
+            .ext_ctx = tls,
             .type_fn = _tls_type_fn,
             .filter_fn = _tls_filter_fn,
             .open_cb = _tls_open_cb,
@@ -253,9 +1194,195 @@ mnet_tls_config(SSL_CTX *ext_ctx) {
             .state_fn = _tls_state_fn,
             .recv_fn = _tls_recv_fn,
             .send_fn = _tls_send_fn,
+            .flush_fn = _tls_flush_fn,
+            .lower = 0,     // socket fd I/O, lowest layer only
         };
         return mnet_ext_register(CHANN_TYPE_TLS, &ext);
     } else {
         return 0;
     }
-}
\ No newline at end of file
+}
+
+/** server cache and client sessions share SSL_CTX session cache mode, client
+ * sessions not stored internally, but in host:port slots
+ */
+static void
+_session_cache_mode(mnet_tls_t *tls, int server_size) {
+    long mode = SSL_SESS_CACHE_OFF;
+    if (server_size > 0) {
+        mode |= SSL_SESS_CACHE_SERVER;
+        SSL_CTX_sess_set_cache_size(tls->ctx, server_size);
+    }
+    if (tls->session_count > 0) {
+        mode |= SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE;
+    }
+    SSL_CTX_set_session_cache_mode(tls->ctx, mode);
+}
+
+int
+mnet_tls_option(mnet_tls_option_t opt, int value) {
+    mnet_tls_t *tls = &g_tls;
+    if (tls->ctx == NULL || value < 0) {
+        return 0;
+    }
+    switch (opt) {
+        case MNET_TLS_OPT_SESSION_CACHE: {
+            static const unsigned char sid_ctx[] = "mnet_tls";
+            SSL_CTX_set_session_id_context(tls->ctx, sid_ctx, sizeof(sid_ctx) - 1);
+            _session_cache_mode(tls, value);
+            return 1;
+        }
+        case MNET_TLS_OPT_TICKET_ROTATE: {
+            tls->ticket_rotate = value;
+            if (value > 0) {
+                SSL_CTX_clear_options(tls->ctx, SSL_OP_NO_TICKET);
+                if (SSL_CTX_get_num_tickets(tls->ctx) == 0) {
+                    SSL_CTX_set_num_tickets(tls->ctx, 2); /* OpenSSL default */
+                }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+                SSL_CTX_set_tlsext_ticket_key_evp_cb(tls->ctx, _ticket_key_cb);
+#else
+                SSL_CTX_set_tlsext_ticket_key_cb(tls->ctx, _ticket_key_cb);
+#endif
+            } else {
+                SSL_CTX_set_options(tls->ctx, SSL_OP_NO_TICKET);
+                SSL_CTX_set_num_tickets(tls->ctx, 0);
+            }
+            return 1;
+        }
+        case MNET_TLS_OPT_CLIENT_SESSIONS: {
+            int server_size = (SSL_CTX_get_session_cache_mode(tls->ctx) & SSL_SESS_CACHE_SERVER) ?
+                (int)SSL_CTX_sess_get_cache_size(tls->ctx) : 0;
+            _sessions_free(tls);
+            if (value > 0) {
+                tls->sessions = (mnet_tls_session_t *)calloc(value, sizeof(mnet_tls_session_t));
+                if (tls->sessions == NULL) {
+                    return 0;
+                }
+                tls->session_count = value;
+            }
+            _session_cache_mode(tls, server_size);
+            return 1;
+        }
+        case MNET_TLS_OPT_KTLS: {
+#ifdef MNET_TLS_KTLS
+            tls->ktls = value > 0 && _ktls_probe();
+            if (tls->ktls) {
+                SSL_CTX_set_options(tls->ctx, SSL_OP_ENABLE_KTLS);
+            } else {
+                SSL_CTX_clear_options(tls->ctx, SSL_OP_ENABLE_KTLS);
+            }
+            return tls->ktls == (value > 0);
+#else
+            return value == 0;
+#endif
+        }
+        case MNET_TLS_OPT_HANDSHAKE_THREADS: {
+            if (value > MNET_TLS_HANDSHAKE_THREADS || (value > 0 && !mnet_ext_wakeup_init())) {
+                return 0;
+            }
+            if (value == 0) {
+                _pool_stop(&tls->pool);
+                return 1;
+            }
+            return _pool_start(&tls->pool, value);
+        }
+        case MNET_TLS_OPT_WRITE_COALESCE: {
+            // applied to channs after handshake
+            tls->coalesce = value > 0;
+            return 1;
+        }
+        case MNET_TLS_OPT_SSL_POOL: {
+            tls->pool_size = value;
+            _uds_free(tls, value);
+            return 1;
+        }
+        case MNET_TLS_OPT_RELEASE_BUFFERS: {
+            // channs join active list in next recv/send
+            tls->release = value > 0;
+            return 1;
+        }
+        case MNET_TLS_OPT_NODELAY: {
+            // applied to socket in next accept/connect
+            tls->nodelay = value > 0;
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+void
+mnet_tls_stats(mnet_tls_stats_t *stats) {
+    if (stats) {
+        *stats = g_tls.stats;
+    }
+}
+
+int
+mnet_tls_mem_track(void) {
+    if (!g_mem_track) {
+        g_mem_track = CRYPTO_set_mem_functions(_mem_malloc, _mem_realloc, _mem_free);
+    }
+    return g_mem_track;
+}
+
+int
+mnet_tls_mem_report(mnet_tls_mem_t *mem) {
+    mnet_tls_t *tls = &g_tls;
+    if (tls->ctx == NULL || mem == NULL) {
+        return 0;
+    }
+    mem->channs = tls->ud_count;
+    mem->pooled = tls->pool_count;
+    mem->ud_bytes = (tls->ud_count + tls->pool_count) * (int64_t)sizeof(mnet_tls_ud_t) +
+        tls->wbuf_count * MNET_TLS_RECORD_SIZE;
+    mem->crypto_bytes = g_mem_track ? g_crypto_bytes : -1;
+    return 1;
+}
+
+SSL*
+mnet_tls_chann_ssl(chann_t *n) {
+    mnet_tls_ud_t *tu = n ? _tls_ud(n) : NULL;
+    return tu ? tu->ssl : NULL;
+}
+
+long
+mnet_tls_chann_sendfile(chann_t *n, int fd, long offset, long size) {
+    mnet_tls_ud_t *tu = n ? _tls_ud(n) : NULL;
+    if (tu == NULL || tu->state != CHANN_STATE_CONNECTED || fd < 0 || offset < 0 || size <= 0) {
+        return -1;
+    }
+    if (mnet_chann_cached(n) > 0) {
+        // keep order with cached data
+        return 0;
+    }
+#ifdef MNET_TLS_KTLS
+    if (tu->ktls & KTLS_SEND) {
+        ossl_ssize_t ret = SSL_sendfile(tu->ssl, fd, (off_t)offset, (size_t)size, 0);
+        if (ret > 0) {
+            return (long)ret;
+        }
+        return _ssl_is_rw(tu->ssl, (int)ret) ? 0 : -1;
+    }
+#endif
+    // user space TLS, send chunks until cached
+    if (lseek(fd, (off_t)offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    uint8_t buf[MNET_TLS_SENDFILE_CHUNK];
+    long sent = 0;
+    while (sent < size && mnet_chann_cached(n) <= 0) {
+        long count = size - sent < (long)sizeof(buf) ? size - sent : (long)sizeof(buf);
+        ssize_t ret = read(fd, buf, (size_t)count);
+        if (ret <= 0) {
+            // EOF or error
+            return sent > 0 ? sent : -1;
+        }
+        if (mnet_chann_send(n, buf, (int)ret) < 0) {
+            return -1;
+        }
+        sent += ret;
+    }
+    return sent;
+}
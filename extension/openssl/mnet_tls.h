@@ -13,7 +13,70 @@
 
 extern chann_type_t const CHANN_TYPE_TLS;
 
-/* config tls */
+typedef enum {
+    MNET_TLS_OPT_SESSION_CACHE = 1, /* server session cache size, 0 to disable, default 1024 */
+    MNET_TLS_OPT_TICKET_ROTATE,     /* server ticket key rotate seconds, 0 to disable ticket, default 3600 */
+    MNET_TLS_OPT_CLIENT_SESSIONS,   /* client sessions for host:port, 0 to disable, default 256 */
+    MNET_TLS_OPT_KTLS,              /* 1 for kernel TLS after handshake, fail without tls module, default 0 */
+    MNET_TLS_OPT_HANDSHAKE_THREADS, /* handshake threads, set before open channs, 0 for in loop, default 0 */
+    MNET_TLS_OPT_WRITE_COALESCE,    /* 1 for full records from sends in dispatch pass, 0 for record each send, default 1 */
+    MNET_TLS_OPT_SSL_POOL,          /* cleared SSL kept for new channs, 0 to disable, default 1024 */
+    MNET_TLS_OPT_RELEASE_BUFFERS,   /* 1 for record buffers freed after 1 second without recv/send, default 1 */
+    MNET_TLS_OPT_NODELAY,           /* 1 for TCP_NODELAY, records already coalesced before send, default 1 */
+} mnet_tls_option_t;
+
+typedef struct {
+    uint64_t full;                  /* full handshakes */
+    uint64_t resumed;               /* resumed handshakes from session cache or ticket */
+    uint64_t client_hits;           /* client session offered and reused */
+    uint64_t client_misses;         /* client without session, or session rejected */
+    uint64_t ticket_rotated;        /* ticket keys generated, first one included */
+    uint64_t ktls_send;             /* handshakes with kernel TLS TX */
+    uint64_t ktls_recv;             /* handshakes with kernel TLS RX */
+    uint64_t offloaded;             /* handshake steps run in threads */
+    uint64_t records;               /* records sealed from coalesced writes */
+    uint64_t flushes;               /* send calls for coalesced records */
+    uint64_t pool_hits;             /* channs with pooled SSL */
+} mnet_tls_stats_t;
+
+/* memory held for TLS channs, OpenSSL heap counted after mnet_tls_mem_track()
+ */
+typedef struct {
+    int64_t channs;                 /* channs with TLS ud */
+    int64_t pooled;                 /* pooled ud with cleared SSL */
+    int64_t ud_bytes;               /* ud in use or pooled, and coalesce buffers */
+    int64_t crypto_bytes;           /* OpenSSL heap, SSL, sessions and record buffers, -1 without tracking */
+} mnet_tls_mem_t;
+
+/* config tls, with session resumption enabled by default, TLS read/write
+ * chann fd itself for socket BIO, kTLS and handshake threads, so always
+ * lowest layer over STREAM, other exts can stack above it
+ */
 int mnet_tls_config(SSL_CTX *ctx);
 
+/* set option after config, return 1 for ok */
+int mnet_tls_option(mnet_tls_option_t opt, int value);
+
+/* handshake and session resumption counters */
+void mnet_tls_stats(mnet_tls_stats_t *stats);
+
+/* count OpenSSL heap for mnet_tls_mem_report(), call before any OpenSSL
+ * function, return 1 for ok
+ */
+int mnet_tls_mem_track(void);
+
+/* memory for TLS channs, return 1 for ok */
+int mnet_tls_mem_report(mnet_tls_mem_t *mem);
+
+/* SSL for TLS chann, NULL before connect/accept, with memory write BIO under
+ * write coalescing, send data with mnet_chann_send()
+ */
+SSL* mnet_tls_chann_ssl(chann_t *n);
+
+/* send file range after cached data drained, SSL_sendfile() under kernel TLS
+ * TX, or read and mnet_chann_send(), return bytes sent, 0 for waiting
+ * CHANN_EVENT_SEND, <0 for error
+ */
+long mnet_tls_chann_sendfile(chann_t *n, int fd, long offset, long size);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnet_pool.h"
+#if defined(_WIN32) || defined(_WIN64)
+#include <winsock2.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+#define POOL_HASH_SIZE 256      /* chann hash buckets */
+
+enum {
+   POOL_CONN_IDLE = 0,          /* connected in pool */
+   POOL_CONN_CONNECTING,        /* pre-warming in pool */
+   POOL_CONN_LENT,              /* acquired by user */
+};
+
+typedef struct s_upstream upstream_t;
+
+typedef struct s_pool_conn {
+   chann_t *n;
+   upstream_t *up;
+   int state;
+   struct s_pool_conn *hnext;   /* chann hash chain */
+   struct s_pool_conn *prev;    /* idle/connecting list in upstream */
+   struct s_pool_conn *next;
+} pool_conn_t;
+
+struct s_upstream {
+   chann_type_t ctype;
+   chann_addr_t addr;
+   int total;                   /* lent + idle + connecting */
+   int count[2];                /* idle, connecting */
+   pool_conn_t *list[2];        /* idle, connecting, head for latest */
+   upstream_t *next;
+};
+
+struct s_mnet_pool {
+   mnet_pool_conf_t conf;
+   mnet_pool_stats_t stats;
+   upstream_t *upstreams;
+   pool_conn_t *htable[POOL_HASH_SIZE];
+};
+
+static inline unsigned
+_chann_hash(chann_t *n) {
+   return (unsigned)(((uintptr_t)n >> 4) & (POOL_HASH_SIZE - 1));
+}
+
+/* chann hash
+ */
+
+static pool_conn_t*
+_conn_find(mnet_pool_t *pool, chann_t *n) {
+   pool_conn_t *c = pool->htable[_chann_hash(n)];
+   for (; c; c = c->hnext) {
+      if (c->n == n) {
+         return c;
+      }
+   }
+   return NULL;
+}
+
+/* upstream list for idle/connecting
+ */
+
+static void
+_list_push(pool_conn_t *c, int state) {
+   upstream_t *up = c->up;
+   c->state = state;
+   c->prev = NULL;
+   c->next = up->list[state];
+   if (up->list[state]) {
+      up->list[state]->prev = c;
+   }
+   up->list[state] = c;
+   up->count[state] += 1;
+}
+
+static void
+_list_unlink(pool_conn_t *c) {
+   upstream_t *up = c->up;
+   if (c->next) { c->next->prev = c->prev; }
+   if (c->prev) { c->prev->next = c->next; }
+   else { up->list[c->state] = c->next; }
+   c->prev = c->next = NULL;
+   up->count[c->state] -= 1;
+}
+
+/* change conn state, update list and stats */
+static void
+_conn_set_state(mnet_pool_t *pool, pool_conn_t *c, int state) {
+   int *counts[3] = { &pool->stats.idle, &pool->stats.connecting, &pool->stats.lent };
+   if (c->state != POOL_CONN_LENT) {
+      _list_unlink(c);
+   }
+   *counts[c->state] -= 1;
+   if (state != POOL_CONN_LENT) {
+      _list_push(c, state);
+   } else {
+      c->state = state;
+   }
+   *counts[state] += 1;
+}
+
+static upstream_t*
+_upstream_get(mnet_pool_t *pool, chann_type_t ctype, const char *ip, int port) {
+   upstream_t *up = pool->upstreams;
+   for (; up; up = up->next) {
+      if (up->ctype == ctype && up->addr.port == port && strcmp(up->addr.ip, ip) == 0) {
+         return up;
+      }
+   }
+   if (strlen(ip) >= sizeof(up->addr.ip)) {
+      return NULL;
+   }
+   up = (upstream_t *)calloc(1, sizeof(upstream_t));
+   if (up) {
+      up->ctype = ctype;
+      strcpy(up->addr.ip, ip);
+      up->addr.port = port;
+      up->next = pool->upstreams;
+      pool->upstreams = up;
+      pool->stats.upstreams += 1;
+   }
+   return up;
+}
+
+/* open new chann in connecting, tracked as state */
+static pool_conn_t*
+_conn_open(mnet_pool_t *pool, upstream_t *up, int state) {
+   if (up->total >= pool->conf.max_conns) {
+      return NULL;
+   }
+   pool_conn_t *c = (pool_conn_t *)calloc(1, sizeof(pool_conn_t));
+   chann_t *n = c ? mnet_chann_open(up->ctype) : NULL;
+   if (n == NULL || !mnet_chann_connect(n, up->addr.ip, up->addr.port)) {
+      mnet_chann_close(n);
+      free(c);
+      return NULL;
+   }
+   c->n = n;
+   c->up = up;
+   c->hnext = pool->htable[_chann_hash(n)];
+   pool->htable[_chann_hash(n)] = c;
+   up->total += 1;
+   pool->stats.created += 1;
+   if (state == POOL_CONN_LENT) {
+      c->state = state;
+      pool->stats.lent += 1;
+   } else {
+      _list_push(c, state);
+      pool->stats.connecting += 1;
+      mnet_chann_active_event(n, CHANN_EVENT_TIMER, pool->conf.connect_timeout_ms);
+   }
+   return c;
+}
+
+/* forget conn, close chann when close_chann */
+static void
+_conn_remove(mnet_pool_t *pool, pool_conn_t *c, int close_chann) {
+   pool_conn_t **pc = &pool->htable[_chann_hash(c->n)];
+   for (; *pc; pc = &(*pc)->hnext) {
+      if (*pc == c) {
+         *pc = c->hnext;
+         break;
+      }
+   }
+   int *counts[3] = { &pool->stats.idle, &pool->stats.connecting, &pool->stats.lent };
+   if (c->state != POOL_CONN_LENT) {
+      _list_unlink(c);
+   }
+   *counts[c->state] -= 1;
+   c->up->total -= 1;
+   if (close_chann) {
+      mnet_chann_close(c->n);
+   }
+   free(c);
+}
+
+/* connected STREAM without pending EOF or data */
+static int
+_conn_is_healthy(pool_conn_t *c) {
+   chann_t *n = c->n;
+   if (mnet_chann_state(n) != CHANN_STATE_CONNECTED) {
+      return 0;
+   }
+   if (mnet_chann_type(n) == CHANN_TYPE_STREAM) {
+      char ch;
+      int ret = (int)recv(mnet_chann_fd(n), &ch, 1, MSG_PEEK);
+#if defined(_WIN32) || defined(_WIN64)
+      return ret < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+      return ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
+#endif
+   }
+   return 1;
+}
+
+/* Public Interface
+ */
+
+mnet_pool_t*
+mnet_pool_create(mnet_pool_conf_t *conf) {
+   mnet_pool_t *pool = (mnet_pool_t *)calloc(1, sizeof(mnet_pool_t));
+   if (pool) {
+      mnet_pool_conf_t *pc = &pool->conf;
+      if (conf) {
+         *pc = *conf;
+      }
+      pc->max_conns = pc->max_conns > 0 ? pc->max_conns : 16;
+      pc->max_idle = (pc->max_idle > 0 && pc->max_idle < pc->max_conns) ? pc->max_idle : pc->max_conns;
+      pc->idle_timeout_ms = pc->idle_timeout_ms > 0 ? pc->idle_timeout_ms : 60000;
+      pc->connect_timeout_ms = pc->connect_timeout_ms > 0 ? pc->connect_timeout_ms : 3000;
+   }
+   return pool;
+}
+
+void
+mnet_pool_destroy(mnet_pool_t *pool) {
+   if (pool == NULL) {
+      return;
+   }
+   for (int i=0; i<POOL_HASH_SIZE; i++) {
+      while (pool->htable[i]) {
+         pool_conn_t *c = pool->htable[i];
+         _conn_remove(pool, c, c->state != POOL_CONN_LENT);
+      }
+   }
+   while (pool->upstreams) {
+      upstream_t *up = pool->upstreams;
+      pool->upstreams = up->next;
+      free(up);
+   }
+   free(pool);
+}
+
+chann_t*
+mnet_pool_acquire(mnet_pool_t *pool, chann_type_t ctype, const char *ip, int port, int *reused) {
+   upstream_t *up = (pool && ip && port>0) ? _upstream_get(pool, ctype, ip, port) : NULL;
+   if (up == NULL) {
+      return NULL;
+   }
+
+   /* latest released first, skip chann with DISCONNECT event pending */
+   pool_conn_t *c = up->list[POOL_CONN_IDLE];
+   while (c) {
+      pool_conn_t *next = c->next;
+      if (_conn_is_healthy(c)) {
+         break;
+      }
+      if (mnet_chann_state(c->n) == CHANN_STATE_CONNECTED) {
+         pool->stats.closed_broken += 1;
+         _conn_remove(pool, c, 1);
+      }
+      c = next;
+   }
+   if (c) {
+      pool->stats.reused += 1;
+   } else if ((c = up->list[POOL_CONN_CONNECTING]) == NULL) {
+      c = _conn_open(pool, up, POOL_CONN_LENT);
+      if (c == NULL) {
+         return NULL;
+      }
+   }
+
+   if (c->state != POOL_CONN_LENT) {
+      _conn_set_state(pool, c, POOL_CONN_LENT);
+   }
+   mnet_chann_active_event(c->n, CHANN_EVENT_TIMER, 0);
+   if (reused) {
+      *reused = (mnet_chann_state(c->n) == CHANN_STATE_CONNECTED);
+   }
+   return c->n;
+}
+
+int
+mnet_pool_release(mnet_pool_t *pool, chann_t *n, int reusable) {
+   pool_conn_t *c = (pool && n) ? _conn_find(pool, n) : NULL;
+   if (c == NULL || c->state != POOL_CONN_LENT) {
+      return -1;
+   }
+   if (!reusable ||
+       c->up->count[POOL_CONN_IDLE] >= pool->conf.max_idle ||
+       mnet_chann_state(n) != CHANN_STATE_CONNECTED ||
+       mnet_chann_cached(n) > 0)
+   {
+      _conn_remove(pool, c, 1);
+      return 0;
+   }
+   _conn_set_state(pool, c, POOL_CONN_IDLE);
+   mnet_chann_set_opaque(n, NULL);
+   mnet_chann_active_event(n, CHANN_EVENT_SEND, 0);
+   mnet_chann_active_event(n, CHANN_EVENT_TIMER, pool->conf.idle_timeout_ms);
+   return 1;
+}
+
+int
+mnet_pool_prewarm(mnet_pool_t *pool, chann_type_t ctype, const char *ip, int port, int count) {
+   upstream_t *up = (pool && ip && port>0) ? _upstream_get(pool, ctype, ip, port) : NULL;
+   int started = 0;
+   while (up &&
+          up->count[POOL_CONN_IDLE] + up->count[POOL_CONN_CONNECTING] < count &&
+          up->count[POOL_CONN_IDLE] + up->count[POOL_CONN_CONNECTING] < pool->conf.max_idle &&
+          _conn_open(pool, up, POOL_CONN_CONNECTING))
+   {
+      started += 1;
+   }
+   return started;
+}
+
+int
+mnet_pool_process(mnet_pool_t *pool, chann_msg_t *msg) {
+   pool_conn_t *c = (pool && msg) ? _conn_find(pool, msg->n) : NULL;
+   if (c == NULL || c->state == POOL_CONN_LENT) {
+      return 0;
+   }
+   switch (msg->event) {
+      case CHANN_EVENT_CONNECTED: {
+         if (c->state == POOL_CONN_CONNECTING) {
+            _conn_set_state(pool, c, POOL_CONN_IDLE);
+            mnet_chann_active_event(c->n, CHANN_EVENT_TIMER, pool->conf.idle_timeout_ms);
+         }
+         break;
+      }
+      case CHANN_EVENT_RECV: {
+         /* peer should not send data to idle chann, error will emit DISCONNECT */
+         char buf[256];
+         if (mnet_chann_recv(c->n, buf, sizeof(buf)) > 0) {
+            pool->stats.closed_broken += 1;
+            _conn_remove(pool, c, 1);
+         }
+         break;
+      }
+      case CHANN_EVENT_TIMER: {
+         if (c->state == POOL_CONN_IDLE) {
+            pool->stats.closed_idle += 1;
+         } else {
+            pool->stats.closed_broken += 1;
+         }
+         _conn_remove(pool, c, 1);
+         break;
+      }
+      case CHANN_EVENT_DISCONNECT: {
+         pool->stats.closed_broken += 1;
+         _conn_remove(pool, c, 1);
+         break;
+      }
+      default:
+         break;
+   }
+   return 1;
+}
+
+void
+mnet_pool_stats(mnet_pool_t *pool, mnet_pool_stats_t *stats) {
+   if (pool && stats) {
+      *stats = pool->stats;
+   }
+}
+
+#undef POOL_HASH_SIZE
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef MNET_POOL_H
+#define MNET_POOL_H
+
+#include "mnet_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* outbound connection pool keyed by chann_type_t and 'ip:port', for
+ * STREAM or ext type build on STREAM like CHANN_TYPE_TLS
+ *
+ * idle and pre-warming channs are owned by pool, their events should be
+ * forwarded to mnet_pool_process() before user handling
+ */
+typedef struct s_mnet_pool mnet_pool_t;
+
+typedef struct {
+   int max_conns;               /* lent + idle + connecting for each upstream, default 16 */
+   int max_idle;                /* idle for each upstream, default max_conns */
+   int idle_timeout_ms;         /* close idle chann after, default 60000 */
+   int connect_timeout_ms;      /* close pre-warming chann after, default 3000 */
+} mnet_pool_conf_t;
+
+typedef struct {
+   int upstreams;               /* upstream count */
+   int lent;                    /* channs acquired by user */
+   int idle;                    /* connected channs in pool */
+   int connecting;              /* pre-warming channs */
+   int64_t reused;              /* acquired from idle */
+   int64_t created;             /* acquired or pre-warmed with new chann */
+   int64_t closed_idle;         /* closed by idle timeout */
+   int64_t closed_broken;       /* closed by peer EOF, error or unexpected data */
+} mnet_pool_stats_t;
+
+/* -- create pool after mnet_init
+ * conf: NULL for default
+ */
+mnet_pool_t* mnet_pool_create(mnet_pool_conf_t *conf);
+
+/* -- close idle and connecting channs, lent channs were left to user */
+void mnet_pool_destroy(mnet_pool_t *pool);
+
+/* -- acquire chann for upstream
+ * reused: output 1 for connected chann from idle, that no CHANN_EVENT_CONNECTED
+ *         will be emitted, or 0 for new (or pre-warming) chann in connecting
+ * --
+ * return: chann owned by user, NULL for reaching max_conns or error
+ */
+chann_t* mnet_pool_acquire(mnet_pool_t *pool, chann_type_t ctype, const char *ip, int port, int *reused);
+
+/* -- give back chann acquired from pool, kept as idle when connected without
+ * cached data and upstream idle not full, or closed, also for disconnected
+ * chann or error in protocol with reusable = 0
+ * --
+ * return: 1 for kept as idle, 0 for closed, -1 for chann not from pool
+ */
+int mnet_pool_release(mnet_pool_t *pool, chann_t *n, int reusable);
+
+/* -- open connecting channs until idle and connecting reach count
+ * --
+ * return: channs started
+ */
+int mnet_pool_prewarm(mnet_pool_t *pool, chann_type_t ctype, const char *ip, int port, int count);
+
+/* -- process event for idle or pre-warming chann, includes health check
+ * and timeouts
+ * --
+ * return: 1 for consumed by pool, 0 for user event
+ */
+int mnet_pool_process(mnet_pool_t *pool, chann_msg_t *msg);
+
+/* -- current counts */
+void mnet_pool_stats(mnet_pool_t *pool, mnet_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,6 +15,7 @@
    #define MNET_OS_LINUX 1
    #define _BSD_SOURCE
    #define _DEFAULT_SOURCE
+   #define _GNU_SOURCE          /* recvmmsg/sendmmsg */
 #endif
 
 #if MNET_OS_WIN
@@ -24,11 +25,14 @@
 #include <ws2tcpip.h>
 #include <windows.h>
 #include <stdint.h>
+#include <io.h>                 /* write */
+#include <process.h>            /* getpid */
 #endif  // WIN
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 
 #if (MNET_OS_MACOX || MNET_OS_FreeBSD)
@@ -45,6 +49,13 @@
 #if MNET_OS_LINUX
 #include <sys/types.h>
 #include <sys/epoll.h>
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103         /* GSO since Linux 4.18 */
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104             /* GRO since Linux 5.0 */
+#endif
 #endif  /* LINUX */
 
 #if (MNET_OS_MACOX || MNET_OS_LINUX || MNET_OS_FreeBSD)
@@ -88,7 +99,22 @@ int _evt_del(chann_t *n, int set);
 #endif  /* WIN */
 
 #define MNET_SKIPLIST_MAX_LEVEL 32  /* should be enough for 2^32 elements */
-#define MNET_EXT_MAX_SIZE 8         /* including reserved chann_type */
+#define MNET_EXT_MAX_DEPTH 8        /* ext layers for chann_type, bits of pend_data */
+#define MNET_DGRAM_BATCH_MAX 64     /* datagram count for each recvmmsg/sendmmsg */
+#define MNET_DGRAM_GSO_SEGS 64      /* segments for each UDP_SEGMENT send */
+#define MNET_DGRAM_GSO_BYTES 65000  /* bytes for each UDP_SEGMENT send */
+#define MNET_DGRAM_PAYLOAD_MAX 65507 /* max IPv4 UDP payload */
+#define MNET_WHEEL_TICK_MS 100      /* timeout wheel tick */
+
+#define MNET_WHEEL_SLOTS 512        /* timeout wheel slots, power of 2 */
+
+#if MNET_OS_WIN
+#define _mm_barrier() MemoryBarrier()
+#define _mm_compiler_barrier() _ReadWriteBarrier()
+#else
+#define _mm_barrier() __sync_synchronize()
+#define _mm_compiler_barrier() __asm__ __volatile__("" ::: "memory")
+#endif
 
 enum {
    MNET_LOG_ERR = 1,
@@ -140,11 +166,12 @@ typedef struct {
 
 struct s_chann {
    int fd;                      /* socket fd */
+   uint64_t id;                 /* chann id for trace */
    chann_state_t state;         /* chann state */
    chann_type_t ctype;          /* 'tcp', 'udp', 'broadcast' */
 
    void *opaque;                /* user defined data */
-   void *ext_ud;                /* ext ud */
+   void *ext_ud;                /* ext ud, or ud array for stacked layers */
 
    struct sockaddr_in addr;     /* socket address */
    socklen_t addr_len;          /* socket address length */
@@ -156,12 +183,36 @@ struct s_chann {
    chann_t *next;               /* double linked next chann */
    chann_t *del_next;           /* for deleting channs */
    chann_t *dis_next;           /* for disconnected channs */
+   chann_t *pend_next;          /* for ext pending data channs */
+   chann_t *wk_next;            /* for wakeup from other threads */
+   chann_t *flush_next;         /* for ext buffered send data */
 
    int64_t bytes_send;          /* bytes sended */
    int64_t bytes_recv;          /* bytes received */
 
    int buf_size;                /* system socket buffer size */
    uint8_t active_send_event;   /* notify user send data buffer empty */
+   uint8_t dgram_connected;     /* DGRAM connected to fixed peer */
+   uint8_t dgram_gso_off;       /* DGRAM kernel without UDP_SEGMENT */
+   uint8_t dgram_gro;           /* DGRAM UDP_GRO enabled */
+   uint8_t wh_queued;           /* in timeout wheel */
+   uint8_t pend_data;           /* ext layers bits for buffered data not from fd */
+   uint8_t pend_queued;         /* in pending list */
+   uint8_t flush_queued;        /* in flush list */
+   volatile uint8_t wk_queued;  /* in wakeup stack */
+   uint8_t ext_cur;             /* ext layer depth in dispatching, or top depth */
+   uint16_t wh_slot;            /* timeout wheel slot */
+
+   uint32_t to_connect;         /* connect timeout ticks, 0 for none */
+   uint32_t to_idle;            /* idle timeout ticks, 0 for none */
+   uint32_t to_window;          /* recv rate window ticks, 0 for none */
+   uint32_t to_rate_bytes;      /* min recv bytes in window */
+   uint32_t to_begin;           /* tick for connect or accept */
+   uint32_t to_active;          /* tick for last recv/send */
+   uint32_t to_window_begin;    /* tick for recv rate window begin */
+   uint32_t to_window_bytes;    /* bytes_recv for recv rate window begin */
+   chann_t *wh_prev;            /* timeout wheel slot list */
+   chann_t *wh_next;
 
    uint32_t epoll_events;       /* event trigger flags */
    chann_msg_t msg;             /* chann message body */
@@ -181,6 +232,17 @@ typedef int kq_t;
 
 typedef int (*sys_accept_fn)(int, struct sockaddr *, socklen_t *);
 
+/* ext config with its lower layer, internal chann_type_t at depth 0 */
+typedef struct s_ext_layer ext_layer_t;
+struct s_ext_layer {
+   mnet_ext_t ext;               /* copied config */
+   chann_type_t ctype;           /* registered chann_type_t */
+   int raw;                      /* internal chann_type_t at bottom */
+   int depth;                    /* 1 for ext on internal chann_type_t */
+   int flush;                    /* any layer has flush_fn */
+   ext_layer_t *lower;           /* NULL for internal chann_type_t */
+};
+
 struct s_event {
    int size;
    int count;
@@ -194,11 +256,19 @@ typedef struct {
    chann_t *channs;              /* channs list */
    chann_t *del_channs;          /* for deleting channs */
    chann_t *dis_channs;          /* for disconnected events */
+   chann_t *pend_channs;         /* ext pending data for next poll */
+   chann_t *pend_round;          /* ext pending data in this poll */
+   chann_t *flush_channs;        /* ext buffered send data in this pass */
+   chann_t wk;                   /* wakeup pipe read end, not in channs list */
+   int wk_fd;                    /* wakeup pipe write end */
+   chann_t *volatile wk_head;    /* lock free stack pushed from other threads */
 
    kq_t kq;                      /* kqueue or epoll fd */
    struct s_event chg;
    struct s_event evt;
-   mnet_ext_t ext_config[MNET_EXT_MAX_SIZE];     /* key is (CHANN_TYPE_BROADCAST, 7] */
+   ext_layer_t **ext_layers;     /* key is chann_type_t, grows in register */
+   int ext_size;
+   ext_layer_t ext_raw[CHANN_TYPE_BROADCAST + 1]; /* internal chann_type_t */
 
    int fd_count;                 /* fd count */
    int fd_index;                 /* fd index*/
@@ -207,6 +277,29 @@ typedef struct {
    struct sk_link *tm_pos;
    int64_t tm_current;
 
+   mnet_stats_t stats;           /* updated in loop */
+   mnet_stats_t stats_pub;       /* published for mnet_stats_snapshot */
+   volatile uint32_t stats_seq;  /* seqlock for stats_pub, odd in writing */
+
+   int hist_on;                  /* record loop histograms */
+   mnet_loop_hist_t hist;
+   int64_t hist_poll_end;        /* micro seconds when poll returned */
+
+   int64_t slow_us;              /* slow handler threshold */
+   mnet_slow_cb slow_cb;
+   int64_t slow_begin;           /* micro seconds when msg returned to user */
+   chann_t *slow_n;              /* chann for msg returned to user */
+   chann_event_t slow_event;
+
+   uint64_t chann_seq;           /* last chann id */
+   mnet_trace_rec_t *tr_ring;    /* trace ring, NULL for disabled */
+   uint32_t tr_mask;
+   volatile uint64_t tr_head;    /* records written */
+
+   uint32_t wh_tick;             /* timeout wheel current tick */
+   int wh_count;                 /* channs in timeout wheel */
+   chann_t *wh_slots[MNET_WHEEL_SLOTS];
+
    void *ac_context;
    sys_accept_fn ac_fn;
    mnet_balancer_cb ac_before;
@@ -249,24 +342,49 @@ static inline void mm_free(void *p) {
 }
 
 static int _log_level = MNET_LOG_INFO;
-static inline void mm_log(chann_t *n, int level, const char *fmt, ...) {
-   if (level <= _log_level) {
-      char buf[192];
-      va_list argptr;
-      va_start(argptr, fmt);
-      vsprintf(buf, fmt, argptr);
-      va_end(argptr);
-      mnet_log(n, level, buf);
-   }
-}
-//#define mm_log(...)             /* use to disable any log handling */
+#ifdef MNET_NO_LOG
+#define mm_log(...) do {} while (0) /* disable any log handling */
+#else
+static void _mm_log(chann_t *n, int level, const char *fmt, ...) {
+   char buf[192];
+   va_list argptr;
+   va_start(argptr, fmt);
+   vsprintf(buf, fmt, argptr);
+   va_end(argptr);
+   mnet_log(n, level, buf);
+}
+/* level checked before arguments evaluated */
+#define mm_log(n, level, ...) do {                                     \
+      if ((level) <= _log_level) { _mm_log((n), (level), __VA_ARGS__); } \
+   } while (0)
+#endif
 
 static inline int
 _min_of(int a, int b) {
    return a < b ? a : b;
 }
 
+static int64_t _tm_current();
+
+/* record written before head moved, dumper only read records before head */
+static inline void
+_trace(mnet_t *ss, chann_t *n, int op, int event, int bytes, int err) {
+   if (ss->tr_ring) {
+      mnet_trace_rec_t *r = &ss->tr_ring[ss->tr_head & ss->tr_mask];
+      r->ts = _tm_current();
+      r->chann_id = n->id;
+      r->fd = n->fd;
+      r->bytes = bytes;
+      r->err = err;
+      r->op = op;
+      r->event = event;
+      _mm_compiler_barrier();
+      ss->tr_head++;
+   }
+}
+
 static int _chann_msg(chann_t *n, chann_event_t event, chann_t *r, int err);
+static void _chann_disconnect_event(mnet_t *ss, chann_t *n, int err);
 
 /* buf op
  */
@@ -288,6 +406,7 @@ _rwb_new(int len) {
 
 static rwb_t*
 _rwb_create_tail(rwb_head_t *h, int len) {
+   _gmnet()->stats.send_cache_chunks++;
    if (h->count <= 0) {
       h->head = h->tail = _rwb_new(len);
       h->count++;
@@ -306,6 +425,7 @@ _rwb_destroy_head(rwb_head_t *h) {
       h->head = b->next;
       mm_free(b);
       h->count -= 1;
+      _gmnet()->stats.send_cache_chunks--;
       if (h->count <= 0) {
          h->head = h->tail = 0;
       }
@@ -316,6 +436,7 @@ static void
 _rwb_cache(rwb_head_t *h, void *buf, int buf_len) {
    rwb_t *b = _rwb_create_tail(h, buf_len);
    memcpy(b->buf, buf, buf_len);
+   _gmnet()->stats.send_cache_bytes += buf_len;
 }
 
 static uint8_t*
@@ -332,6 +453,7 @@ _rwb_drain(rwb_head_t *h, int drain_len) {
       int len = _min_of(drain_len, _rwb_buffered(b));
       drain_len -= len;
       b->ptr += len;
+      _gmnet()->stats.send_cache_bytes -= len;
       _rwb_destroy_head(h);
    }
 }
@@ -339,6 +461,9 @@ _rwb_drain(rwb_head_t *h, int drain_len) {
 static void
 _rwb_destroy(rwb_head_t *h) {
    while (h->count > 0) {
+      rwb_t *b = h->head;
+      _gmnet()->stats.send_cache_bytes -= _rwb_buffered(b);
+      b->ptr = b->len;
       _rwb_destroy_head(h);
    }
 }
@@ -571,7 +696,11 @@ _tm_next(mnet_t *ss) {
       if (tm->time <= ss->tm_current) {
          chann_t *n = (chann_t *)tm->chann;
          mm_log(n, MNET_LOG_VERBOSE, "chann hit timer, %p (%p) -> %zd microsecond (%d)\n", n, tm, tm->interval, _tm_count(clock));
+         if (ss->hist_on) {
+            mnet_hist_record(&ss->hist.timer_late, _tm_current() - tm->time);
+         }
          _tm_update(clock, n, tm->interval);
+         ss->stats.timer_fires++;
          if (_chann_msg(n, CHANN_EVENT_TIMER, NULL, 0)) {
             return &n->msg;
          } else {
@@ -636,9 +765,168 @@ _listen(int fd, int backlog) {
 
 /* mnet extension internal
  */
-mnet_ext_t*
-_ext_config(chann_type_t ctype) {
-   return &_gmnet()->ext_config[ctype];
+static int
+_ext_table(mnet_t *ss, chann_type_t ctype) {
+   if ((int)ctype < ss->ext_size) {
+      return 1;
+   }
+   int size = (int)ctype + 1;
+   ext_layer_t **layers = (ext_layer_t **)mm_realloc(ss->ext_layers, size * sizeof(ext_layer_t *));
+   if (layers == NULL) {
+      return 0;
+   }
+   memset(&layers[ss->ext_size], 0, (size - ss->ext_size) * sizeof(ext_layer_t *));
+   ss->ext_layers = layers;
+   ss->ext_size = size;
+   return 1;
+}
+
+static inline ext_layer_t*
+_ext_layer(chann_type_t ctype) {
+   mnet_t *ss = _gmnet();
+   return (ctype>=CHANN_TYPE_STREAM && (int)ctype<ss->ext_size) ? ss->ext_layers[ctype] : NULL;
+}
+
+/* built-in chann_type_t without ext indirection, MNET_NO_EXT for only
+ * built-in chann_type_t
+ */
+static inline int
+_ext_builtin(chann_t *n) {
+#ifdef MNET_NO_EXT
+   return 1;
+#else
+   return n->ctype <= CHANN_TYPE_BROADCAST;
+#endif
+}
+
+/* layer at depth below top layer */
+static inline ext_layer_t*
+_ext_layer_at(ext_layer_t *l, int depth) {
+   while (l->depth > depth) {
+      l = l->lower;
+   }
+   return l;
+}
+
+static inline int
+_ext_raw_type(chann_t *n) {
+   return _ext_builtin(n) ? (int)n->ctype : _ext_layer(n->ctype)->raw;
+}
+
+/* op callbacks from lowest layer, stop when chann disconnected by lower
+ * layer, or from top layer when down
+ */
+static void
+_ext_op(chann_t *n, ext_layer_t *l, size_t op, int down) {
+   if (l->depth <= 0) {
+      return;
+   }
+   if (!down) {
+      int fd = n->fd;
+      _ext_op(n, l->lower, op, down);
+      if (fd > 0 && n->fd < 0) {
+         return;
+      }
+   }
+   uint8_t cur = n->ext_cur;
+   n->ext_cur = (uint8_t)l->depth;
+   (*(mnet_ext_chann_op_cb *)((char *)&l->ext + op))(l->ext.ext_ctx, n);
+   n->ext_cur = cur;
+   if (down) {
+      _ext_op(n, l->lower, op, down);
+   }
+}
+
+#define _EXT_OP(n, op, down) do {                                      \
+      if (!_ext_builtin(n)) {                                           \
+         _ext_op((n), _ext_layer((n)->ctype), offsetof(mnet_ext_t, op), (down)); \
+      }                                                                 \
+   } while (0)
+
+/* state wrapped from lowest layer */
+static int
+_ext_state_layer(chann_t *n, ext_layer_t *l, int state) {
+   if (l->depth <= 0) {
+      return state;
+   }
+   state = _ext_state_layer(n, l->lower, state);
+   uint8_t cur = n->ext_cur;
+   n->ext_cur = (uint8_t)l->depth;
+   state = l->ext.state_fn(l->ext.ext_ctx, n, state);
+   n->ext_cur = cur;
+   return state;
+}
+
+static inline int
+_ext_state(chann_t *n) {
+   return _ext_builtin(n) ? (int)n->state : _ext_state_layer(n, _ext_layer(n->ctype), n->state);
+}
+
+/* msg filtered from lowest layer, accepted chann in same layer */
+static int
+_ext_filter(ext_layer_t *l, chann_msg_t *msg) {
+   if (l->depth <= 0) {
+      return 1;
+   }
+   if (!_ext_filter(l->lower, msg)) {
+      return 0;
+   }
+   chann_t *n = msg->n, *r = msg->r;
+   uint8_t cur = n->ext_cur, rcur = r ? r->ext_cur : 0;
+   n->ext_cur = (uint8_t)l->depth;
+   if (r) {
+      r->ext_cur = (uint8_t)l->depth;
+   }
+   int ret = l->ext.filter_fn(l->ext.ext_ctx, msg);
+   n->ext_cur = cur;
+   if (r) {
+      r->ext_cur = rcur;
+   }
+   return ret;
+}
+
+static inline int
+_ext_recv(chann_t *n, ext_layer_t *l, void *buf, int len) {
+   uint8_t cur = n->ext_cur;
+   n->ext_cur = (uint8_t)l->depth;
+   int ret = l->ext.recv_fn(l->ext.ext_ctx, n, buf, len);
+   n->ext_cur = cur;
+   return ret;
+}
+
+static inline int
+_ext_send(chann_t *n, ext_layer_t *l, void *buf, int len) {
+   uint8_t cur = n->ext_cur;
+   n->ext_cur = (uint8_t)l->depth;
+   int ret = l->ext.send_fn(l->ext.ext_ctx, n, buf, len);
+   n->ext_cur = cur;
+   return ret;
+}
+
+/* flush from top layer down into lower layers, stop when blocked */
+static int
+_ext_flush(chann_t *n, ext_layer_t *l) {
+   for (; l->depth > 0; l = l->lower) {
+      if (l->ext.flush_fn) {
+         uint8_t cur = n->ext_cur;
+         n->ext_cur = (uint8_t)l->depth;
+         int ret = l->ext.flush_fn(l->ext.ext_ctx, n);
+         n->ext_cur = cur;
+         if (ret <= 0) {
+            return ret;
+         }
+      }
+   }
+   return 1;
+}
+
+/* ud slot for layer at depth */
+static inline void**
+_ext_ud_slot(chann_t *n, ext_layer_t *top, int depth) {
+   if (top->depth <= 1) {
+      return &n->ext_ud;
+   }
+   return &((void **)n->ext_ud)[(depth > 0 ? depth : 1) - 1];
 }
 
 static int
@@ -663,6 +951,7 @@ _ext_state_fn(void *ext_ctx, chann_t *n, int state) {
 static int
 _ext_stream_recv(void *ext_ctx, chann_t *n, void *buf, int len) {
    int ret = (int)recv(n->fd, buf, len, 0);
+   _gmnet()->stats.syscalls++;
    if (ret<0 && errno==EWOULDBLOCK) {
       ret = 0;
    }
@@ -672,6 +961,7 @@ _ext_stream_recv(void *ext_ctx, chann_t *n, void *buf, int len) {
 static int
 _ext_dgram_recv(void *ext_ctx, chann_t *n, void *buf, int len) {
    int ret = (int)recvfrom(n->fd, buf, len, 0, (struct sockaddr *)&n->addr, &n->addr_len);
+   _gmnet()->stats.syscalls++;
    if (ret<0 && errno==EWOULDBLOCK) {
       ret = 0;
    }
@@ -681,6 +971,7 @@ _ext_dgram_recv(void *ext_ctx, chann_t *n, void *buf, int len) {
 static int
 _ext_stream_send(void *ext_ctx, chann_t *n, void *buf, int len) {
    int ret = (int)send(n->fd, buf, len, 0);
+   _gmnet()->stats.syscalls++;
    if (ret<0 && errno==EWOULDBLOCK) {
       ret = 0;
    }
@@ -689,13 +980,34 @@ _ext_stream_send(void *ext_ctx, chann_t *n, void *buf, int len) {
 
 static int
 _ext_dgram_send(void *ext_ctx, chann_t *n, void *buf, int len) {
-   int ret = (int)sendto(n->fd, buf, len, 0, (struct sockaddr *)&n->addr, n->addr_len);
+   int ret = n->dgram_connected ? (int)send(n->fd, buf, len, 0) :
+      (int)sendto(n->fd, buf, len, 0, (struct sockaddr *)&n->addr, n->addr_len);
+   _gmnet()->stats.syscalls++;
    if (ret<0 && errno==EWOULDBLOCK) {
       ret = 0;
    }
    return ret;
 }
 
+/* recv/send for top layer, or built-in directly */
+static inline int
+_ext_top_recv(chann_t *n, void *buf, int len) {
+   if (!_ext_builtin(n)) {
+      return _ext_recv(n, _ext_layer(n->ctype), buf, len);
+   }
+   return n->ctype == CHANN_TYPE_STREAM ? _ext_stream_recv(NULL, n, buf, len) :
+      _ext_dgram_recv(NULL, n, buf, len);
+}
+
+static inline int
+_ext_top_send(chann_t *n, void *buf, int len) {
+   if (!_ext_builtin(n)) {
+      return _ext_send(n, _ext_layer(n->ctype), buf, len);
+   }
+   return n->ctype == CHANN_TYPE_STREAM ? _ext_stream_send(NULL, n, buf, len) :
+      _ext_dgram_send(NULL, n, buf, len);
+}
+
 mnet_ext_t _ext_internal_config = {
    .reserved = 0,
    .ext_ctx = NULL,
@@ -710,16 +1022,174 @@ mnet_ext_t _ext_internal_config = {
    .state_fn = _ext_state_fn,
    .recv_fn = NULL,
    .send_fn = NULL,
+   .flush_fn = NULL,
 };
 
+/* timeout wheel op, coarse deadlines in ticks, chann checked in slot of
+ * next deadline, and re-bucketed lazily with recent activity
+ */
+
+static inline uint32_t
+_wh_current_tick() {
+   return (uint32_t)(_tm_current() / (MNET_WHEEL_TICK_MS * 1000));
+}
+
+static inline uint32_t
+_wh_ticks(int ms) {
+   return ms > 0 ? (uint32_t)((ms + MNET_WHEEL_TICK_MS - 1) / MNET_WHEEL_TICK_MS) : 0;
+}
+
+/* tick a reached tick b */
+static inline int
+_wh_reached(uint32_t a, uint32_t b) {
+   return (int32_t)(a - b) >= 0;
+}
+
+static void
+_wh_del(mnet_t *ss, chann_t *n) {
+   if (n->wh_queued) {
+      if (n->wh_next) { n->wh_next->wh_prev = n->wh_prev; }
+      if (n->wh_prev) { n->wh_prev->wh_next = n->wh_next; }
+      else { ss->wh_slots[n->wh_slot] = n->wh_next; }
+      n->wh_prev = n->wh_next = NULL;
+      n->wh_queued = 0;
+      ss->wh_count--;
+   }
+}
+
+static void
+_wh_add(mnet_t *ss, chann_t *n, uint32_t tick) {
+   _wh_del(ss, n);
+   n->wh_slot = tick & (MNET_WHEEL_SLOTS - 1);
+   n->wh_next = ss->wh_slots[n->wh_slot];
+   if (n->wh_next) {
+      n->wh_next->wh_prev = n;
+   }
+   ss->wh_slots[n->wh_slot] = n;
+   n->wh_queued = 1;
+   ss->wh_count++;
+}
+
+/* return err for expired, or 0 with next deadline, has_next 0 for leaving wheel */
+static int
+_wh_expired(mnet_t *ss, chann_t *n, uint32_t *next, int *has_next) {
+   uint32_t now = ss->wh_tick;
+   *has_next = 0;
+   if (n->state != CHANN_STATE_CONNECTING && n->state != CHANN_STATE_CONNECTED) {
+      return 0;
+   }
+   int connected = _ext_state(n) >= CHANN_STATE_CONNECTED;
+
+#define _WH_DEADLINE(t) do {                                            \
+      uint32_t _t = (t);                                               \
+      if (!*has_next || !_wh_reached(_t, *next)) { *next = _t; }       \
+      *has_next = 1;                                                   \
+   } while (0)
+
+   /* deadline + 1 for at least timeout ticks */
+   if (!connected && n->to_connect) {
+      uint32_t t = n->to_begin + n->to_connect + 1;
+      if (_wh_reached(now, t)) {
+         return MNET_ERR_CONNECT_TIMEOUT;
+      }
+      _WH_DEADLINE(t);
+   }
+   if (n->to_idle) {
+      uint32_t t = n->to_active + n->to_idle + 1;
+      if (_wh_reached(now, t)) {
+         return MNET_ERR_IDLE_TIMEOUT;
+      }
+      _WH_DEADLINE(t);
+   }
+   if (connected && n->to_window) {
+      uint32_t t = n->to_window_begin + n->to_window;
+      if (_wh_reached(now, t)) {
+         uint32_t bytes = (uint32_t)n->bytes_recv - n->to_window_bytes;
+         if (bytes > 0 && bytes < n->to_rate_bytes) {
+            return MNET_ERR_RECV_RATE;
+         }
+         n->to_window_begin = now;
+         n->to_window_bytes = (uint32_t)n->bytes_recv;
+         t = now + n->to_window;
+      }
+      _WH_DEADLINE(t);
+   }
+
+#undef _WH_DEADLINE
+   return 0;
+}
+
+/* schedule chann after connect/accept or timeout changed */
+static void
+_wh_schedule(mnet_t *ss, chann_t *n) {
+   uint32_t next = 0;
+   int has_next = 0;
+   if ((n->to_connect || n->to_idle || n->to_window) &&
+       _wh_expired(ss, n, &next, &has_next) == 0 &&
+       has_next)
+   {
+      _wh_add(ss, n, next);
+   } else {
+      _wh_del(ss, n);
+   }
+}
+
+/* chann begin connect/accept with timeout */
+static void
+_wh_begin(mnet_t *ss, chann_t *n) {
+   n->to_begin = n->to_active = n->to_window_begin = ss->wh_tick;
+   n->to_window_bytes = (uint32_t)n->bytes_recv;
+   _wh_schedule(ss, n);
+}
+
+/* check slots from last tick to current, emit DISCONNECT for expired */
+static void
+_wh_advance(mnet_t *ss) {
+   uint32_t now = _wh_current_tick();
+   uint32_t tick = ss->wh_tick + 1;
+   ss->wh_tick = now;
+   if (ss->wh_count <= 0 || !_wh_reached(now, tick)) {
+      return;
+   }
+   if (now - tick >= MNET_WHEEL_SLOTS) {
+      tick = now - MNET_WHEEL_SLOTS + 1;
+   }
+   for (; _wh_reached(now, tick); tick++) {
+      uint32_t slot = tick & (MNET_WHEEL_SLOTS - 1);
+      chann_t *n = ss->wh_slots[slot];
+      ss->wh_slots[slot] = NULL;
+      while (n) {
+         chann_t *next_n = n->wh_next;
+         n->wh_prev = n->wh_next = NULL;
+         n->wh_queued = 0;
+         ss->wh_count--;
+         uint32_t next = 0;
+         int has_next = 0;
+         int err = _wh_expired(ss, n, &next, &has_next);
+         if (err) {
+            mm_log(n, MNET_LOG_VERBOSE, "chann %p fd:%d timeout %d\n", n, n->fd, err);
+            _chann_disconnect_event(ss, n, err);
+         } else if (has_next) {
+            _wh_add(ss, n, next);
+         }
+         n = next_n;
+      }
+   }
+}
+
 /* channel op
  */
 
 static chann_t*
 _chann_create(mnet_t *ss, chann_type_t ctype, chann_state_t state) {
    chann_t *n = (chann_t*)mm_malloc(sizeof(*n));
+   n->id = ++ss->chann_seq;
    n->ctype = ctype;
    n->state = state;
+   n->ext_cur = _ext_builtin(n) ? 0 : (uint8_t)_ext_layer(ctype)->depth;
+   if (n->ext_cur > 1) {
+      n->ext_ud = mm_malloc(n->ext_cur * sizeof(void *));
+   }
    n->next = ss->channs;
    if (ss->channs) {
       ss->channs->prev = n;
@@ -730,14 +1200,46 @@ _chann_create(mnet_t *ss, chann_type_t ctype, chann_state_t state) {
    return n;
 }
 
+/* remove from pending list, rare in destroy */
+static void
+_pend_unlink(chann_t **list, chann_t *n) {
+   for (; *list; list = &(*list)->pend_next) {
+      if (*list == n) {
+         *list = n->pend_next;
+         return;
+      }
+   }
+}
+
+/* remove from flush list, rare in destroy */
+static void
+_flush_unlink(chann_t **list, chann_t *n) {
+   for (; *list; list = &(*list)->flush_next) {
+      if (*list == n) {
+         *list = n->flush_next;
+         return;
+      }
+   }
+}
+
 static void
 _chann_destroy(mnet_t *ss, chann_t *n) {
    if (n->state == CHANN_STATE_CLOSED) {
+      if (n->pend_queued) {
+         _pend_unlink(&ss->pend_channs, n);
+         _pend_unlink(&ss->pend_round, n);
+      }
+      if (n->flush_queued) {
+         _flush_unlink(&ss->flush_channs, n);
+      }
       if (n->next) { n->next->prev = n->prev; }
       if (n->prev) { n->prev->next = n->next; }
       else { ss->channs = n->next; }
       _rwb_destroy(&n->rwb_send);
       _tm_kill(ss->tm_clock, n);
+      if (!_ext_builtin(n) && _ext_layer(n->ctype)->depth > 1) {
+         mm_free(n->ext_ud);
+      }
       ss->chann_count--;
       mm_log(n, MNET_LOG_VERBOSE, "chann destroy %p (%d)\n", n, ss->chann_count);
       mm_free(n);
@@ -770,27 +1272,54 @@ _chann_accept(mnet_t *ss, chann_t *n) {
    struct sockaddr_in addr;
    socklen_t addr_len = sizeof(addr);
    int fd = ss->ac_fn(n->fd, (struct sockaddr*)&addr, &addr_len);
+   ss->stats.syscalls++;
    if (fd > 0 && _set_nonblocking(fd) >= 0) {
       chann_t *c = _chann_create(ss, n->ctype, CHANN_STATE_CONNECTED);
       c->fd = fd;
       c->addr = addr;
       c->addr_len = addr_len;
+      c->to_connect = n->to_connect;
+      c->to_idle = n->to_idle;
+      c->to_window = n->to_window;
+      c->to_rate_bytes = n->to_rate_bytes;
       mm_log(n, MNET_LOG_VERBOSE, "chann accept %p fd %d, from %s, count %d\n",
             c, c->fd, _chann_addr(&c->addr), ss->chann_count);
-      mnet_ext_t *ext = _ext_config(n->ctype);
-      ext->accept_cb(ext->ext_ctx, c);
+      _EXT_OP(c, accept_cb, 0);
+      _wh_begin(ss, c);
+      ss->stats.accepts++;
+      _trace(ss, c, MNET_TRACE_ACCEPT, 0, 0, 0);
       return c;
    }
    return NULL;
 }
 
-static int
-_chann_send(chann_t *n, void *buf, int len) {
-   mnet_ext_t *ext = _ext_config(n->ctype);
-   int ret = ext->send_fn(ext->ext_ctx, n, buf, len);
+/* accounting for each recv/send path, bytes for idle timeout, counters and
+ * trace, ret < 0 with errno
+ */
+static inline void
+_chann_recv_account(mnet_t *ss, chann_t *n, int ret) {
+   _trace(ss, n, MNET_TRACE_RECV, 0, ret, ret < 0 ? errno : 0);
+   if (ret > 0) {
+      n->bytes_recv += ret;
+      n->to_active = ss->wh_tick;
+      ss->stats.bytes_recv += ret;
+   }
+}
+
+static inline void
+_chann_send_account(mnet_t *ss, chann_t *n, int ret) {
+   _trace(ss, n, MNET_TRACE_SEND, 0, ret, ret < 0 ? errno : 0);
    if (ret > 0) {
       n->bytes_send += ret;
+      n->to_active = ss->wh_tick;
+      ss->stats.bytes_send += ret;
    }
+}
+
+static int
+_chann_send(chann_t *n, void *buf, int len) {
+   int ret = _ext_top_send(n, buf, len);
+   _chann_send_account(_gmnet(), n, ret);
    return ret;
 }
 
@@ -801,13 +1330,18 @@ _chann_disconnect_socket(mnet_t *ss, chann_t *n) {
 #if MNET_OS_WIN
       _evt_del(n, MNET_SET_DEL);
 #endif
-      mnet_ext_t *ext = _ext_config(n->ctype);
-      ext->disconnect_cb(ext->ext_ctx, n);
+      _EXT_OP(n, disconnect_cb, 1);
+      _wh_del(ss, n);
+      _trace(ss, n, MNET_TRACE_CLOSE, 0, 0, 0);
       close(n->fd);
+      ss->stats.syscalls++;
       _rwb_destroy(&n->rwb_send);
       n->fd = -1;
       n->state = CHANN_STATE_DISCONNECT;
       n->epoll_events = 0;
+      n->dgram_connected = 0;
+      n->dgram_gro = 0;
+      n->pend_data = 0;
       return 1;
    }
    return 0;
@@ -816,8 +1350,7 @@ _chann_disconnect_socket(mnet_t *ss, chann_t *n) {
 static void
 _chann_close_socket(mnet_t *ss, chann_t *n) {
    if (n->state > CHANN_STATE_CLOSED) {
-      mnet_ext_t *ext = _ext_config(n->ctype);
-      ext->close_cb(ext->ext_ctx, n);
+      _EXT_OP(n, close_cb, 1);
       n->del_next = ss->del_channs;
       ss->del_channs = n;
       n->state = CHANN_STATE_CLOSED;
@@ -826,15 +1359,47 @@ _chann_close_socket(mnet_t *ss, chann_t *n) {
    }
 }
 
+/* count disconnect by err, first slots for distinct err, last for others */
+static void
+_stats_disconnect(mnet_stats_t *st, int err) {
+   int i = 0;
+   for (; i<MNET_STATS_ERR_SLOTS-1; i++) {
+      if (st->disconnect_errs[i].count <= 0) {
+         st->disconnect_errs[i].err = err;
+         break;
+      }
+      if (st->disconnect_errs[i].err == err) {
+         break;
+      }
+   }
+   st->disconnect_errs[i].count++;
+   st->disconnects++;
+}
+
 int
 _chann_msg(chann_t *n, chann_event_t event, chann_t *r, int err) {
+   mnet_stats_t *st = &_gmnet()->stats;
+   st->events[event]++;
+   if (event == CHANN_EVENT_DISCONNECT) {
+      _stats_disconnect(st, err);
+   }
+   _trace(_gmnet(), n, MNET_TRACE_EVENT, event, 0, err);
    n->msg.event = event;
    n->msg.err = err;
    n->msg.n = n;
    n->msg.r = r;
    n->msg.opaque = n->opaque;
-   mnet_ext_t *ext = _ext_config(n->ctype);
-   return ext->filter_fn(ext->ext_ctx, &n->msg);
+   return _ext_builtin(n) || _ext_filter(_ext_layer(n->ctype), &n->msg);
+}
+
+/* disconnect chann and queue DISCONNECT event for next result */
+static void
+_chann_disconnect_event(mnet_t *ss, chann_t *n, int err) {
+   _chann_disconnect_socket(ss, n);
+   if (_chann_msg(n, CHANN_EVENT_DISCONNECT, NULL, err)) {
+      n->dis_next = ss->dis_channs;
+      ss->dis_channs = n;
+   }
 }
 
 static int
@@ -847,6 +1412,21 @@ _chann_get_err(chann_t *n) {
    return -9999;
 }
 
+/* return 1 when ext buffered send data flushed */
+static int
+_chann_flushed_ext(chann_t *n) {
+   if (_ext_builtin(n) || !_ext_layer(n->ctype)->flush) {
+      return 1;
+   }
+   int ret = _ext_flush(n, _ext_layer(n->ctype));
+   if (ret < 0) {
+      mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, ext flush errno %d:%s\n",
+               n, n->fd, errno, strerror(errno));
+      _chann_disconnect_event(_gmnet(), n, errno);
+   }
+   return ret > 0;
+}
+
 /* return 1 when sended all cached data */
 static int
 _chann_sended_rwb(chann_t *n) {
@@ -863,12 +1443,7 @@ _chann_sended_rwb(chann_t *n) {
       } else if (ret < 0) {
          mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, rwb send errno %d:%s\n",
                   n, n->fd, errno, strerror(errno));
-         _chann_disconnect_socket(_gmnet(), n);
-         if (_chann_msg(n, CHANN_EVENT_DISCONNECT, NULL, errno)) {
-            mnet_t *ss = _gmnet();
-            n->dis_next = ss->dis_channs;
-            ss->dis_channs = n;
-         }
+         _chann_disconnect_event(_gmnet(), n, errno);
       }
    } while (ret>0 && ret>=len && _rwb_count(prh)>0);
    return _rwb_count(prh) <= 0;
@@ -886,10 +1461,10 @@ _chann_fill_addr(chann_t *n, const char *host, int port) {
 static int
 _chann_open_socket(chann_t *n, const char *host, int port, int backlog) {
    if (n->state == CHANN_STATE_DISCONNECT) {
-      mnet_ext_t *ext = _ext_config(n->ctype);
-      int istcp = ext->type_fn(ext->ext_ctx, n->ctype) == CHANN_TYPE_STREAM;
-      int isbc = ext->type_fn(ext->ext_ctx, n->ctype) == CHANN_TYPE_BROADCAST;
+      int istcp = _ext_raw_type(n) == CHANN_TYPE_STREAM;
+      int isbc = _ext_raw_type(n) == CHANN_TYPE_BROADCAST;
       int fd = socket(AF_INET, istcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+      _gmnet()->stats.syscalls++;
       if (fd > 0) {
          int buf_size = n->buf_size>0 ? n->buf_size : MNET_BUF_SIZE;
 
@@ -1068,6 +1643,8 @@ _evt_add(chann_t *n, int set) {
       }
       kev->flags = EV_ADD | EV_EOF;
       kev->udata = (void*)n;
+      ss->stats.evt_ctl++;
+      ss->stats.syscalls++;
       if (kevent(ss->kq, chg->array, 1, NULL, 0, NULL) < 0) {
          mm_log(n, MNET_LOG_ERR, "kq fail to add fd:%d filter:%x set:%d, errno %d:%s\n",
                 n->fd, kev->filter, set, errno, strerror(errno));
@@ -1082,6 +1659,8 @@ _evt_add(chann_t *n, int set) {
          events = n->epoll_events | EPOLLOUT | EPOLLRDHUP | EPOLLHUP;
       }
       kev->events = events;
+      ss->stats.evt_ctl++;
+      ss->stats.syscalls++;
       if (epoll_ctl(ss->kq, (n->epoll_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD), n->fd, kev) < 0) {
          mm_log(n, MNET_LOG_ERR, "epoll fail to add fd:%d filter:%x set:%d, errno %d:%s\n",
                 n->fd, n->epoll_events, set, errno, strerror(errno));
@@ -1111,6 +1690,8 @@ _evt_del(chann_t *n, int set) {
       }
       kev->flags = EV_DELETE;
       kev->udata = (void*)n;
+      ss->stats.evt_ctl++;
+      ss->stats.syscalls++;
       if (kevent(ss->kq, chg->array, 1, NULL, 0, NULL) < 0) {
          mm_log(n, MNET_LOG_ERR, "kq fail to delete fd:%d filter %x, errno %d:%s\n",
                 n->fd, kev->filter, errno, strerror(errno));
@@ -1124,7 +1705,13 @@ _evt_del(chann_t *n, int set) {
       } else if (set == MNET_SET_WRITE) {
          events = n->epoll_events & ~EPOLLOUT;
       }
+      if (!(events & (EPOLLIN | EPOLLOUT))) {
+         // HUP only with read/write wanted, as kqueue filters
+         events = 0;
+      }
       kev->events = events;
+      ss->stats.evt_ctl++;
+      ss->stats.syscalls++;
       if (epoll_ctl(ss->kq, events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, n->fd, kev) < 0) {
          mm_log(n, MNET_LOG_ERR, "epoll fail to add fd:%d filter %x, errno %d, %s\n",
                 n->fd, n->epoll_events, errno, strerror(errno));
@@ -1149,18 +1736,117 @@ _evt_del_channs(mnet_t *ss) {
    ss->del_channs = NULL;
 }
 
+/* seqlock writer, readers retry when seq odd or changed */
+static void
+_stats_publish(mnet_t *ss) {
+   ss->stats.timestamp = _tm_current();
+   ss->stats.channs = ss->chann_count;
+   ss->stats_seq++;
+   _mm_barrier();
+   ss->stats_pub = ss->stats;
+   _mm_barrier();
+   ss->stats_seq++;
+}
+
+/* report user handling for last msg over threshold */
+static inline void
+_slow_check(mnet_t *ss, int64_t now) {
+   if (ss->slow_n) {
+      if (ss->slow_cb && now - ss->slow_begin >= ss->slow_us) {
+         ss->slow_cb(ss->slow_n, ss->slow_event, now - ss->slow_begin);
+      }
+      ss->slow_n = NULL;
+   }
+}
+
+#if !MNET_OS_WIN
+/* take channs woken from other threads, as ext pending data */
+static void
+_wk_drain(mnet_t *ss) {
+   chann_t *n = __sync_lock_test_and_set(&ss->wk_head, NULL);
+   while (n) {
+      chann_t *next = n->wk_next;
+      n->wk_queued = 0;
+      if (n->state == CHANN_STATE_CONNECTED) {
+         mnet_ext_chann_pending(n, 1);
+      }
+      n = next;
+   }
+}
+#endif
+
+/* ext buffered send data in this pass, wait writable when blocked */
+static void
+_flush_channs(mnet_t *ss) {
+   chann_t *n = ss->flush_channs;
+   ss->flush_channs = NULL;
+   while (n) {
+      chann_t *next = n->flush_next;
+      n->flush_queued = 0;
+      if (n->state == CHANN_STATE_CONNECTED && n->fd >= 0) {
+         // blocked, or disconnected with error
+         if (!_chann_flushed_ext(n) && n->fd >= 0) {
+            _evt_add(n, MNET_SET_WRITE);
+         }
+      }
+      n = next;
+   }
+}
+
 static inline int
 _evt_poll(uint32_t milliseconds) {
    mnet_t *ss = _gmnet();
    struct s_event *evt = &ss->evt;
 
+   /* dispatch pass, chann closed by user still valid before destroy */
+   if (ss->hist_on || ss->slow_cb) {
+      int64_t now = _tm_current();
+      _slow_check(ss, now);
+      if (ss->hist_on && ss->hist_poll_end > 0) {
+         mnet_hist_record(&ss->hist.dispatch, now - ss->hist_poll_end);
+      }
+   }
+
+#if !MNET_OS_WIN
+   /* woken before closed, drain before destroy */
+   if (ss->wk_head) {
+      _wk_drain(ss);
+   }
+#endif
+
+   /* coalesced send data out before wait, chann closed skipped */
+   if (ss->flush_channs) {
+      _flush_channs(ss);
+   }
+
    /* destroy channs */
    _evt_del_channs(ss);
 
+   /* stats for last dispatch */
+   _stats_publish(ss);
+
    /* timer schedule */
    _tm_schedule(ss);
 
+   /* wake up for next tick when timeout wheel in use */
+   if (ss->wh_count > 0 && milliseconds > MNET_WHEEL_TICK_MS) {
+      milliseconds = MNET_WHEEL_TICK_MS;
+   }
+
+   /* ext pending data emit after fd events, no wait */
+   if (ss->pend_channs) {
+      chann_t *tail = ss->pend_channs;
+      while (tail->pend_next) {
+         tail = tail->pend_next;
+      }
+      tail->pend_next = ss->pend_round;
+      ss->pend_round = ss->pend_channs;
+      ss->pend_channs = NULL;
+      milliseconds = 0;
+   }
+
    /* kqueue/epoll read/write/error event */
+   int64_t wait_begin = ss->hist_on ? _tm_current() : 0;
 #if (MNET_OS_MACOX || MNET_OS_FreeBSD)
    struct timespec tsp;
    tsp.tv_sec = milliseconds / MNET_MILLI_SECOND;
@@ -1170,6 +1856,19 @@ _evt_poll(uint32_t milliseconds) {
    ss->fd_count = epoll_wait(ss->kq, evt->array, evt->size, milliseconds);
 #endif
    ss->fd_index = -1;
+   ss->stats.polls++;
+   ss->stats.syscalls++;
+   if (ss->fd_count > 0) {
+      ss->stats.poll_events += ss->fd_count;
+   }
+   if (ss->hist_on) {
+      ss->hist_poll_end = _tm_current();
+      mnet_hist_record(&ss->hist.poll_block, ss->hist_poll_end - wait_begin);
+      mnet_hist_record(&ss->hist.poll_events, ss->fd_count > 0 ? ss->fd_count : 0);
+   }
+
+   /* connect/idle timeout */
+   _wh_advance(ss);
 
    if (ss->fd_count<0 && errno!=EINTR) {
       mm_log(NULL, MNET_LOG_ERR, "kevent return %d, errno %d:%s\n", ss->fd_count, errno, strerror(errno));
@@ -1198,14 +1897,36 @@ _evt_result_next() {
          return &n->msg;
       }
 
-      ss->fd_index += 1;
-      if (ss->fd_index >= ss->fd_count) {
-         return NULL;
+      if (ss->fd_index + 1 >= ss->fd_count) {
+         /* ext pending data without fd readable */
+         n = ss->pend_round;
+         if (n == NULL) {
+            return NULL;
+         }
+         ss->pend_round = n->pend_next;
+         n->pend_queued = 0;
+         if (n->pend_data && n->state == CHANN_STATE_CONNECTED && n->fd >= 0 &&
+             _chann_msg(n, CHANN_EVENT_RECV, NULL, 0))
+         {
+            return &n->msg;
+         }
+         continue;
       }
 
+      ss->fd_index += 1;
       mevent_t *kev = &evt->array[ss->fd_index];
       n = (chann_t*)_kev_opaque(kev);
 
+#if !MNET_OS_WIN
+      if (n == &ss->wk) {
+         uint8_t buf[64];
+         while (read(n->fd, buf, sizeof(buf)) > 0) {
+         }
+         _wk_drain(ss);
+         continue;
+      }
+#endif
+
       if (n->state == CHANN_STATE_CLOSED || n->fd<0) {
          continue;
       }
@@ -1214,7 +1935,6 @@ _evt_result_next() {
                n->fd, _kev_get_flags(kev), _kev_get_events(kev), n->state,
                _KEV_FLAG_ERROR, _KEV_FLAG_HUP, _KEV_EVENT_READ, _KEV_EVENT_WRITE);
 
-      mnet_ext_t *ext = _ext_config(n->ctype);
       /* check error first */
       if ( _kev_flags(kev, (_KEV_FLAG_ERROR | _KEV_FLAG_HUP)) ) {
          if (_kev_flags(kev, _KEV_FLAG_ERROR)) {
@@ -1237,7 +1957,7 @@ _evt_result_next() {
 
       switch ( n->state ) {
          case CHANN_STATE_LISTENING: {
-            if (ext->type_fn(ext->ext_ctx, n->ctype) == CHANN_TYPE_STREAM) {
+            if (_ext_raw_type(n) == CHANN_TYPE_STREAM) {
                chann_t *c = _chann_accept(ss, n);
                if (c) {
                   _evt_add(c, MNET_SET_READ);
@@ -1279,7 +1999,8 @@ _evt_result_next() {
                   return &n->msg;
                }
             } else if ( _kev_events(kev, _KEV_EVENT_WRITE) ) {
-               if (_chann_sended_rwb(n)) {
+               // ext buffered data before cached, in send order
+               if (_chann_flushed_ext(n) && _chann_sended_rwb(n)) {
                   if (n->active_send_event) {
                      if (_chann_msg(n, CHANN_EVENT_SEND, NULL, 0)) {
                         return &n->msg;
@@ -1318,10 +2039,15 @@ mnet_init() {
       _evt_init();
       srand(_tm_current());
       ss->tm_clock = skiplist_create();
+      ss->wh_tick = _wh_current_tick();
       ss->ac_fn = accept;
       ss->init = 1;
+      if (!_ext_table(ss, CHANN_TYPE_BROADCAST)) {
+         return 0;
+      }
       for (int i=CHANN_TYPE_STREAM; i<=CHANN_TYPE_BROADCAST; i++) {
-         mnet_ext_t *ext = &ss->ext_config[i];
+         ext_layer_t *l = &ss->ext_raw[i];
+         mnet_ext_t *ext = &l->ext;
          *ext = _ext_internal_config;
          ext->reserved = 1;
          if (i == CHANN_TYPE_STREAM) {
@@ -1331,6 +2057,9 @@ mnet_init() {
             ext->recv_fn = _ext_dgram_recv;
             ext->send_fn = _ext_dgram_send;
          }
+         l->ctype = (chann_type_t)i;
+         l->raw = i;
+         ss->ext_layers[i] = l;
       }
       return 1;
    }
@@ -1349,10 +2078,25 @@ mnet_fini() {
          _chann_destroy(ss, n);
          n = next;
       }
+#if !MNET_OS_WIN
+      if (ss->wk_fd > 0) {
+         close(ss->wk.fd);
+         close(ss->wk_fd);
+      }
+#endif
       _kev_get_flags(NULL); // for compile warning
       _kev_get_events(NULL);
       _evt_fini();
       skiplist_destroy(ss->tm_clock);
+      if (ss->tr_ring) {
+         mm_free(ss->tr_ring);
+      }
+      for (int i=CHANN_TYPE_BROADCAST+1; i<ss->ext_size; i++) {
+         if (ss->ext_layers[i]) {
+            mm_free(ss->ext_layers[i]);
+         }
+      }
+      mm_free(ss->ext_layers);
       ss->init = 0;
       memset(ss, 0, sizeof(*ss));
 #if MNET_OS_WIN
@@ -1406,6 +2150,342 @@ mnet_report(int level) {
    return -1;
 }
 
+int
+mnet_stats_snapshot(mnet_stats_t *stats) {
+   mnet_t *ss = _gmnet();
+   if (ss->init && stats) {
+      uint32_t seq = 0;
+      do {
+         while ((seq = ss->stats_seq) & 1) {
+            _mm_barrier();
+         }
+         _mm_barrier();
+         *stats = ss->stats_pub;
+         _mm_barrier();
+      } while (seq != ss->stats_seq);
+      return 1;
+   }
+   return 0;
+}
+
+static void
+_stats_append(char *buf, int len, int *pos, const char *fmt, ...) {
+   if (*pos >= 0) {
+      va_list argptr;
+      va_start(argptr, fmt);
+      int ret = vsnprintf(buf + *pos, len - *pos, fmt, argptr);
+      va_end(argptr);
+      *pos = (ret < 0 || ret >= len - *pos) ? -1 : (*pos + ret);
+   }
+}
+
+int
+mnet_stats_export(const mnet_stats_t *st, mnet_stats_format_t fmt, char *buf, int len) {
+   static const char *evt_names[CHANN_EVENT_TIMER + 1] = {
+      "", "recv", "send", "accept", "connected", "disconnect", "timer"
+   };
+   if (!st || !buf || len <= 0) {
+      return -1;
+   }
+   int pos = 0;
+   if (fmt == MNET_STATS_JSON) {
+      _stats_append(buf, len, &pos, "{\"timestamp\":%lld,\"polls\":%llu,\"poll_events\":%llu,\"events\":{",
+                    (long long)st->timestamp, (unsigned long long)st->polls, (unsigned long long)st->poll_events);
+      for (int i=CHANN_EVENT_RECV; i<=CHANN_EVENT_TIMER; i++) {
+         _stats_append(buf, len, &pos, "%s\"%s\":%llu", i>CHANN_EVENT_RECV ? "," : "",
+                       evt_names[i], (unsigned long long)st->events[i]);
+      }
+      _stats_append(buf, len, &pos, "},\"accepts\":%llu,\"connects\":%llu,\"disconnects\":%llu,\"disconnect_errs\":{",
+                    (unsigned long long)st->accepts, (unsigned long long)st->connects, (unsigned long long)st->disconnects);
+      for (int i=0; i<MNET_STATS_ERR_SLOTS && st->disconnect_errs[i].count>0; i++) {
+         if (i < MNET_STATS_ERR_SLOTS - 1) {
+            _stats_append(buf, len, &pos, "%s\"%d\":%llu", i>0 ? "," : "",
+                          st->disconnect_errs[i].err, (unsigned long long)st->disconnect_errs[i].count);
+         } else {
+            _stats_append(buf, len, &pos, ",\"other\":%llu", (unsigned long long)st->disconnect_errs[i].count);
+         }
+      }
+      _stats_append(buf, len, &pos, "},\"bytes_recv\":%llu,\"bytes_send\":%llu,\"timer_fires\":%llu,"
+                    "\"evt_ctl\":%llu,\"syscalls\":%llu,\"send_cache_bytes\":%lld,\"send_cache_chunks\":%lld,\"channs\":%lld}",
+                    (unsigned long long)st->bytes_recv, (unsigned long long)st->bytes_send,
+                    (unsigned long long)st->timer_fires, (unsigned long long)st->evt_ctl,
+                    (unsigned long long)st->syscalls, (long long)st->send_cache_bytes,
+                    (long long)st->send_cache_chunks, (long long)st->channs);
+   } else if (fmt == MNET_STATS_PROMETHEUS) {
+      _stats_append(buf, len, &pos, "# TYPE mnet_polls_total counter\nmnet_polls_total %llu\n"
+                    "# TYPE mnet_poll_events_total counter\nmnet_poll_events_total %llu\n"
+                    "# TYPE mnet_events_total counter\n",
+                    (unsigned long long)st->polls, (unsigned long long)st->poll_events);
+      for (int i=CHANN_EVENT_RECV; i<=CHANN_EVENT_TIMER; i++) {
+         _stats_append(buf, len, &pos, "mnet_events_total{event=\"%s\"} %llu\n",
+                       evt_names[i], (unsigned long long)st->events[i]);
+      }
+      _stats_append(buf, len, &pos, "# TYPE mnet_accepts_total counter\nmnet_accepts_total %llu\n"
+                    "# TYPE mnet_connects_total counter\nmnet_connects_total %llu\n"
+                    "# TYPE mnet_disconnects_total counter\n",
+                    (unsigned long long)st->accepts, (unsigned long long)st->connects);
+      for (int i=0; i<MNET_STATS_ERR_SLOTS && st->disconnect_errs[i].count>0; i++) {
+         if (i < MNET_STATS_ERR_SLOTS - 1) {
+            _stats_append(buf, len, &pos, "mnet_disconnects_total{err=\"%d\"} %llu\n",
+                          st->disconnect_errs[i].err, (unsigned long long)st->disconnect_errs[i].count);
+         } else {
+            _stats_append(buf, len, &pos, "mnet_disconnects_total{err=\"other\"} %llu\n",
+                          (unsigned long long)st->disconnect_errs[i].count);
+         }
+      }
+      _stats_append(buf, len, &pos, "# TYPE mnet_bytes_total counter\n"
+                    "mnet_bytes_total{dir=\"recv\"} %llu\nmnet_bytes_total{dir=\"send\"} %llu\n"
+                    "# TYPE mnet_timer_fires_total counter\nmnet_timer_fires_total %llu\n"
+                    "# TYPE mnet_evt_ctl_total counter\nmnet_evt_ctl_total %llu\n"
+                    "# TYPE mnet_syscalls_total counter\nmnet_syscalls_total %llu\n"
+                    "# TYPE mnet_send_cache_bytes gauge\nmnet_send_cache_bytes %lld\n"
+                    "# TYPE mnet_send_cache_chunks gauge\nmnet_send_cache_chunks %lld\n"
+                    "# TYPE mnet_channs gauge\nmnet_channs %lld\n",
+                    (unsigned long long)st->bytes_recv, (unsigned long long)st->bytes_send,
+                    (unsigned long long)st->timer_fires, (unsigned long long)st->evt_ctl,
+                    (unsigned long long)st->syscalls, (long long)st->send_cache_bytes,
+                    (long long)st->send_cache_chunks, (long long)st->channs);
+   } else {
+      return -1;
+   }
+   return pos;
+}
+
+/* memory op
+ */
+
+static int64_t
+_chann_mem(chann_t *n, int64_t *timer_bytes, int64_t *cache_bytes) {
+   int64_t tbytes = 0, cbytes = 0;
+   if (n->timer_node) {
+      skipnode_t *snode = (skipnode_t *)n->timer_node;
+      tbytes = sizeof(chann_tm_t) + sizeof(skipnode_t) + snode->level * sizeof(struct sk_link);
+   }
+   for (rwb_t *b = n->rwb_send.head; b; b = b->next) {
+      cbytes += sizeof(rwb_t) + b->len;
+   }
+   if (timer_bytes) {
+      *timer_bytes += tbytes;
+   }
+   if (cache_bytes) {
+      *cache_bytes += cbytes;
+   }
+   return sizeof(chann_t) + tbytes + cbytes;
+}
+
+int
+mnet_mem_report(mnet_mem_t *mem) {
+   mnet_t *ss = _gmnet();
+   if (!ss->init || mem == NULL) {
+      return 0;
+   }
+   memset(mem, 0, sizeof(*mem));
+   for (chann_t *n = ss->channs; n; n = n->next) {
+      if (n->state > CHANN_STATE_CLOSED) {
+         mem->channs++;
+      }
+      mem->chann_bytes += sizeof(chann_t);
+      _chann_mem(n, &mem->timer_bytes, &mem->send_cache_bytes);
+   }
+   mem->loop_bytes = sizeof(mnet_t) + sizeof(skiplist_t)
+      + (ss->chg.size + ss->evt.size) * sizeof(mevent_t);
+   if (ss->tr_ring) {
+      mem->loop_bytes += ((int64_t)ss->tr_mask + 1) * sizeof(mnet_trace_rec_t);
+   }
+   mem->total_bytes = mem->chann_bytes + mem->timer_bytes + mem->send_cache_bytes + mem->loop_bytes;
+   return 1;
+}
+
+/* histogram op, values under 8 in exact bucket, others in 8 sub buckets
+ * for each power of 2
+ */
+
+static inline int
+_hist_msb(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+   return 63 - __builtin_clzll(v);
+#else
+   int msb = 0;
+   while (v >>= 1) {
+      msb++;
+   }
+   return msb;
+#endif
+}
+
+static inline int
+_hist_index(uint64_t v) {
+   if (v < 8) {
+      return (int)v;
+   }
+   int msb = _hist_msb(v);
+   return (msb - 2) * 8 + (int)((v >> (msb - 3)) & 7);
+}
+
+/* middle value of bucket */
+static inline uint64_t
+_hist_value(int idx) {
+   if (idx < 8) {
+      return idx;
+   }
+   int shift = idx / 8 - 1;
+   uint64_t lower = (uint64_t)(8 + idx % 8) << shift;
+   return lower + (((uint64_t)1 << shift) >> 1);
+}
+
+void
+mnet_hist_reset(mnet_hist_t *h) {
+   if (h) {
+      memset(h, 0, sizeof(*h));
+   }
+}
+
+void
+mnet_hist_record(mnet_hist_t *h, uint64_t value) {
+   if (h) {
+      if (h->count <= 0 || value < h->min) {
+         h->min = value;
+      }
+      if (value > h->max) {
+         h->max = value;
+      }
+      h->count++;
+      h->sum += value;
+      h->buckets[_hist_index(value)]++;
+   }
+}
+
+uint64_t
+mnet_hist_percentile(const mnet_hist_t *h, double percent) {
+   if (h == NULL || h->count <= 0) {
+      return 0;
+   }
+   percent = percent < 0 ? 0 : (percent > 100 ? 100 : percent);
+   uint64_t rank = (uint64_t)(percent / 100.0 * h->count + 0.5);
+   rank = rank < 1 ? 1 : rank;
+   uint64_t count = 0;
+   for (int i=0; i<MNET_HIST_BUCKETS; i++) {
+      count += h->buckets[i];
+      if (count >= rank) {
+         uint64_t v = _hist_value(i);
+         return v < h->min ? h->min : (v > h->max ? h->max : v);
+      }
+   }
+   return h->max;
+}
+
+void
+mnet_loop_hist_enable(int enable) {
+   mnet_t *ss = _gmnet();
+   ss->hist_on = !!enable;
+   ss->hist_poll_end = 0;
+}
+
+void
+mnet_loop_hist_reset(void) {
+   mnet_t *ss = _gmnet();
+   memset(&ss->hist, 0, sizeof(ss->hist));
+   ss->hist_poll_end = 0;
+}
+
+int
+mnet_loop_hist(mnet_loop_hist_t *hist) {
+   if (hist) {
+      *hist = _gmnet()->hist;
+      return 1;
+   }
+   return 0;
+}
+
+void
+mnet_slow_handler(int64_t threshold_us, mnet_slow_cb cb) {
+   mnet_t *ss = _gmnet();
+   ss->slow_us = threshold_us > 0 ? threshold_us : 0;
+   ss->slow_cb = (threshold_us > 0) ? cb : NULL;
+   ss->slow_n = NULL;
+}
+
+int
+mnet_trace_enable(int records) {
+   mnet_t *ss = _gmnet();
+   if (!ss->init) {
+      return 0;
+   }
+   if (ss->tr_ring) {
+      mnet_trace_rec_t *ring = ss->tr_ring;
+      ss->tr_ring = NULL;
+      mm_free(ring);
+   }
+   int capacity = 0;
+   if (records > 0) {
+      capacity = 1;
+      while (capacity < records && capacity < (1 << 24)) {
+         capacity <<= 1;
+      }
+      ss->tr_mask = capacity - 1;
+      ss->tr_head = 0;
+      ss->tr_ring = (mnet_trace_rec_t *)mm_malloc(capacity * sizeof(mnet_trace_rec_t));
+   }
+   return capacity;
+}
+
+/* write all or fail, only async-signal-safe calls */
+static int
+_trace_write(int fd, const void *buf, size_t len) {
+   const uint8_t *p = (const uint8_t *)buf;
+   while (len > 0) {
+      int ret = (int)write(fd, p, (unsigned)len);
+#if !MNET_OS_WIN
+      if (ret < 0 && errno == EINTR) {
+         continue;
+      }
+#endif
+      if (ret <= 0) {
+         return 0;
+      }
+      p += ret;
+      len -= ret;
+   }
+   return 1;
+}
+
+int
+mnet_trace_dump(int fd) {
+   mnet_t *ss = _gmnet();
+   mnet_trace_rec_t *ring = ss->tr_ring;
+   if (ring == NULL || fd < 0) {
+      return -1;
+   }
+#if !MNET_OS_WIN
+   int saved = errno;
+#endif
+   uint64_t head = ss->tr_head;
+   uint64_t capacity = (uint64_t)ss->tr_mask + 1;
+   uint64_t count = head < capacity ? head : capacity;
+   mnet_trace_hdr_t hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   hdr.magic = MNET_TRACE_MAGIC;
+   hdr.version = MNET_TRACE_VERSION;
+   hdr.rec_size = sizeof(mnet_trace_rec_t);
+   hdr.count = (uint32_t)count;
+   hdr.pid = (uint32_t)getpid();
+   hdr.total = head;
+   int ok = _trace_write(fd, &hdr, sizeof(hdr));
+   if (ok && count > 0) {
+      /* oldest from begin to ring end, then wrapped part */
+      uint64_t begin = (head - count) & ss->tr_mask;
+      uint64_t first = _min_of((int)count, (int)(capacity - begin));
+      ok = _trace_write(fd, &ring[begin], first * sizeof(mnet_trace_rec_t));
+      if (ok && count > first) {
+         ok = _trace_write(fd, ring, (count - first) * sizeof(mnet_trace_rec_t));
+      }
+   }
+#if !MNET_OS_WIN
+   errno = saved;
+#endif
+   return ok ? (int)count : -1;
+}
+
 int64_t
 mnet_tm_current() {
    return _tm_current();
@@ -1475,6 +2555,69 @@ mnet_parse_ipport(const char *ipport, chann_addr_t *addr) {
    return 0;
 }
 
+int
+mnet_sockaddr_set(chann_sockaddr_t *sa, const char *ip, int port) {
+   if (sa && ip && port>=0 && port<=0xffff) {
+      memset(sa, 0, sizeof(*sa));
+      if (strchr(ip, ':')) {
+         struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)sa->storage;
+         if (inet_pton(AF_INET6, ip, &in6->sin6_addr) == 1) {
+            in6->sin6_family = AF_INET6;
+            in6->sin6_port = htons(port);
+            sa->len = sizeof(*in6);
+            return 1;
+         }
+      } else {
+         struct sockaddr_in *in4 = (struct sockaddr_in *)sa->storage;
+         if (inet_pton(AF_INET, ip, &in4->sin_addr) == 1) {
+            in4->sin_family = AF_INET;
+            in4->sin_port = htons(port);
+            sa->len = sizeof(*in4);
+            return 1;
+         }
+      }
+   }
+   return 0;
+}
+
+int
+mnet_sockaddr_equal(const chann_sockaddr_t *a, const chann_sockaddr_t *b) {
+   if (a && b && a->len == b->len && a->len > 0) {
+      const struct sockaddr *sa = (const struct sockaddr *)a->storage;
+      if (sa->sa_family == AF_INET) {
+         const struct sockaddr_in *a4 = (const struct sockaddr_in *)a->storage;
+         const struct sockaddr_in *b4 = (const struct sockaddr_in *)b->storage;
+         return (a4->sin_port == b4->sin_port) && (a4->sin_addr.s_addr == b4->sin_addr.s_addr);
+      }
+      if (sa->sa_family == AF_INET6) {
+         const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a->storage;
+         const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b->storage;
+         return (a6->sin6_port == b6->sin6_port) &&
+            (memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0);
+      }
+   }
+   return 0;
+}
+
+int
+mnet_sockaddr_string(const chann_sockaddr_t *sa, char *buf, int len) {
+   if (sa && buf && len>0 && sa->len>0) {
+      char ip[64] = {0};
+      const struct sockaddr *s = (const struct sockaddr *)sa->storage;
+      if (s->sa_family == AF_INET) {
+         const struct sockaddr_in *in4 = (const struct sockaddr_in *)sa->storage;
+         inet_ntop(AF_INET, (void *)&in4->sin_addr, ip, sizeof(ip));
+         return snprintf(buf, len, "%s:%d", ip, ntohs(in4->sin_port));
+      }
+      if (s->sa_family == AF_INET6) {
+         const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)sa->storage;
+         inet_ntop(AF_INET6, (void *)&in6->sin6_addr, ip, sizeof(ip));
+         return snprintf(buf, len, "[%s]:%d", ip, ntohs(in6->sin6_port));
+      }
+   }
+   return 0;
+}
+
 void
 mnet_multi_accept_balancer(void *ac_context,
                            mnet_balancer_cb ac_before,
@@ -1506,6 +2649,24 @@ mnet_multi_reset_event() {
          _evt_add(n, MNET_SET_READ);
          n = n->next;
       }
+#if !MNET_OS_WIN
+      /* wakeup pipe shared with forked processes, new pipe in same fds for
+       * worker threads writing, missed wakeup drained in next poll
+       */
+      if (ss->wk_fd > 0) {
+         int fds[2];
+         if (pipe(fds) == 0) {
+            _set_nonblocking(fds[0]);
+            _set_nonblocking(fds[1]);
+            dup2(fds[0], ss->wk.fd);
+            dup2(fds[1], ss->wk_fd);
+            close(fds[0]);
+            close(fds[1]);
+         }
+         ss->wk.epoll_events = 0;
+         _evt_add(&ss->wk, MNET_SET_READ);
+      }
+#endif
    }
 }
 
@@ -1514,15 +2675,11 @@ mnet_multi_reset_event() {
 
 chann_t*
 mnet_chann_open(chann_type_t ctype) {
-   if (ctype<CHANN_TYPE_STREAM || ctype>=(chann_type_t)MNET_EXT_MAX_SIZE) {
-      return NULL;
-   }
-   mnet_ext_t *ext = _ext_config(ctype);
-   if (!ext->reserved) {
+   if (_ext_layer(ctype) == NULL) {
       return NULL;
    }
    chann_t *n = _chann_create(_gmnet(), ctype, CHANN_STATE_DISCONNECT);
-   ext->open_cb(ext->ext_ctx, n);
+   _EXT_OP(n, open_cb, 0);
    return n;
 }
 
@@ -1535,6 +2692,16 @@ mnet_chann_close(chann_t *n) {
    }
 }
 
+uint64_t
+mnet_chann_id(chann_t *n) {
+   return n ? n->id : 0;
+}
+
+int64_t
+mnet_chann_mem(chann_t *n) {
+   return n ? _chann_mem(n, NULL, NULL) : 0;
+}
+
 int
 mnet_chann_fd(chann_t *n) {
    if (n) {
@@ -1554,8 +2721,7 @@ mnet_chann_type(chann_t *n) {
 int
 mnet_chann_state(chann_t *n) {
    if (n) {
-      mnet_ext_t *ext = _ext_config(n->ctype);
-      return ext->state_fn(ext->ext_ctx, n, n->state);
+      return _ext_state(n);
    }
    return -1;
 }
@@ -1566,21 +2732,25 @@ mnet_chann_connect(chann_t *n, const char *host, int port) {
       int fd = _chann_open_socket(n, host, port, 0);
       if (fd > 0) {
          n->fd = fd;
-         mnet_ext_t *ext = _ext_config(n->ctype);
-         if (ext->type_fn(ext->ext_ctx, n->ctype) == CHANN_TYPE_STREAM) {
+         if (_ext_raw_type(n) == CHANN_TYPE_STREAM) {
             int r = connect(fd, (struct sockaddr*)&n->addr, n->addr_len);
+            _gmnet()->stats.syscalls++;
+            _gmnet()->stats.connects++;
+            _trace(_gmnet(), n, MNET_TRACE_CONNECT, 0, 0, r < 0 ? errno : 0);
             if (r >= 0 || errno==EINPROGRESS || errno==EWOULDBLOCK) {
                n->state = CHANN_STATE_CONNECTING;
                _evt_add(n, MNET_SET_WRITE);
                mm_log(n, MNET_LOG_VERBOSE, "chann fd:%d ctype:%d connecting...\n", fd, n->ctype);
-               ext->connect_cb(ext->ext_ctx, n);
+               _EXT_OP(n, connect_cb, 0);
+               _wh_begin(_gmnet(), n);
                return 1;
             }
          } else {
             n->state = CHANN_STATE_CONNECTED;
             _evt_add(n, MNET_SET_READ);
             mm_log(n, MNET_LOG_VERBOSE, "chann fd:%d ctype:%d connected\n", fd, n->ctype);
-            ext->connect_cb(ext->ext_ctx, n);
+            _EXT_OP(n, connect_cb, 0);
+            _wh_begin(_gmnet(), n);
             return 1;
          }
       }
@@ -1605,8 +2775,7 @@ mnet_chann_listen(chann_t *n, const char *host, int port, int backlog) {
          n->state = CHANN_STATE_LISTENING;
          _evt_add(n, MNET_SET_READ);
          mm_log(n, MNET_LOG_VERBOSE, "chann %p, fd:%d listen\n", n, fd);
-         mnet_ext_t *ext = _ext_config(n->ctype);
-         ext->listen_cb(ext->ext_ctx, n);
+         _EXT_OP(n, listen_cb, 0);
          return 1;
       }
       mm_log(n, MNET_LOG_ERR, "chann %p fail to listen\n", n);
@@ -1634,9 +2803,8 @@ mnet_chann_active_event(chann_t *n, chann_event_t et, int64_t value) {
    if (n == NULL) {
       return;
    }
-   mnet_ext_t *ext = _ext_config(n->ctype);
    if (et == CHANN_EVENT_SEND &&
-       ext->state_fn(ext->ext_ctx, n, n->state) == CHANN_STATE_CONNECTED &&
+       _ext_state(n) == CHANN_STATE_CONNECTED &&
        n->active_send_event != !!value)
    {
       n->active_send_event = !!value;
@@ -1659,26 +2827,43 @@ mnet_chann_active_event(chann_t *n, chann_event_t et, int64_t value) {
    }
 }
 
+void
+mnet_chann_set_timeout(chann_t *n, int connect_ms, int idle_ms) {
+   if (n && n->state != CHANN_STATE_CLOSED) {
+      n->to_connect = _wh_ticks(connect_ms);
+      n->to_idle = _wh_ticks(idle_ms);
+      _wh_schedule(_gmnet(), n);
+   }
+}
+
+void
+mnet_chann_set_recv_rate(chann_t *n, int min_bytes, int window_ms) {
+   if (n && n->state != CHANN_STATE_CLOSED) {
+      mnet_t *ss = _gmnet();
+      int enable = min_bytes > 0 && window_ms > 0;
+      n->to_rate_bytes = enable ? min_bytes : 0;
+      n->to_window = enable ? _wh_ticks(window_ms) : 0;
+      n->to_window_begin = ss->wh_tick;
+      n->to_window_bytes = (uint32_t)n->bytes_recv;
+      _wh_schedule(ss, n);
+   }
+}
+
 int
 mnet_chann_recv(chann_t *n, void *buf, int len) {
    mnet_t *ss = _gmnet();
-   mnet_ext_t *ext = n ? _ext_config(n->ctype) : NULL;
-   if (n && buf && len>0 && ext && ext->state_fn(ext->ext_ctx, n, n->state)>=CHANN_STATE_CONNECTED) {
-      int ret = ext->recv_fn(ext->ext_ctx, n, buf, len);
+   if (n && buf && len>0 && _ext_state(n)>=CHANN_STATE_CONNECTED) {
+      int ret = _ext_top_recv(n, buf, len);
+      _chann_recv_account(ss, n, ret);
       if (ret < 0) {
          mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, recv errno %d:%s\n",
                   n, n->fd, errno, strerror(errno));
-         _chann_disconnect_socket(ss, n);
-         if (_chann_msg(n, CHANN_EVENT_DISCONNECT, NULL, errno)) {
-            n->dis_next = ss->dis_channs;
-            ss->dis_channs = n;
-         }
+         _chann_disconnect_event(ss, n, errno);
       }
-      n->bytes_recv += ret;
       return ret;
    } else {
-      mm_log(n, MNET_LOG_VERBOSE, "chann %p fd:%d recv ext:%p state:%d len:%d!\n",
-            n, n->fd, ext, ext ? ext->state_fn(ext->ext_ctx, n, n->state) : -1, len);
+      mm_log(n, MNET_LOG_VERBOSE, "chann %p fd:%d recv state:%d len:%d!\n",
+            n, n ? n->fd : -1, n ? _ext_state(n) : -1, len);
       return -1;
    }
 }
@@ -1686,8 +2871,7 @@ mnet_chann_recv(chann_t *n, void *buf, int len) {
 int
 mnet_chann_send(chann_t *n, void *buf, int len) {
    mnet_t *ss = _gmnet();
-   mnet_ext_t *ext = n ? _ext_config(n->ctype) : NULL;
-   if (n && buf && len>0 && ext && ext->state_fn(ext->ext_ctx, n, n->state)>=CHANN_STATE_CONNECTED) {
+   if (n && buf && len>0 && _ext_state(n)>=CHANN_STATE_CONNECTED) {
       int ret = len;
       rwb_head_t *prh = &n->rwb_send;
       if (_rwb_count(prh) > 0) {
@@ -1699,11 +2883,7 @@ mnet_chann_send(chann_t *n, void *buf, int len) {
          if (ret < 0) {
             mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, send errno %d:%s\n",
                      n, n->fd, errno, strerror(errno));
-            _chann_disconnect_socket(ss, n);
-            if (_chann_msg(n, CHANN_EVENT_DISCONNECT, NULL, errno)) {
-               n->dis_next = ss->dis_channs;
-               ss->dis_channs = n;
-            }
+            _chann_disconnect_event(ss, n, errno);
             return -1;
          }
          if (ret >= 0 && ret < len) {
@@ -1715,8 +2895,8 @@ mnet_chann_send(chann_t *n, void *buf, int len) {
       }
       return ret;
    } else {
-      mm_log(n, MNET_LOG_VERBOSE, "chann %p fd:%d send ext:%p state:%d len:%d!\n",
-            n, n->fd, ext, ext ? ext->state_fn(ext->ext_ctx, n, n->state) : -1, len);
+      mm_log(n, MNET_LOG_VERBOSE, "chann %p fd:%d send state:%d len:%d!\n",
+            n, n ? n->fd : -1, n ? _ext_state(n) : -1, len);
       return -1;
    }
 }
@@ -1724,8 +2904,7 @@ mnet_chann_send(chann_t *n, void *buf, int len) {
 int
 mnet_dgram_recv(chann_t *n, chann_addr_t *addr_in, void *buf, int len) {
    if ((n->ctype == CHANN_TYPE_DGRAM || n->ctype == CHANN_TYPE_BROADCAST) && buf && len>0) {
-      mnet_ext_t *ext = n ? _ext_config(n->ctype) : NULL;
-      if (ext->state_fn(ext->ext_ctx, n, n->state)>=CHANN_STATE_CONNECTED) {
+      if (_ext_state(n)>=CHANN_STATE_CONNECTED) {
          int ret = mnet_chann_recv(n, buf, len);
          mnet_chann_socket_addr(n, addr_in);
          return ret;
@@ -1737,8 +2916,7 @@ mnet_dgram_recv(chann_t *n, chann_addr_t *addr_in, void *buf, int len) {
 int
 mnet_dgram_send(chann_t *n, chann_addr_t *addr, void *buf, int len) {
    if ((n->ctype == CHANN_TYPE_DGRAM || n->ctype == CHANN_TYPE_BROADCAST) && addr && buf && len>0) {
-      mnet_ext_t *ext = n ? _ext_config(n->ctype) : NULL;
-      if (ext->state_fn(ext->ext_ctx, n, n->state)>=CHANN_STATE_CONNECTED) {
+      if (_ext_state(n)>=CHANN_STATE_CONNECTED) {
          _chann_fill_addr(n, addr->ip, addr->port);
       } else {
          mnet_chann_connect(n, addr->ip, addr->port);
@@ -1748,6 +2926,450 @@ mnet_dgram_send(chann_t *n, chann_addr_t *addr, void *buf, int len) {
    return 0;
 }
 
+static inline int
+_dgram_is_raw(chann_t *n) {
+   return n && (n->ctype == CHANN_TYPE_DGRAM || n->ctype == CHANN_TYPE_BROADCAST);
+}
+
+/* binary address from/to chann socket address */
+static inline int
+_sockaddr_copy_in(chann_t *n, const chann_sockaddr_t *sa) {
+   if (sa->len <= 0 || sa->len > (int)sizeof(n->addr)) {
+      return 0;                 /* chann socket only support IPv4 */
+   }
+   memcpy(&n->addr, sa->storage, sa->len);
+   n->addr_len = sa->len;
+   return 1;
+}
+
+static inline void
+_sockaddr_copy_out(chann_t *n, const chann_sockaddr_t *sa) {
+   if (sa->len > 0 && sa->len <= (int)sizeof(n->addr)) {
+      memcpy(&n->addr, sa->storage, sa->len);
+      n->addr_len = sa->len;
+   }
+}
+
+/* DGRAM open socket without bind for sending */
+static int
+_dgram_open(chann_t *n) {
+   if (n->state >= CHANN_STATE_CONNECTED) {
+      return 1;
+   }
+   int fd = _chann_open_socket(n, NULL, 0, 0);
+   if (fd > 0) {
+      n->fd = fd;
+      n->state = CHANN_STATE_CONNECTED;
+      _evt_add(n, MNET_SET_READ);
+      _EXT_OP(n, connect_cb, 0);
+      _wh_begin(_gmnet(), n);
+      return 1;
+   }
+   return 0;
+}
+
+/* recv datagrams in one syscall under Linux, return count, 0 for would block */
+static int
+_dgram_recv_mmsg(chann_t *n, chann_dgram_t *msgs, int cnt) {
+#if MNET_OS_LINUX
+   struct mmsghdr hdr[MNET_DGRAM_BATCH_MAX];
+   struct iovec iov[MNET_DGRAM_BATCH_MAX];
+   memset(hdr, 0, sizeof(hdr[0]) * cnt);
+   for (int i=0; i<cnt; i++) {
+      iov[i].iov_base = msgs[i].buf;
+      iov[i].iov_len = msgs[i].size;
+      hdr[i].msg_hdr.msg_name = msgs[i].addr.storage;
+      hdr[i].msg_hdr.msg_namelen = sizeof(msgs[i].addr.storage);
+      hdr[i].msg_hdr.msg_iov = &iov[i];
+      hdr[i].msg_hdr.msg_iovlen = 1;
+   }
+   int ret = recvmmsg(n->fd, hdr, cnt, 0, NULL);
+   _gmnet()->stats.syscalls++;
+   if (ret < 0) {
+      return errno==EWOULDBLOCK ? 0 : -1;
+   }
+   for (int i=0; i<ret; i++) {
+      msgs[i].len = (int)hdr[i].msg_len;
+      msgs[i].addr.len = hdr[i].msg_hdr.msg_namelen;
+   }
+   if (ret > 0) {
+      _sockaddr_copy_out(n, &msgs[ret - 1].addr);
+   }
+   return ret;
+#else
+   int i = 0;
+   for (; i<cnt; i++) {
+      socklen_t addr_len = sizeof(msgs[i].addr.storage);
+      int ret = (int)recvfrom(n->fd, msgs[i].buf, msgs[i].size, 0, (struct sockaddr *)msgs[i].addr.storage, &addr_len);
+      if (ret < 0) {
+         if (errno == EWOULDBLOCK) {
+            break;
+         }
+         return i > 0 ? i : -1;
+      }
+      msgs[i].len = ret;
+      msgs[i].addr.len = addr_len;
+      _sockaddr_copy_out(n, &msgs[i].addr);
+   }
+   return i;
+#endif
+}
+
+/* batch entry with buffer, length and peer address for unconnected socket,
+ * invalid one not sent to kernel for error disconnecting shared chann
+ */
+static inline int
+_dgram_msg_valid(chann_t *n, const chann_dgram_t *m) {
+   if (m->len < 0 || m->len > MNET_DGRAM_PAYLOAD_MAX || (m->buf == NULL && m->len > 0)) {
+      return 0;
+   }
+   return n->dgram_connected || (m->addr.len > 0 && m->addr.len <= (int)sizeof(n->addr));
+}
+
+/* send datagrams in one syscall under Linux, return count, 0 for would block */
+static int
+_dgram_send_mmsg(chann_t *n, chann_dgram_t *msgs, int cnt) {
+#if MNET_OS_LINUX
+   struct mmsghdr hdr[MNET_DGRAM_BATCH_MAX];
+   struct iovec iov[MNET_DGRAM_BATCH_MAX];
+   memset(hdr, 0, sizeof(hdr[0]) * cnt);
+   for (int i=0; i<cnt; i++) {
+      iov[i].iov_base = msgs[i].buf;
+      iov[i].iov_len = msgs[i].len;
+      if (!n->dgram_connected) {
+         hdr[i].msg_hdr.msg_name = msgs[i].addr.storage;
+         hdr[i].msg_hdr.msg_namelen = msgs[i].addr.len;
+      }
+      hdr[i].msg_hdr.msg_iov = &iov[i];
+      hdr[i].msg_hdr.msg_iovlen = 1;
+   }
+   mnet_t *ss = _gmnet();
+   int ret = sendmmsg(n->fd, hdr, cnt, 0);
+   ss->stats.syscalls++;
+   if (ret < 0) {
+      if (errno == EWOULDBLOCK) {
+         return 0;
+      }
+      _chann_send_account(ss, n, -1);
+      return -1;
+   }
+   int bytes = 0;
+   for (int i=0; i<ret; i++) {
+      bytes += hdr[i].msg_len;
+   }
+   _chann_send_account(ss, n, bytes);
+   return ret;
+#else
+   int i = 0;
+   for (; i<cnt; i++) {
+      if (!n->dgram_connected) {
+         _sockaddr_copy_in(n, &msgs[i].addr);
+      }
+      int ret = _chann_send(n, msgs[i].buf, msgs[i].len);
+      if (ret < 0) {
+         return i > 0 ? i : -1;
+      }
+      if (ret == 0) {
+         break;
+      }
+   }
+   return i;
+#endif
+}
+
+int
+mnet_dgram_recvfrom(chann_t *n, chann_sockaddr_t *addr_in, void *buf, int len) {
+   if (_dgram_is_raw(n) && buf && len>0 && n->state>=CHANN_STATE_CONNECTED) {
+      int ret = mnet_chann_recv(n, buf, len);
+      if (ret>0 && addr_in) {
+         memcpy(addr_in->storage, &n->addr, n->addr_len);
+         addr_in->len = n->addr_len;
+      }
+      return ret;
+   }
+   return 0;
+}
+
+int
+mnet_dgram_sendto(chann_t *n, const chann_sockaddr_t *addr_out, void *buf, int len) {
+   if (_dgram_is_raw(n) && buf && len>0) {
+      if (!_dgram_open(n)) {
+         return -1;
+      }
+      if (!n->dgram_connected && (addr_out == NULL || !_sockaddr_copy_in(n, addr_out))) {
+         return -1;
+      }
+      return mnet_chann_send(n, buf, len);
+   }
+   return 0;
+}
+
+int
+mnet_dgram_connect(chann_t *n, const chann_sockaddr_t *peer) {
+   if (_dgram_is_raw(n) && peer && _dgram_open(n) && _sockaddr_copy_in(n, peer)) {
+      if (connect(n->fd, (struct sockaddr *)&n->addr, n->addr_len) == 0) {
+         n->dgram_connected = 1;
+         mm_log(n, MNET_LOG_VERBOSE, "chann fd:%d dgram connected %s:%d\n",
+                n->fd, _chann_addr(&n->addr), _chann_port(&n->addr));
+         return 1;
+      }
+      mm_log(n, MNET_LOG_ERR, "chann %p fail to connect dgram %d:%s\n", n, errno, strerror(errno));
+   }
+   return 0;
+}
+
+/* send segments with UDP_SEGMENT in one syscall, return bytes sent, 0 for would
+ * block, -1 for error, -2 for kernel without GSO support
+ */
+static int
+_dgram_send_gso(chann_t *n, uint8_t *buf, int len, int seg_size) {
+#if MNET_OS_LINUX
+   struct iovec iov = { .iov_base = buf, .iov_len = len };
+   char control[CMSG_SPACE(sizeof(uint16_t))];
+   struct msghdr hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   memset(control, 0, sizeof(control));
+   if (!n->dgram_connected) {
+      hdr.msg_name = &n->addr;
+      hdr.msg_namelen = n->addr_len;
+   }
+   hdr.msg_iov = &iov;
+   hdr.msg_iovlen = 1;
+   hdr.msg_control = control;
+   hdr.msg_controllen = sizeof(control);
+   struct cmsghdr *cm = CMSG_FIRSTHDR(&hdr);
+   cm->cmsg_level = IPPROTO_UDP;
+   cm->cmsg_type = UDP_SEGMENT;
+   cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+   *((uint16_t *)CMSG_DATA(cm)) = (uint16_t)seg_size;
+   mnet_t *ss = _gmnet();
+   int ret = (int)sendmsg(n->fd, &hdr, 0);
+   ss->stats.syscalls++;
+   if (ret < 0) {
+      if (errno == EWOULDBLOCK) {
+         return 0;
+      }
+      if (errno==EINVAL || errno==ENOPROTOOPT || errno==EOPNOTSUPP || errno==EIO) {
+         return -2;
+      }
+   }
+   _chann_send_account(ss, n, ret);
+   return ret < 0 ? -1 : ret;
+#else
+   return -2;
+#endif
+}
+
+int
+mnet_dgram_send_segments(chann_t *n, const chann_sockaddr_t *addr_out, void *buf, int len, int seg_size) {
+   mnet_t *ss = _gmnet();
+   if (_dgram_is_raw(n) && buf && len>0 && seg_size>0) {
+      if (!_dgram_open(n)) {
+         return -1;
+      }
+      if (!n->dgram_connected && (addr_out == NULL || !_sockaddr_copy_in(n, addr_out))) {
+         return -1;
+      }
+      uint8_t *ptr = (uint8_t *)buf;
+      int sended = 0;
+      int gso_max = _min_of(MNET_DGRAM_GSO_SEGS, MNET_DGRAM_GSO_BYTES / seg_size) * seg_size;
+      while (sended < len) {
+         int ret = 0;
+         int slen = _min_of(len - sended, seg_size);
+         if (!n->dgram_gso_off && gso_max > seg_size && (len - sended) > seg_size) {
+            slen = _min_of(len - sended, gso_max);
+            ret = _dgram_send_gso(n, ptr + sended, slen, seg_size);
+            if (ret == -2) {
+               mm_log(n, MNET_LOG_INFO, "chann %p fd:%d, fallback without UDP_SEGMENT %d:%s\n",
+                      n, n->fd, errno, strerror(errno));
+               n->dgram_gso_off = 1;
+               continue;
+            }
+         } else {
+            ret = _chann_send(n, ptr + sended, slen);
+         }
+         if (ret < 0) {
+            if (sended > 0) {
+               break;
+            }
+            mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, send segments errno %d:%s\n",
+                   n, n->fd, errno, strerror(errno));
+            _chann_disconnect_event(ss, n, errno);
+            return -1;
+         }
+         sended += ret;
+         if (ret < slen) {
+            break;
+         }
+      }
+      return sended;
+   }
+   return 0;
+}
+
+int
+mnet_dgram_set_gro(chann_t *n, int enable) {
+#if MNET_OS_LINUX
+   if (_dgram_is_raw(n) && n->fd > 0) {
+      int opt = !!enable;
+      if (setsockopt(n->fd, IPPROTO_UDP, UDP_GRO, &opt, sizeof(opt)) == 0) {
+         n->dgram_gro = opt;
+         return 1;
+      }
+      mm_log(n, MNET_LOG_INFO, "chann %p fd:%d, without UDP_GRO %d:%s\n",
+             n, n->fd, errno, strerror(errno));
+   }
+#endif
+   return 0;
+}
+
+int
+mnet_dgram_recv_segments(chann_t *n, void *buf, int len, chann_dgram_t *views, int cnt) {
+   mnet_t *ss = _gmnet();
+   if (_dgram_is_raw(n) && buf && len>0 && views && cnt>0 && n->state>=CHANN_STATE_CONNECTED) {
+      if (n->dgram_gro && cnt < MNET_DGRAM_GRO_SEGS) {
+         errno = EINVAL;        /* segments not fit in views were lost */
+         return -1;
+      }
+      int ret = 0;
+      int seg_size = 0;
+      int truncated = 0;
+      chann_sockaddr_t addr;
+#if MNET_OS_LINUX
+      struct iovec iov = { .iov_base = buf, .iov_len = len };
+      char control[CMSG_SPACE(sizeof(int))];
+      struct msghdr hdr;
+      memset(&hdr, 0, sizeof(hdr));
+      hdr.msg_name = addr.storage;
+      hdr.msg_namelen = sizeof(addr.storage);
+      hdr.msg_iov = &iov;
+      hdr.msg_iovlen = 1;
+      if (n->dgram_gro) {
+         hdr.msg_control = control;
+         hdr.msg_controllen = sizeof(control);
+      }
+      ret = (int)recvmsg(n->fd, &hdr, 0);
+      ss->stats.syscalls++;
+      addr.len = hdr.msg_namelen;
+      truncated = ret >= 0 && (hdr.msg_flags & MSG_TRUNC);
+      if (ret > 0 && n->dgram_gro) {
+         struct cmsghdr *cm = CMSG_FIRSTHDR(&hdr);
+         for (; cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+            if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+               seg_size = *((int *)CMSG_DATA(cm));
+            }
+         }
+      }
+#else
+      socklen_t addr_len = sizeof(addr.storage);
+      ret = (int)recvfrom(n->fd, buf, len, 0, (struct sockaddr *)addr.storage, &addr_len);
+      addr.len = addr_len;
+#endif
+      if (ret < 0 && errno == EWOULDBLOCK) {
+         return 0;
+      }
+      _chann_recv_account(ss, n, ret);
+      if (ret < 0) {
+         mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, recv segments errno %d:%s\n",
+                n, n->fd, errno, strerror(errno));
+         _chann_disconnect_event(ss, n, errno);
+         return -1;
+      }
+      _sockaddr_copy_out(n, &addr);
+      if (seg_size <= 0 || seg_size > ret) {
+         seg_size = ret;        /* single datagram */
+      }
+      if (truncated || (seg_size > 0 && (ret + seg_size - 1) / seg_size > cnt)) {
+         mm_log(n, MNET_LOG_INFO, "chann %p fd:%d, recv segments truncated %d, buf %d\n",
+                n, n->fd, ret, len);
+         errno = EMSGSIZE;
+         return -1;
+      }
+      int count = 0;
+      for (int offset=0; count<cnt && (offset<ret || count==0); offset+=seg_size) {
+         views[count].addr = addr;
+         views[count].buf = (uint8_t *)buf + offset;
+         views[count].size = seg_size;
+         views[count].len = _min_of(seg_size, ret - offset);
+         count++;
+      }
+      return count;
+   }
+   return 0;
+}
+
+int
+mnet_dgram_recv_batch(chann_t *n, chann_dgram_t *msgs, int cnt) {
+   mnet_t *ss = _gmnet();
+   if (_dgram_is_raw(n) && msgs && cnt>0 && n->state>=CHANN_STATE_CONNECTED) {
+      int count = 0;
+      while (count < cnt) {
+         int batch = _min_of(cnt - count, MNET_DGRAM_BATCH_MAX);
+         int ret = _dgram_recv_mmsg(n, &msgs[count], batch);
+         if (ret < 0) {
+            _chann_recv_account(ss, n, ret);
+            if (count > 0) {
+               break;
+            }
+            mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, recv batch errno %d:%s\n",
+                   n, n->fd, errno, strerror(errno));
+            _chann_disconnect_event(ss, n, errno);
+            return -1;
+         }
+         int bytes = 0;
+         for (int i=0; i<ret; i++) {
+            bytes += msgs[count + i].len;
+         }
+         _chann_recv_account(ss, n, bytes);
+         count += ret;
+         if (ret < batch) {
+            break;
+         }
+      }
+      return count;
+   }
+   return 0;
+}
+
+int
+mnet_dgram_send_batch(chann_t *n, chann_dgram_t *msgs, int cnt) {
+   mnet_t *ss = _gmnet();
+   if (_dgram_is_raw(n) && msgs && cnt>0) {
+      if (!_dgram_open(n)) {
+         return -1;
+      }
+      // stop before first invalid entry, chann kept
+      int valid = 0;
+      while (valid < cnt && _dgram_msg_valid(n, &msgs[valid])) {
+         valid++;
+      }
+      if (valid <= 0) {
+         errno = EINVAL;
+         return -1;
+      }
+      int count = 0;
+      while (count < valid) {
+         int batch = _min_of(valid - count, MNET_DGRAM_BATCH_MAX);
+         int ret = _dgram_send_mmsg(n, &msgs[count], batch);
+         if (ret < 0) {
+            if (count > 0) {
+               break;
+            }
+            mm_log(n, MNET_LOG_ERR, "chann %p fd:%d, send batch errno %d:%s\n",
+                   n, n->fd, errno, strerror(errno));
+            _chann_disconnect_event(ss, n, errno);
+            return -1;
+         }
+         count += ret;
+         if (ret < batch) {
+            break;
+         }
+      }
+      return count;
+   }
+   return 0;
+}
+
 int
 mnet_chann_cached(chann_t *n) {
    if (n) {
@@ -1793,10 +3415,9 @@ mnet_chann_socket_addr(chann_t *n, chann_addr_t *addr) {
 
 int
 mnet_chann_peer_addr(chann_t *n, chann_addr_t *out_addr) {
-   mnet_ext_t *ext = n ? _ext_config(n->ctype) : NULL;
    if (n &&
        n->ctype == CHANN_TYPE_STREAM &&
-       ext->state_fn(ext->ext_ctx, n, n->state)>=CHANN_STATE_CONNECTED &&
+       _ext_state(n)>=CHANN_STATE_CONNECTED &&
        out_addr)
    {
       struct sockaddr_in addr;
@@ -1812,6 +3433,17 @@ mnet_chann_peer_addr(chann_t *n, chann_addr_t *out_addr) {
 
 chann_msg_t*
 mnet_result_next() {
+   mnet_t *ss = _gmnet();
+   if (ss->slow_cb) {
+      _slow_check(ss, _tm_current());
+      chann_msg_t *msg = _evt_result_next();
+      if (msg) {
+         ss->slow_n = msg->n;
+         ss->slow_event = msg->event;
+         ss->slow_begin = _tm_current();
+      }
+      return msg;
+   }
    return _evt_result_next();
 }
 
@@ -1824,12 +3456,14 @@ mnet_poll(uint32_t milliseconds) {
  */
 
 int mnet_ext_register(chann_type_t ctype, mnet_ext_t *ext) {
-   if (ext==NULL || ctype<=CHANN_TYPE_BROADCAST || ctype>=(chann_type_t)MNET_EXT_MAX_SIZE) {
+#ifdef MNET_NO_EXT
+   return 0;
+#else
+   mnet_t *ss = _gmnet();
+   if (ext==NULL || ctype<=CHANN_TYPE_BROADCAST || _ext_layer(ctype)) {
       return 0;
    }
-   mnet_ext_t *ss_ext = _ext_config(ctype);
-   if (!ss_ext->reserved &&
-       ext->type_fn &&
+   if (ext->type_fn &&
        ext->filter_fn &&
        ext->open_cb &&
        ext->close_cb &&
@@ -1842,30 +3476,170 @@ int mnet_ext_register(chann_type_t ctype, mnet_ext_t *ext) {
        ext->send_fn)
    {
       int raw_type = ext->type_fn(ext->ext_ctx, ctype);
-      if (raw_type >= CHANN_TYPE_STREAM && raw_type <= CHANN_TYPE_BROADCAST) {
-         *ss_ext = *ext;
-         ss_ext->reserved = 1;
-         return 1;
+      if (raw_type < CHANN_TYPE_STREAM || raw_type > CHANN_TYPE_BROADCAST) {
+         return 0;
       }
+      ext_layer_t *lower = &ss->ext_raw[raw_type];
+      if (ext->lower) {
+         lower = ext->lower > CHANN_TYPE_BROADCAST ? _ext_layer(ext->lower) : NULL;
+         if (lower == NULL || lower->raw != raw_type || lower->depth >= MNET_EXT_MAX_DEPTH) {
+            return 0;
+         }
+      }
+      if (!_ext_table(ss, ctype)) {
+         return 0;
+      }
+      ext_layer_t *l = (ext_layer_t *)mm_malloc(sizeof(*l));
+      l->ext = *ext;
+      l->ext.reserved = 1;
+      l->ctype = ctype;
+      l->raw = raw_type;
+      l->depth = lower->depth + 1;
+      l->flush = ext->flush_fn != NULL || lower->flush;
+      l->lower = lower;
+      ss->ext_layers[ctype] = l;
+      return 1;
    }
    return 0;
+#endif
 }
 
 /* set extension userdata for chann */
 void mnet_ext_chann_set_ud(chann_t *n, void *ext_ud) {
-   if (n && _ext_config(n->ctype)->reserved) {
-      n->ext_ud = ext_ud;
+   ext_layer_t *top = n ? _ext_layer(n->ctype) : NULL;
+   if (top) {
+      *_ext_ud_slot(n, top, n->ext_cur) = ext_ud;
    }
 }
 
 /* get extension userdata for chann */
 void* mnet_ext_chann_get_ud(chann_t *n) {
-   if (n && _ext_config(n->ctype)->reserved) {
-      return n->ext_ud;
+   ext_layer_t *top = n ? _ext_layer(n->ctype) : NULL;
+   if (top) {
+      return *_ext_ud_slot(n, top, n->ext_cur);
    } else {
       return NULL;
    }
 }
 
+/* userdata of ctype layer, not rely on layer in dispatching */
+void* mnet_ext_chann_layer_ud(chann_t *n, chann_type_t ctype) {
+   ext_layer_t *top = n ? _ext_layer(n->ctype) : NULL;
+   for (ext_layer_t *l = top; l && l->depth > 0; l = l->lower) {
+      if (l->ctype == ctype) {
+         return *_ext_ud_slot(n, top, l->depth);
+      }
+   }
+   return NULL;
+}
+
+/* recv/send with layer below, internal chann_type_t at last */
+int mnet_ext_lower_recv(chann_t *n, void *buf, int len) {
+   if (n == NULL || n->ext_cur <= 0) {
+      return -1;
+   }
+   return _ext_recv(n, _ext_layer_at(_ext_layer(n->ctype), n->ext_cur - 1), buf, len);
+}
+
+int mnet_ext_lower_send(chann_t *n, void *buf, int len) {
+   if (n == NULL || n->ext_cur <= 0) {
+      return -1;
+   }
+   return _ext_send(n, _ext_layer_at(_ext_layer(n->ctype), n->ext_cur - 1), buf, len);
+}
+
+/* stop or resume read events in loop thread */
+void mnet_ext_chann_pause(chann_t *n, int pause) {
+   if (n && n->fd >= 0 && n->state == CHANN_STATE_CONNECTED) {
+      if (pause) {
+         _evt_del(n, MNET_SET_READ);
+      } else {
+         _evt_add(n, MNET_SET_READ);
+      }
+   }
+}
+
+/* wakeup pipe in loop, once */
+int mnet_ext_wakeup_init(void) {
+#if MNET_OS_WIN
+   return 0;
+#else
+   mnet_t *ss = _gmnet();
+   if (ss->wk_fd > 0) {
+      return 1;
+   }
+   int fds[2];
+   if (!ss->init || pipe(fds) < 0) {
+      return 0;
+   }
+   _set_nonblocking(fds[0]);
+   _set_nonblocking(fds[1]);
+   memset(&ss->wk, 0, sizeof(ss->wk));
+   ss->wk.fd = fds[0];
+   ss->wk.state = CHANN_STATE_LISTENING;
+   ss->wk_fd = fds[1];
+   if (!_evt_add(&ss->wk, MNET_SET_READ)) {
+      close(fds[0]);
+      close(fds[1]);
+      ss->wk_fd = 0;
+      return 0;
+   }
+   return 1;
+#endif
+}
+
+/* push to lock free stack, write pipe when stack was empty */
+void mnet_ext_chann_wakeup(chann_t *n) {
+#if !MNET_OS_WIN
+   mnet_t *ss = _gmnet();
+   if (n == NULL || ss->wk_fd <= 0 || !__sync_bool_compare_and_swap(&n->wk_queued, 0, 1)) {
+      return;
+   }
+   chann_t *head = NULL;
+   do {
+      head = ss->wk_head;
+      n->wk_next = head;
+   } while (!__sync_bool_compare_and_swap(&ss->wk_head, head, n));
+   if (head == NULL) {
+      ssize_t ret = write(ss->wk_fd, "w", 1);
+      (void)ret;
+   }
+#endif
+}
+
+/* ext buffered data not from fd, emit RECV after fd events until cleared */
+void mnet_ext_chann_pending(chann_t *n, int pending) {
+   if (n == NULL) {
+      return;
+   }
+   uint8_t bit = (uint8_t)(1 << ((n->ext_cur > 0 ? n->ext_cur : 1) - 1));
+   n->pend_data = pending ? (n->pend_data | bit) : (n->pend_data & ~bit);
+   if (n->pend_data && !n->pend_queued) {
+      mnet_t *ss = _gmnet();
+      n->pend_queued = 1;
+      n->pend_next = ss->pend_channs;
+      ss->pend_channs = n;
+   }
+}
+
+/* ext buffered send data, flushed once before next poll wait */
+void mnet_ext_chann_flush(chann_t *n) {
+   if (n == NULL || n->flush_queued || _ext_builtin(n) || !_ext_layer(n->ctype)->flush) {
+      return;
+   }
+   mnet_t *ss = _gmnet();
+   n->flush_queued = 1;
+   n->flush_next = ss->flush_channs;
+   ss->flush_channs = n;
+}
+
 #undef MNET_SKIPLIST_MAX_LEVEL
-#undef MNET_EXT_MAX_SIZE
\ No newline at end of file
+#undef MNET_WHEEL_TICK_MS
+#undef MNET_WHEEL_SLOTS
+#undef _mm_barrier
+#undef MNET_EXT_MAX_DEPTH
+#undef _EXT_OP
+#undef MNET_DGRAM_BATCH_MAX
+#undef MNET_DGRAM_GSO_SEGS
+#undef MNET_DGRAM_GSO_BYTES
+#undef MNET_DGRAM_PAYLOAD_MAX
\ No newline at end of file
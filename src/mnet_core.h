@@ -40,6 +40,12 @@ typedef enum {
    CHANN_EVENT_TIMER,          /* user defined interval, highest priority */
 } chann_event_t;
 
+typedef enum {
+   MNET_ERR_CONNECT_TIMEOUT = -1001, /* not connected in connect timeout */
+   MNET_ERR_IDLE_TIMEOUT = -1002,    /* no recv/send in idle timeout */
+   MNET_ERR_RECV_RATE = -1003,       /* recv less than min bytes in window */
+} mnet_err_t;                        /* chann_msg_t err for CHANN_EVENT_DISCONNECT */
+
 typedef struct s_chann chann_t;
 
 typedef struct {
@@ -55,7 +61,111 @@ typedef struct {
    int port;
 } chann_addr_t;
 
+typedef struct {
+   int len;                     /* sockaddr length, 0 for invalid */
+   uint32_t storage[7];         /* sockaddr_in or sockaddr_in6, network byte order */
+} chann_sockaddr_t;
+
+typedef struct {
+   chann_sockaddr_t addr;       /* peer address, dest for send, source for recv */
+   void *buf;                   /* datagram buffer */
+   int size;                    /* buffer size for recv */
+   int len;                     /* datagram length, input for send, output for recv */
+} chann_dgram_t;
+
+#define MNET_STATS_ERR_SLOTS 16 /* disconnect errno slots, last for others */
+
+typedef struct {
+   int64_t timestamp;           /* micro seconds when published */
+   uint64_t polls;              /* mnet_poll count */
+   uint64_t poll_events;        /* kqueue/epoll events returned */
+   uint64_t events[CHANN_EVENT_TIMER + 1]; /* chann events emitted, index by chann_event_t */
+   uint64_t accepts;            /* accepted channs */
+   uint64_t connects;           /* connect started */
+   uint64_t disconnects;        /* disconnect by peer, error or timeout */
+   struct {
+      int err;                  /* errno or mnet_err_t */
+      uint64_t count;
+   } disconnect_errs[MNET_STATS_ERR_SLOTS];
+   uint64_t bytes_recv;
+   uint64_t bytes_send;
+   uint64_t timer_fires;
+   uint64_t evt_ctl;            /* epoll_ctl/kevent changes */
+   uint64_t syscalls;           /* socket syscalls from internal chann type and poll */
+   int64_t send_cache_bytes;    /* gauge for unsent data cached */
+   int64_t send_cache_chunks;   /* gauge for cached buffers */
+   int64_t channs;              /* gauge for opened channs */
+} mnet_stats_t;
+
+typedef enum {
+   MNET_STATS_JSON = 1,
+   MNET_STATS_PROMETHEUS,
+} mnet_stats_format_t;
+
+#define MNET_HIST_BUCKETS 496 /* log2 buckets with 8 sub buckets, error < 6.25% */
+
+typedef struct {
+   uint64_t count;
+   uint64_t sum;
+   uint64_t min;
+   uint64_t max;
+   uint64_t buckets[MNET_HIST_BUCKETS];
+} mnet_hist_t;
+
+typedef struct {
+   mnet_hist_t poll_block;      /* micro seconds blocked in kqueue/epoll */
+   mnet_hist_t dispatch;        /* micro seconds from poll return to next poll */
+   mnet_hist_t poll_events;     /* events for each poll */
+   mnet_hist_t timer_late;      /* micro seconds timer fired after deadline */
+} mnet_loop_hist_t;
+
+/* memory allocated by core, without allocator overhead, ext ud and kernel
+ * socket buffers
+ */
+typedef struct {
+   int64_t channs;              /* opened channs */
+   int64_t chann_bytes;         /* chann_t */
+   int64_t timer_bytes;         /* timer and skiplist node */
+   int64_t send_cache_bytes;    /* buffers for unsent data */
+   int64_t loop_bytes;          /* loop state, event arrays, trace ring */
+   int64_t total_bytes;
+} mnet_mem_t;
+
+typedef enum {
+   MNET_TRACE_EVENT = 1,        /* event emitted, chann_event_t in 'event' */
+   MNET_TRACE_RECV,             /* bytes received, -1 with errno */
+   MNET_TRACE_SEND,             /* bytes sended, -1 with errno */
+   MNET_TRACE_ACCEPT,           /* accepted chann and fd */
+   MNET_TRACE_CONNECT,          /* connect started, errno for failure */
+   MNET_TRACE_CLOSE,            /* socket closed */
+} mnet_trace_op_t;
+
+/* binary trace record, 32 bytes in host byte order */
+typedef struct {
+   int64_t ts;                  /* micro seconds */
+   uint64_t chann_id;           /* mnet_chann_id() */
+   int32_t fd;
+   int32_t bytes;
+   int32_t err;                 /* errno or chann_msg_t err */
+   uint16_t op;                 /* mnet_trace_op_t */
+   uint16_t event;              /* chann_event_t for MNET_TRACE_EVENT */
+} mnet_trace_rec_t;
+
+#define MNET_TRACE_MAGIC 0x524e4d54 /* 'TMNR' in little endian */
+#define MNET_TRACE_VERSION 1
+
+/* trace dump header, followed by 'count' records from oldest */
+typedef struct {
+   uint32_t magic;
+   uint16_t version;
+   uint16_t rec_size;           /* sizeof(mnet_trace_rec_t) */
+   uint32_t count;              /* records followed */
+   uint32_t pid;
+   uint64_t total;              /* records since enabled, overwritten = total - count */
+} mnet_trace_hdr_t;
+
 typedef void (*chann_msg_cb)(chann_msg_t*);
+typedef void (*mnet_slow_cb)(chann_t *n, chann_event_t event, int64_t micro_seconds);
 typedef void (*mnet_log_cb)(chann_t*, int, const char *log_string);
 typedef int (*mnet_balancer_cb)(void *context, int afd);
 
@@ -85,6 +195,44 @@ int mnet_version();
  */
 int mnet_report(int level);
 
+/* stats snapshot published before each poll, can be read from other
+ * thread without blocking the loop, return 1 for ok
+ */
+int mnet_stats_snapshot(mnet_stats_t *stats);
+
+/* export stats as JSON or Prometheus text, return length or -1 for
+ * buffer too small
+ */
+int mnet_stats_export(const mnet_stats_t *stats, mnet_stats_format_t fmt, char *buf, int len);
+
+/* walk channs for memory accounting, O(channs), return 1 for ok */
+int mnet_mem_report(mnet_mem_t *mem);
+
+/* log bucketed histogram */
+void mnet_hist_reset(mnet_hist_t *h);
+void mnet_hist_record(mnet_hist_t *h, uint64_t value);
+uint64_t mnet_hist_percentile(const mnet_hist_t *h, double percent); /* percent in [0, 100] */
+
+/* loop latency histograms, disabled by default for extra clock reading */
+void mnet_loop_hist_enable(int enable);
+void mnet_loop_hist_reset(void);
+int mnet_loop_hist(mnet_loop_hist_t *hist); /* copy in loop thread, return 1 for ok */
+
+/* report chann and event when user handling blocked loop over threshold,
+ * 0 or NULL to disable
+ */
+void mnet_slow_handler(int64_t threshold_us, mnet_slow_cb cb);
+
+/* binary trace ring for chann events and socket ops, records rounded up to
+ * power of 2, oldest overwritten when full, 0 to disable, return capacity
+ */
+int mnet_trace_enable(int records);
+
+/* write header and records to fd, only write(2) inside, can be called in
+ * signal handler like SIGSEGV or SIGUSR1, return records dumped or -1
+ */
+int mnet_trace_dump(int fd);
+
 /* sync resolve host name, using after init under windows */
 int mnet_resolve(const char *host, int port, chann_type_t ctype, chann_addr_t*);
 
@@ -111,6 +259,8 @@ chann_t* mnet_chann_open(chann_type_t type); /* create chann */
 void mnet_chann_close(chann_t *n);           /* destroy chann */
 
 int mnet_chann_fd(chann_t *n);
+uint64_t mnet_chann_id(chann_t *n);          /* unique in loop, from 1 */
+int64_t mnet_chann_mem(chann_t *n);          /* bytes allocated by core for chann */
 chann_type_t mnet_chann_type(chann_t *n);
 
 int mnet_chann_listen(chann_t *n, const char *host, int port, int backlog);
@@ -126,6 +276,19 @@ void* mnet_chann_get_opaque(chann_t *n); /* user defined data in chann */
  */
 void mnet_chann_active_event(chann_t *n, chann_event_t et, int64_t value);
 
+/* coarse timeout in 100ms ticks without timer for each chann, 0 to disable,
+ * emit CHANN_EVENT_DISCONNECT with MNET_ERR_CONNECT_TIMEOUT when not connected
+ * (or ext handshake not finished) in connect_ms, or MNET_ERR_IDLE_TIMEOUT
+ * without recv/send in idle_ms, accepted chann inherit from listen chann
+ */
+void mnet_chann_set_timeout(chann_t *n, int connect_ms, int idle_ms);
+
+/* slowloris guard, emit CHANN_EVENT_DISCONNECT with MNET_ERR_RECV_RATE when
+ * peer sent data but less than min_bytes in window_ms, 0 to disable, accepted
+ * chann inherit from listen chann
+ */
+void mnet_chann_set_recv_rate(chann_t *n, int min_bytes, int window_ms);
+
 /* send/recv data, return -1 for error */
 int mnet_chann_recv(chann_t *n, void *buf, int len);
 int mnet_chann_send(chann_t *n, void *buf, int len); /* send will always cached would blocked data */
@@ -134,6 +297,41 @@ int mnet_chann_send(chann_t *n, void *buf, int len); /* send will always cached
 int mnet_dgram_recv(chann_t*, chann_addr_t *addr_in, void *buf, int len);
 int mnet_dgram_send(chann_t*, chann_addr_t *addr_out, void *buf, int len);
 
+/* DGRAM send/recv with binary address, skip string address convertion
+ */
+int mnet_dgram_recvfrom(chann_t*, chann_sockaddr_t *addr_in, void *buf, int len);
+int mnet_dgram_sendto(chann_t*, const chann_sockaddr_t *addr_out, void *buf, int len);
+
+/* connected DGRAM for fixed peer, then send/recv without address, also
+ * mnet_chann_send/mnet_chann_recv, return 1 for ok
+ */
+int mnet_dgram_connect(chann_t*, const chann_sockaddr_t *peer);
+
+/* DGRAM segmentation offload, send equal size datagrams to the same peer, using
+ * UDP_SEGMENT (GSO) under Linux, fallback to send each segment, return bytes sended
+ */
+int mnet_dgram_send_segments(chann_t*, const chann_sockaddr_t *addr_out, void *buf, int len, int seg_size);
+
+/* enable UDP_GRO after listen/connect, return 1 for kernel support */
+int mnet_dgram_set_gro(chann_t*, int enable);
+
+#define MNET_DGRAM_GRO_SEGS 64  /* max datagrams coalesced by UDP_GRO */
+
+/* recv coalesced datagrams into buf, split into views point to each datagram,
+ * return views count, 0 for would block, -1 for error, single datagram without GRO,
+ * with GRO enabled cnt less than MNET_DGRAM_GRO_SEGS refused with errno EINVAL,
+ * -1 with errno EMSGSIZE for datagrams truncated by short len under Linux, chann kept
+ */
+int mnet_dgram_recv_segments(chann_t*, void *buf, int len, chann_dgram_t *views, int cnt);
+
+/* DGRAM batch send/recv, return datagram count, 0 for would block, -1 for error,
+ * using recvmmsg/sendmmsg under Linux, drain datagrams as much as cnt in one RECV event,
+ * send stops before entry without peer address on unconnected chann or length over
+ * 65507, -1 with errno EINVAL for first one, chann kept
+ */
+int mnet_dgram_recv_batch(chann_t*, chann_dgram_t *msgs, int cnt);
+int mnet_dgram_send_batch(chann_t*, chann_dgram_t *msgs, int cnt);
+
 /* cached bytes not send
  */
 int mnet_chann_cached(chann_t *n);
@@ -152,10 +350,19 @@ int mnet_chann_socket_set_bufsize(chann_t *n, int bufsize); /* before listen/con
 int64_t mnet_tm_current(void); /* micro seconds */
 int mnet_parse_ipport(const char *ipport, chann_addr_t *addr);
 
+/* binary address from IPv4/IPv6 string, return 1 for ok */
+int mnet_sockaddr_set(chann_sockaddr_t *sa, const char *ip, int port);
+/* compare binary address, return 1 for equal */
+int mnet_sockaddr_equal(const chann_sockaddr_t *a, const chann_sockaddr_t *b);
+/* 'ip:port' or '[ipv6]:port' string for logging, return string length */
+int mnet_sockaddr_string(const chann_sockaddr_t *sa, char *buf, int len);
+
 /* Extension Interface
  *
  * mnet extension was a external defined chann_type_t build on top of
- * internal chann_type_t as STREAM/DGRAM/BROADCAST
+ * internal chann_type_t as STREAM/DGRAM/BROADCAST, or stacked on another
+ * registered ext as its lower layer, like stream -> TLS -> framing -> app,
+ * ext read/write chann fd itself like TLS only over internal chann_type_t
  */
 
 /* type/msg/operation/state/data handler
@@ -165,6 +372,7 @@ typedef int (*mnet_ext_chann_msg_filter)(void *ext_ctx, chann_msg_t *msg); /* re
 typedef void (*mnet_ext_chann_op_cb)(void *ext_ctx, chann_t *n); /* open/close/listen/accept/connect/disconnect */
 typedef int (*mnet_ext_chann_state_wrapper)(void *ext_ctx, chann_t *n, int state); /* wrapper state */
 typedef int (*mnet_ext_chann_data_wrapper)(void *ext_ctx, chann_t *n, void *buf, int len); /* wrapper recv/send */
+typedef int (*mnet_ext_chann_data_flush)(void *ext_ctx, chann_t *n); /* 1 for flushed, 0 for blocked, <0 for error */
 
 /* context for ext chann_type_t
  */
@@ -182,20 +390,61 @@ typedef struct {
    mnet_ext_chann_state_wrapper state_fn; /* actual state, NOT NULL */
    mnet_ext_chann_data_wrapper recv_fn;   /* internal recv, <0 for error, NOT NULL */
    mnet_ext_chann_data_wrapper send_fn;   /* internal send, <0 for error, NOT NULL */
+   mnet_ext_chann_data_flush flush_fn;    /* send ext buffered data, can be NULL */
+   chann_type_t lower;                    /* registered ext below, 0 for internal chann_type_t */
 } mnet_ext_t;
 
 /* register chann ext type
- * ctype: chan extension type between (CHANN_TYPE_BROADCAST, 7]
+ * ctype: chan extension type above CHANN_TYPE_BROADCAST
  * ext: extension config, will be copied
+ *
+ * with lower layer, open/listen/accept/connect callbacks, state_fn and
+ * filter_fn run from lowest layer up, disconnect/close callbacks and
+ * flush_fn from top layer down, recv_fn/send_fn only for top layer
  */
 int mnet_ext_register(chann_type_t ctype, mnet_ext_t *ext);
 
-/* set extension userdata for chann */
+/* set extension userdata for chann, of layer in dispatching or top layer */
 void mnet_ext_chann_set_ud(chann_t *n, void *ext_ud);
 
-/* get extension userdata for chann */
+/* get extension userdata for chann, of layer in dispatching or top layer */
 void* mnet_ext_chann_get_ud(chann_t *n);
 
+/* get extension userdata of ctype layer for chann, from any thread */
+void* mnet_ext_chann_layer_ud(chann_t *n, chann_type_t ctype);
+
+/* recv/send through layer below the one in dispatching, buffer passed
+ * down without copy, lowest layer reach raw socket, same return as recv_fn/send_fn
+ */
+int mnet_ext_lower_recv(chann_t *n, void *buf, int len);
+int mnet_ext_lower_send(chann_t *n, void *buf, int len);
+
+/* ext buffered data not from fd, like decrypted records, mark after each
+ * recv_fn, CHANN_EVENT_RECV emitted after fd events, and next poll not wait,
+ * marked for each layer
+ */
+void mnet_ext_chann_pending(chann_t *n, int pending);
+
+/* ext buffered send data, like coalesced records, flush_fn called before
+ * next poll wait, and in writable event when blocked
+ */
+void mnet_ext_chann_flush(chann_t *n);
+
+/* stop or resume read events for chann in loop thread, peer close or error
+ * not reported while paused without write events, but right after resumed
+ */
+void mnet_ext_chann_pause(chann_t *n, int pause);
+
+/* create wakeup pipe in loop thread before mnet_ext_chann_wakeup(), return 1
+ * for ok, not support Windows
+ */
+int mnet_ext_wakeup_init(void);
+
+/* thread safe, wake up mnet_poll() and emit CHANN_EVENT_RECV for chann like
+ * pending data, chann should not be closed before wakeup returned
+ */
+void mnet_ext_chann_wakeup(chann_t *n);
+
 #ifdef __cplusplus
 }
 #endif
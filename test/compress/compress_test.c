@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef MNET_COMPRESS_TEST_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+#include "mnet_compress.h"
+
+/* client send text lines in chunks, server echo back, client level 6 with
+ * flush in dispatch pass, server flush each send, second round with pooled
+ * contexts, and client send zstd in last round when built with zstd, then
+ * raw stream peer send complete zlib streams, server recv each just fit
+ */
+
+#define kDataSize (4 * 1024 * 1024)
+#define kChunkSize (64 * 1024)
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+#define kRounds 3
+#else
+#define kRounds 2
+#endif
+#define kTestSeconds 10
+#define kEndSize 1000           // plain bytes in each complete zlib stream
+
+typedef struct {
+   int failed;
+   int round;
+   int sended;
+   int recved;
+   chann_t *svr;
+   chann_t *cnt;
+   chann_t *acc;
+   chann_addr_t addr;
+   uint8_t *data;
+} ctx_t;
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("%s FAILED\n", what);
+      ctx->failed += 1;
+   }
+}
+
+static void
+_data_init(ctx_t *ctx) {
+   ctx->data = malloc(kDataSize + 128);
+   int len = 0;
+   for (int i=0; len<kDataSize; i++) {
+      len += sprintf((char *)ctx->data + len, "line %d, stream compress over mnet chann\n", i);
+   }
+}
+
+static void
+_cnt_send(ctx_t *ctx, chann_t *n) {
+   if (ctx->sended < kDataSize) {
+      int len = kDataSize - ctx->sended < kChunkSize ? kDataSize - ctx->sended : kChunkSize;
+      _expect(ctx, mnet_chann_send(n, ctx->data + ctx->sended, len) == len, "send chunk");
+      ctx->sended += len;
+   } else {
+      mnet_chann_active_event(n, CHANN_EVENT_SEND, 0);
+   }
+}
+
+static void
+_on_msg(ctx_t *ctx, chann_msg_t *msg) {
+   static uint8_t buf[kChunkSize];
+   if (msg->n == ctx->svr) {
+      if (msg->event == CHANN_EVENT_ACCEPT) {
+         ctx->acc = msg->r;
+         _expect(ctx, mnet_compress_chann_option(ctx->acc, MNET_COMPRESS_OPT_FLUSH, MNET_COMPRESS_FLUSH_SEND), "server flush policy");
+      }
+   } else if (msg->n == ctx->cnt) {
+      if (msg->event == CHANN_EVENT_CONNECTED) {
+#ifdef MNET_COMPRESS_HAVE_ZSTD
+         if (ctx->round == kRounds - 1) {
+            _expect(ctx, mnet_compress_chann_option(msg->n, MNET_COMPRESS_OPT_ALGO, MNET_COMPRESS_ZSTD), "client zstd");
+         }
+#endif
+         _expect(ctx, mnet_compress_chann_option(msg->n, MNET_COMPRESS_OPT_LEVEL, 6), "client level");
+         mnet_chann_active_event(msg->n, CHANN_EVENT_SEND, 1);
+         _cnt_send(ctx, msg->n);
+      } else if (msg->event == CHANN_EVENT_SEND) {
+         _cnt_send(ctx, msg->n);
+      } else if (msg->event == CHANN_EVENT_RECV) {
+         int ret = mnet_chann_recv(msg->n, buf, sizeof(buf));
+         if (ret > 0) {
+            _expect(ctx, ctx->recved + ret <= kDataSize, "data size");
+            _expect(ctx, memcmp(buf, ctx->data + ctx->recved, ret) == 0, "data order");
+            ctx->recved += ret;
+         }
+      } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+         _expect(ctx, 0, "client disconnect");
+      }
+   } else if (msg->event == CHANN_EVENT_RECV) {
+      int ret = mnet_chann_recv(msg->n, buf, sizeof(buf));
+      if (ret > 0) {
+         mnet_chann_send(msg->n, buf, ret);
+      }
+   }
+}
+
+static void
+_run_round(ctx_t *ctx) {
+   ctx->sended = ctx->recved = 0;
+   ctx->acc = NULL;
+   ctx->cnt = mnet_chann_open(CHANN_TYPE_COMPRESS);
+   mnet_chann_connect(ctx->cnt, ctx->addr.ip, ctx->addr.port);
+
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (ctx->recved < kDataSize && mnet_tm_current() < deadline) {
+      if (mnet_poll(1000) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         _on_msg(ctx, msg);
+      }
+   }
+   _expect(ctx, ctx->recved == kDataSize, "all data echoed");
+   mnet_chann_close(ctx->cnt);
+   if (ctx->acc) {
+      mnet_chann_close(ctx->acc);
+   }
+}
+
+/* next stream detected after one ended with output buffer full */
+static void
+_run_stream_end(ctx_t *ctx) {
+   uint8_t zbuf[2][kEndSize + 64];
+   uLongf zlen[2];
+   for (int i=0; i<2; i++) {
+      zlen[i] = sizeof(zbuf[i]);
+      _expect(ctx, compress2(zbuf[i], &zlen[i], ctx->data + i * kEndSize, kEndSize, 6) == Z_OK, "zlib stream");
+   }
+   ctx->acc = NULL;
+   chann_t *cnt = mnet_chann_open(CHANN_TYPE_STREAM);
+   mnet_chann_connect(cnt, ctx->addr.ip, ctx->addr.port);
+
+   int streams = 0, recved = 0, failed = 0;
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (streams < 2 && !failed && mnet_tm_current() < deadline) {
+      if (mnet_poll(100) < 0) {
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->n == cnt && msg->event == CHANN_EVENT_CONNECTED) {
+            mnet_chann_send(cnt, zbuf[0], (int)zlen[0]);
+         } else if (msg->n == ctx->svr && msg->event == CHANN_EVENT_ACCEPT) {
+            ctx->acc = msg->r;
+         } else if (msg->n == ctx->acc && msg->event == CHANN_EVENT_RECV) {
+            uint8_t buf[kEndSize];
+            int ret = mnet_chann_recv(msg->n, buf, kEndSize - recved);
+            if (ret > 0) {
+               _expect(ctx, memcmp(buf, ctx->data + streams * kEndSize + recved, ret) == 0, "stream end data");
+               recved += ret;
+               if (recved >= kEndSize) {
+                  streams += 1;
+                  recved = 0;
+                  if (streams == 1) {
+                     mnet_chann_send(cnt, zbuf[1], (int)zlen[1]);
+                  }
+               }
+            }
+         } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+            failed = 1;
+         }
+      }
+   }
+   _expect(ctx, streams == 2 && !failed, "next stream after stream end");
+   mnet_chann_close(cnt);
+   if (ctx->acc) {
+      mnet_chann_close(ctx->acc);
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   if (mnet_parse_ipport(argc > 1 ? argv[1] : "127.0.0.1:8099", &ctx.addr) <= 0) {
+      printf("%s: [ip:port]\n", argv[0]);
+      return 0;
+   }
+   _data_init(&ctx);
+
+   mnet_init();
+   _expect(&ctx, mnet_compress_config(0), "config over stream");
+   _expect(&ctx, mnet_compress_config(0), "config again");
+   _expect(&ctx, !mnet_compress_option(MNET_COMPRESS_OPT_FLUSH, 9), "reject flush policy");
+
+   ctx.svr = mnet_chann_open(CHANN_TYPE_COMPRESS);
+   if (!mnet_chann_listen(ctx.svr, ctx.addr.ip, ctx.addr.port, 16)) {
+      printf("fail to listen %s:%d\n", ctx.addr.ip, ctx.addr.port);
+      return 1;
+   }
+
+   int64_t begin = mnet_tm_current();
+   for (ctx.round=0; ctx.round<kRounds; ctx.round++) {
+      _run_round(&ctx);
+   }
+   int64_t elapsed = mnet_tm_current() - begin;
+
+   mnet_compress_stats_t st;
+   mnet_compress_stats(&st);
+   printf("plain %llu, compressed %llu, flushes %llu, pool hits %llu, %.1f MB/s\n",
+          (unsigned long long)st.send_plain, (unsigned long long)st.send_bytes,
+          (unsigned long long)st.flushes, (unsigned long long)st.pool_hits,
+          (double)st.send_plain / (elapsed > 0 ? elapsed : 1));
+   _expect(&ctx, st.send_plain == 2ULL * kRounds * kDataSize, "plain bytes");
+   _expect(&ctx, st.recv_plain == st.send_plain, "recv plain bytes");
+   _expect(&ctx, st.recv_bytes == st.send_bytes, "compressed bytes");
+   _expect(&ctx, st.send_bytes < st.send_plain / 2, "compressed size");
+   _expect(&ctx, st.pool_hits >= 1, "pooled contexts");
+   _run_stream_end(&ctx);
+
+   mnet_chann_close(ctx.svr);
+   mnet_fini();
+   mnet_compress_option(MNET_COMPRESS_OPT_POOL, 0);
+   free(ctx.data);
+
+   printf("compress test %s, %d failed\n", ctx.failed ? "FAILED" : "passed", ctx.failed);
+   return ctx.failed ? 1 : 0;
+}
+
+#endif  /* MNET_COMPRESS_TEST_C */
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_DGRAM_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "mnet_core.h"
+
+#define kDgramSize 512
+#define kBatchCount 32          // datagrams in each round
+#define kRoundCount 1000        // rounds client send batch and wait echo back
+#define kGroBufSize 64*1024     // buffer for coalesced datagrams
+#define kIdleMs 50              // idle timeout with only batch/segments traffic
+
+typedef struct {
+   int round;
+   int recved;                  // echo back count in current round
+   uint8_t mark[kBatchCount];   // echo back mark in current round
+   uint8_t buf[kBatchCount][kDgramSize];
+   chann_dgram_t views[MNET_DGRAM_GRO_SEGS];
+   uint8_t gro_buf[kGroBufSize];
+} ctx_t;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [-s|-c] [ip:port]\n", argv[0]);
+}
+
+static void
+_fill_dgram(uint8_t *buf, int round, int idx) {
+   buf[0] = idx;
+   for (int i=1; i<kDgramSize; i++) {
+      buf[i] = (round + idx + i) & 0xff;
+   }
+}
+
+static int
+_check_dgram(uint8_t *buf, int len, int round) {
+   if (len != kDgramSize || buf[0] >= kBatchCount) {
+      return -1;
+   }
+   int idx = buf[0];
+   for (int i=1; i<kDgramSize; i++) {
+      if (buf[i] != ((round + idx + i) & 0xff)) {
+         return -1;
+      }
+   }
+   return idx;
+}
+
+static void
+_client_send_round(chann_t *n, ctx_t *ctx, chann_sockaddr_t *addr) {
+   // equal size datagrams in continuous buffer, send with segmentation offload
+   for (int i=0; i<kBatchCount; i++) {
+      _fill_dgram(ctx->buf[i], ctx->round, i);
+   }
+   int len = kBatchCount * kDgramSize;
+   int ret = mnet_dgram_send_segments(n, addr, ctx->buf, len, kDgramSize);
+   if (ret != len) {
+      printf("c send segments %d of %d\n", ret, len);
+   }
+}
+
+/* bad entry stops batch on unconnected chann, chann not disconnected */
+static int
+_client_send_invalid(ctx_t *ctx, chann_sockaddr_t *addr) {
+   chann_t *n = mnet_chann_open(CHANN_TYPE_DGRAM);
+   chann_dgram_t msgs[3];
+   memset(msgs, 0, sizeof(msgs));
+   for (int i=0; i<3; i++) {
+      _fill_dgram(ctx->buf[i], 0, i);
+      msgs[i].buf = ctx->buf[i];
+      msgs[i].len = kDgramSize;
+      msgs[i].addr = *addr;
+   }
+   msgs[1].addr.len = 0;
+   int ok = mnet_dgram_send_batch(n, msgs, 3) == 1;
+   msgs[0].len = kGroBufSize;
+   ok = ok && mnet_dgram_send_batch(n, msgs, 3) == -1 && errno == EINVAL;
+   ok = ok && mnet_chann_state(n) == CHANN_STATE_CONNECTED;
+   mnet_chann_close(n);
+   return ok;
+}
+
+static void
+_as_client(chann_addr_t *addr) {
+   chann_t *cnt = mnet_chann_open(CHANN_TYPE_DGRAM);
+
+   ctx_t *ctx = calloc(1, sizeof(ctx_t));
+
+   // binary address converted once, then connected to fixed peer
+   chann_sockaddr_t sa;
+   char sa_str[64];
+   mnet_sockaddr_set(&sa, addr->ip, addr->port);
+   mnet_sockaddr_string(&sa, sa_str, sizeof(sa_str));
+   if (!mnet_dgram_connect(cnt, &sa)) {
+      printf("c fail to connect %s\n", sa_str);
+      free(ctx);
+      return;
+   }
+   printf("c connect %s\n", sa_str);
+   if (!_client_send_invalid(ctx, &sa)) {
+      printf("c invalid batch entry not refused\n");
+   }
+   mnet_chann_set_timeout(cnt, 0, kIdleMs);
+
+   _client_send_round(cnt, ctx, &sa);
+   mnet_chann_active_event(cnt, CHANN_EVENT_TIMER, MNET_MILLI_SECOND);
+
+   for (;;) {
+
+      if (mnet_poll(MNET_MILLI_SECOND) <= 0) {
+         break;
+      }
+
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+
+         if (msg->event == CHANN_EVENT_TIMER) {
+            // resend lost datagrams in this round
+            printf("c round %d timeout, recved %d\n", ctx->round, ctx->recved);
+            _client_send_round(msg->n, ctx, &sa);
+         }
+
+         if (msg->event == CHANN_EVENT_RECV) {
+            uint8_t buf[kBatchCount][kDgramSize];
+            chann_dgram_t msgs[kBatchCount];
+            for (int i=0; i<kBatchCount; i++) {
+               msgs[i].buf = buf[i];
+               msgs[i].size = kDgramSize;
+            }
+            int ret = mnet_dgram_recv_batch(msg->n, msgs, kBatchCount);
+            for (int i=0; i<ret; i++) {
+               int idx = _check_dgram(msgs[i].buf, msgs[i].len, ctx->round);
+               if (!mnet_sockaddr_equal(&msgs[i].addr, &sa)) {
+                  printf("c recv datagram from invalid address\n");
+               } else if (idx >= 0 && !ctx->mark[idx]) {
+                  ctx->mark[idx] = 1;
+                  ctx->recved += 1;
+               }
+            }
+            if (ctx->recved >= kBatchCount) {
+               ctx->round += 1;
+               ctx->recved = 0;
+               memset(ctx->mark, 0, sizeof(ctx->mark));
+               if (ctx->round >= kRoundCount) {
+                  printf("c recved %d rounds, %d bytes\n", ctx->round,
+                         (int)mnet_chann_bytes(msg->n, 0));
+                  mnet_chann_close(msg->n);
+                  break;
+               }
+               _client_send_round(msg->n, ctx, &sa);
+               mnet_chann_active_event(msg->n, CHANN_EVENT_TIMER, MNET_MILLI_SECOND);
+            }
+         }
+
+         if (msg->event == CHANN_EVENT_DISCONNECT) {
+            printf("c disconnect with errno %d\n", msg->err);
+            mnet_chann_close(msg->n);
+         }
+      }
+   }
+
+   free(ctx);
+}
+
+static void
+_as_server(chann_addr_t *addr) {
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_DGRAM);
+   mnet_chann_listen(svr, addr->ip, addr->port, 1);
+   printf("svr listen %s:%d\n", addr->ip, addr->port);
+
+   int gro = mnet_dgram_set_gro(svr, 1);
+   printf("svr enable GRO: %d\n", gro);
+
+   ctx_t *ctx = calloc(1, sizeof(ctx_t));
+
+   for (;;) {
+
+      if (mnet_poll(MNET_MILLI_SECOND) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->event == CHANN_EVENT_RECV) {
+            // split coalesced datagrams, echo back to each source
+            int ret = 0;
+            while ((ret = mnet_dgram_recv_segments(msg->n, ctx->gro_buf, kGroBufSize, ctx->views, MNET_DGRAM_GRO_SEGS)) > 0) {
+               mnet_dgram_send_batch(msg->n, ctx->views, ret);
+            }
+            if (ret < 0) {
+               printf("svr recv segments errno %d\n", errno);
+            }
+         }
+      }
+   }
+
+   free(ctx);
+}
+
+int
+main(int argc, char *argv[]) {
+   if (argc < 2) {
+      _print_help(argv);
+      return 0;
+   }
+
+   char *option = argv[1];
+   char *ipport = argc > 2 ? argv[2] : "127.0.0.1:8090";
+
+   chann_addr_t addr;
+   if (mnet_parse_ipport(ipport, &addr) <= 0) {
+      _print_help(argv);
+      return 0;
+   }
+
+   mnet_init();
+
+   if (strcmp(option, "-s") == 0) {
+      _as_server(&addr);
+   } else if (strcmp(option, "-c") == 0) {
+      _as_client(&addr);
+   } else {
+      _print_help(argv);
+      return 0;
+   }
+
+   mnet_fini();
+
+   return 0;
+}
+
+#endif  /* TEST_DGRAM_C */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_HIST_C
+
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "mnet_core.h"
+
+#define kTimerMs 10
+#define kSlowUs 20000           // slow handler threshold
+#define kSleepUs 30000          // blocking in handler
+#define kFireCount 20
+
+typedef struct {
+   int failed;
+   int fired;
+   int slow_count;
+   chann_t *slow_n;
+   chann_event_t slow_event;
+   int64_t slow_us;
+} ctx_t;
+
+static ctx_t g_ctx;
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("%s FAILED\n", what);
+      ctx->failed += 1;
+   }
+}
+
+/* values in range within 1/8 relative error */
+static int
+_near(uint64_t v, uint64_t expect) {
+   uint64_t diff = v > expect ? v - expect : expect - v;
+   return diff * 8 <= expect;
+}
+
+static void
+_test_percentile(ctx_t *ctx) {
+   mnet_hist_t h;
+   mnet_hist_reset(&h);
+   _expect(ctx, mnet_hist_percentile(&h, 50) == 0, "empty percentile");
+
+   for (uint64_t v=1; v<=100000; v++) {
+      mnet_hist_record(&h, v);
+   }
+   _expect(ctx, h.count == 100000 && h.min == 1 && h.max == 100000, "count min max");
+   _expect(ctx, _near(mnet_hist_percentile(&h, 50), 50000), "p50");
+   _expect(ctx, _near(mnet_hist_percentile(&h, 99), 99000), "p99");
+   _expect(ctx, _near(mnet_hist_percentile(&h, 99.9), 99900), "p999");
+   _expect(ctx, mnet_hist_percentile(&h, 0) == 1, "p0");
+   _expect(ctx, mnet_hist_percentile(&h, 100) == 100000, "p100");
+
+   mnet_hist_reset(&h);
+   mnet_hist_record(&h, 3);
+   mnet_hist_record(&h, UINT64_MAX);
+   _expect(ctx, mnet_hist_percentile(&h, 50) == 3, "exact small value");
+   _expect(ctx, h.max == UINT64_MAX && mnet_hist_percentile(&h, 100) >= ((uint64_t)15 << 60), "max value");
+}
+
+static void
+_on_slow(chann_t *n, chann_event_t event, int64_t micro_seconds) {
+   ctx_t *ctx = &g_ctx;
+   ctx->slow_count += 1;
+   ctx->slow_n = n;
+   ctx->slow_event = event;
+   ctx->slow_us = micro_seconds;
+}
+
+static void
+_test_loop(ctx_t *ctx) {
+   mnet_init();
+   mnet_loop_hist_enable(1);
+   mnet_slow_handler(kSlowUs, _on_slow);
+
+   // chann without socket only for timer
+   chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+   mnet_chann_active_event(n, CHANN_EVENT_TIMER, kTimerMs);
+
+   while (ctx->fired < kFireCount) {
+      if (mnet_poll(kTimerMs / 2) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->event == CHANN_EVENT_TIMER) {
+            ctx->fired += 1;
+            if (ctx->fired == kFireCount / 2) {
+               usleep(kSleepUs);
+            }
+         }
+      }
+   }
+   mnet_poll(0);                // report last handler
+
+   mnet_loop_hist_t hist;
+   _expect(ctx, mnet_loop_hist(&hist), "loop hist");
+   _expect(ctx, ctx->slow_count == 1, "slow count");
+   _expect(ctx, ctx->slow_n == n && ctx->slow_event == CHANN_EVENT_TIMER, "slow chann event");
+   _expect(ctx, ctx->slow_us >= kSleepUs, "slow duration");
+   _expect(ctx, hist.poll_block.count >= kFireCount, "poll block count");
+   _expect(ctx, hist.dispatch.count >= kFireCount, "dispatch count");
+   _expect(ctx, hist.dispatch.max >= kSleepUs, "dispatch max");
+   _expect(ctx, hist.timer_late.count == kFireCount, "timer late count");
+   _expect(ctx, hist.poll_events.count == hist.poll_block.count, "poll events count");
+
+   printf("poll block p50 %d us, p99 %d us, dispatch p99 %d us, timer late p50 %d us, max %d us\n",
+          (int)mnet_hist_percentile(&hist.poll_block, 50),
+          (int)mnet_hist_percentile(&hist.poll_block, 99),
+          (int)mnet_hist_percentile(&hist.dispatch, 99),
+          (int)mnet_hist_percentile(&hist.timer_late, 50),
+          (int)hist.timer_late.max);
+
+   // memory accounting for timer chann
+   mnet_mem_t mem;
+   _expect(ctx, mnet_mem_report(&mem), "mem report");
+   _expect(ctx, mem.channs == 1 && mem.timer_bytes > 0 && mem.send_cache_bytes == 0, "mem channs");
+   _expect(ctx, mnet_chann_mem(n) == mem.chann_bytes + mem.timer_bytes, "chann mem");
+   _expect(ctx, mem.total_bytes == mem.chann_bytes + mem.timer_bytes + mem.loop_bytes, "mem total");
+
+   mnet_loop_hist_reset();
+   mnet_loop_hist(&hist);
+   _expect(ctx, hist.poll_block.count == 0 && hist.timer_late.count == 0, "loop hist reset");
+
+   mnet_fini();
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t *ctx = &g_ctx;
+
+   _test_percentile(ctx);
+   _test_loop(ctx);
+
+   printf("hist test %s, %d failed\n", ctx->failed ? "FAILED" : "passed", ctx->failed);
+   return ctx->failed ? 1 : 0;
+}
+
+#endif  /* TEST_HIST_C */
@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_LAYER_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnet_core.h"
+
+/* stream -> xor -> frame -> app, xor layer on raw socket with lower
+ * recv/send, frame layer buffered recv with pending mark and buffered send
+ * with flush, each layer with its own ud
+ */
+
+#define kDataSize 4000
+#define kReadSize 10            // user read size
+#define kKey 0x5a
+#define kTestSeconds 5
+
+static chann_type_t const CHANN_TYPE_XOR = 100;
+static chann_type_t const CHANN_TYPE_FRAME = 200;
+static chann_type_t const CHANN_TYPE_NONE = 300;
+
+typedef struct {
+   char tag;
+   int len;
+   int pos;
+   int slen;
+   uint8_t buf[kDataSize];
+   uint8_t sbuf[kDataSize];
+} layer_ud_t;
+
+typedef struct {
+   int failed;
+   int recved;
+   int sended;
+   int xor_bytes;               // bytes passed xor layer
+   int flushes;
+   char ops[64];                // client op callbacks order, upper case for frame
+   int ops_count;
+   chann_t *svr;
+   chann_t *cnt;
+   chann_t *acc;
+   chann_addr_t addr;
+} ctx_t;
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("%s FAILED\n", what);
+      ctx->failed += 1;
+   }
+}
+
+static void
+_op(ctx_t *ctx, chann_t *n, char op) {
+   if ((ctx->cnt == NULL || n == ctx->cnt) && ctx->ops_count < (int)sizeof(ctx->ops) - 1) {
+      ctx->ops[ctx->ops_count++] = op;
+   }
+}
+
+static int
+_type_fn(void *ext_ctx, chann_type_t ctype) {
+   return CHANN_TYPE_STREAM;
+}
+
+static int
+_filter_fn(void *ext_ctx, chann_msg_t *msg) {
+   return 1;
+}
+
+static int
+_state_fn(void *ext_ctx, chann_t *n, int state) {
+   return state;
+}
+
+static void
+_ud_new(chann_t *n, char tag) {
+   layer_ud_t *ud = calloc(1, sizeof(layer_ud_t));
+   ud->tag = tag;
+   mnet_ext_chann_set_ud(n, ud);
+}
+
+static void
+_ud_free(chann_t *n) {
+   free(mnet_ext_chann_get_ud(n));
+   mnet_ext_chann_set_ud(n, NULL);
+}
+
+static int
+_ud_is(chann_t *n, char tag) {
+   layer_ud_t *ud = mnet_ext_chann_get_ud(n);
+   return ud && ud->tag == tag;
+}
+
+/* xor layer */
+
+static void
+_xor_open_cb(void *ext_ctx, chann_t *n) {
+   _ud_new(n, 'x');
+   _op(ext_ctx, n, 'o');
+}
+
+static void
+_xor_close_cb(void *ext_ctx, chann_t *n) {
+   _expect(ext_ctx, _ud_is(n, 'x'), "xor ud in close");
+   _op(ext_ctx, n, 'c');
+   _ud_free(n);
+}
+
+static void
+_xor_connect_cb(void *ext_ctx, chann_t *n) {
+   _op(ext_ctx, n, 'n');
+}
+
+static void
+_xor_disconnect_cb(void *ext_ctx, chann_t *n) {
+   _op(ext_ctx, n, 'd');
+}
+
+static void
+_xor_listen_cb(void *ext_ctx, chann_t *n) {
+}
+
+static void
+_xor_accept_cb(void *ext_ctx, chann_t *n) {
+   _ud_new(n, 'x');
+}
+
+static int
+_xor_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   ctx_t *ctx = ext_ctx;
+   _expect(ctx, _ud_is(n, 'x'), "xor ud in recv");
+   int ret = mnet_ext_lower_recv(n, buf, len);
+   for (int i=0; i<ret; i++) {
+      ((uint8_t *)buf)[i] ^= kKey;
+   }
+   ctx->xor_bytes += ret > 0 ? ret : 0;
+   return ret;
+}
+
+static int
+_xor_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   ctx_t *ctx = ext_ctx;
+   uint8_t data[kDataSize];
+   len = len < kDataSize ? len : kDataSize;
+   for (int i=0; i<len; i++) {
+      data[i] = ((uint8_t *)buf)[i] ^ kKey;
+   }
+   int ret = mnet_ext_lower_send(n, data, len);
+   ctx->xor_bytes += ret > 0 ? ret : 0;
+   return ret;
+}
+
+/* frame layer */
+
+static void
+_frame_open_cb(void *ext_ctx, chann_t *n) {
+   _ud_new(n, 'f');
+   _op(ext_ctx, n, 'O');
+}
+
+static void
+_frame_close_cb(void *ext_ctx, chann_t *n) {
+   _expect(ext_ctx, _ud_is(n, 'f'), "frame ud in close");
+   _op(ext_ctx, n, 'C');
+   _ud_free(n);
+}
+
+static void
+_frame_connect_cb(void *ext_ctx, chann_t *n) {
+   _op(ext_ctx, n, 'N');
+}
+
+static void
+_frame_disconnect_cb(void *ext_ctx, chann_t *n) {
+   _op(ext_ctx, n, 'D');
+}
+
+static void
+_frame_listen_cb(void *ext_ctx, chann_t *n) {
+}
+
+static void
+_frame_accept_cb(void *ext_ctx, chann_t *n) {
+   _expect(ext_ctx, mnet_ext_chann_layer_ud(n, CHANN_TYPE_XOR) != NULL, "xor accepted first");
+   _ud_new(n, 'f');
+}
+
+static int
+_frame_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   layer_ud_t *ud = mnet_ext_chann_get_ud(n);
+   _expect(ext_ctx, ud->tag == 'f', "frame ud in recv");
+   if (ud->pos >= ud->len) {
+      int ret = mnet_ext_lower_recv(n, ud->buf, kDataSize);
+      if (ret <= 0) {
+         return ret;
+      }
+      ud->len = ret;
+      ud->pos = 0;
+   }
+   int count = ud->len - ud->pos < len ? ud->len - ud->pos : len;
+   memcpy(buf, ud->buf + ud->pos, count);
+   ud->pos += count;
+   mnet_ext_chann_pending(n, ud->pos < ud->len);
+   return count;
+}
+
+static int
+_frame_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   layer_ud_t *ud = mnet_ext_chann_get_ud(n);
+   int count = kDataSize - ud->slen < len ? kDataSize - ud->slen : len;
+   memcpy(ud->sbuf + ud->slen, buf, count);
+   ud->slen += count;
+   mnet_ext_chann_flush(n);
+   return count;
+}
+
+static int
+_frame_flush_fn(void *ext_ctx, chann_t *n) {
+   ctx_t *ctx = ext_ctx;
+   layer_ud_t *ud = mnet_ext_chann_get_ud(n);
+   _expect(ctx, ud->tag == 'f', "frame ud in flush");
+   if (ud->slen <= 0) {
+      return 1;
+   }
+   int ret = mnet_ext_lower_send(n, ud->sbuf, ud->slen);
+   if (ret < 0) {
+      return ret;
+   }
+   memmove(ud->sbuf, ud->sbuf + ret, ud->slen - ret);
+   ud->slen -= ret;
+   ctx->flushes += 1;
+   return ud->slen <= 0;
+}
+
+static void
+_on_msg(ctx_t *ctx, chann_msg_t *msg) {
+   uint8_t buf[kDataSize];
+   if (msg->n == ctx->svr) {
+      if (msg->event == CHANN_EVENT_ACCEPT && ctx->acc == NULL) {
+         ctx->acc = msg->r;
+      }
+   } else if (msg->n == ctx->cnt) {
+      if (msg->event == CHANN_EVENT_CONNECTED) {
+         for (int i=0; i<kDataSize; i++) {
+            buf[i] = i & 0xff;
+         }
+         // several sends coalesced in frame layer, flushed before poll wait
+         for (int i=0; i<kDataSize; i+=kDataSize/4) {
+            ctx->sended += mnet_chann_send(msg->n, buf + i, kDataSize/4);
+         }
+      }
+   } else if (msg->event == CHANN_EVENT_RECV) {
+      int ret = mnet_chann_recv(msg->n, buf, kReadSize);
+      for (int i=0; i<ret; i++) {
+         _expect(ctx, buf[i] == ((ctx->recved + i) & 0xff), "data order");
+      }
+      ctx->recved += ret > 0 ? ret : 0;
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   if (mnet_parse_ipport(argc > 1 ? argv[1] : "127.0.0.1:8098", &ctx.addr) <= 0) {
+      printf("%s: [ip:port]\n", argv[0]);
+      return 0;
+   }
+
+   mnet_init();
+   mnet_ext_t xor = {
+      .ext_ctx = &ctx,
+      .type_fn = _type_fn,
+      .filter_fn = _filter_fn,
+      .open_cb = _xor_open_cb,
+      .close_cb = _xor_close_cb,
+      .listen_cb = _xor_listen_cb,
+      .accept_cb = _xor_accept_cb,
+      .connect_cb = _xor_connect_cb,
+      .disconnect_cb = _xor_disconnect_cb,
+      .state_fn = _state_fn,
+      .recv_fn = _xor_recv_fn,
+      .send_fn = _xor_send_fn,
+   };
+   mnet_ext_t frame = {
+      .ext_ctx = &ctx,
+      .type_fn = _type_fn,
+      .filter_fn = _filter_fn,
+      .open_cb = _frame_open_cb,
+      .close_cb = _frame_close_cb,
+      .listen_cb = _frame_listen_cb,
+      .accept_cb = _frame_accept_cb,
+      .connect_cb = _frame_connect_cb,
+      .disconnect_cb = _frame_disconnect_cb,
+      .state_fn = _state_fn,
+      .recv_fn = _frame_recv_fn,
+      .send_fn = _frame_send_fn,
+      .flush_fn = _frame_flush_fn,
+      .lower = CHANN_TYPE_NONE,
+   };
+   _expect(&ctx, !mnet_ext_register(CHANN_TYPE_FRAME, &frame), "reject unregistered lower");
+   _expect(&ctx, mnet_ext_register(CHANN_TYPE_XOR, &xor), "register xor");
+   _expect(&ctx, !mnet_ext_register(CHANN_TYPE_XOR, &xor), "reject registered ctype");
+   frame.lower = CHANN_TYPE_XOR;
+   _expect(&ctx, mnet_ext_register(CHANN_TYPE_FRAME, &frame), "register frame over xor");
+
+   ctx.svr = mnet_chann_open(CHANN_TYPE_FRAME);
+   if (!mnet_chann_listen(ctx.svr, ctx.addr.ip, ctx.addr.port, 16)) {
+      printf("fail to listen %s:%d\n", ctx.addr.ip, ctx.addr.port);
+      return 1;
+   }
+   memset(ctx.ops, 0, sizeof(ctx.ops));
+   ctx.ops_count = 0;
+   ctx.cnt = mnet_chann_open(CHANN_TYPE_FRAME);
+   mnet_chann_connect(ctx.cnt, ctx.addr.ip, ctx.addr.port);
+
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (ctx.recved < kDataSize && mnet_tm_current() < deadline) {
+      if (mnet_poll(1000) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         _on_msg(&ctx, msg);
+      }
+   }
+   _expect(&ctx, ctx.sended == kDataSize, "all data sended");
+   _expect(&ctx, ctx.recved == kDataSize, "all data received");
+   _expect(&ctx, ctx.xor_bytes == 2 * kDataSize, "data passed xor layer");
+   _expect(&ctx, ctx.flushes >= 1 && ctx.flushes < 4, "sends coalesced in flush");
+
+   // ud for each layer, top layer outside callbacks
+   layer_ud_t *xud = mnet_ext_chann_layer_ud(ctx.cnt, CHANN_TYPE_XOR);
+   layer_ud_t *fud = mnet_ext_chann_layer_ud(ctx.cnt, CHANN_TYPE_FRAME);
+   _expect(&ctx, xud && xud->tag == 'x', "xor layer ud");
+   _expect(&ctx, fud && fud->tag == 'f', "frame layer ud");
+   _expect(&ctx, mnet_ext_chann_get_ud(ctx.cnt) == fud, "top layer ud");
+   _expect(&ctx, mnet_ext_chann_layer_ud(ctx.cnt, CHANN_TYPE_STREAM) == NULL, "no internal ud");
+
+   mnet_chann_close(ctx.cnt);
+   _expect(&ctx, strcmp(ctx.ops, "oOnNDdCc") == 0, "op callbacks order");
+
+   mnet_fini();
+
+   printf("layer test %s, %d failed\n", ctx.failed ? "FAILED" : "passed", ctx.failed);
+   return ctx.failed ? 1 : 0;
+}
+
+#endif  /* TEST_LAYER_C */
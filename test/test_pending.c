@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_PENDING_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "mnet_core.h"
+
+/* ext buffered whole socket data in first recv, like TLS read ahead, then
+ * serve small reads from buffer with pending mark, no fd readable for them
+ */
+
+#define kDataSize 4000
+#define kReadSize 10            // user read size
+#define kTestSeconds 5
+
+static chann_type_t const CHANN_TYPE_BUFFERED = 5;
+
+typedef struct {
+   int len;
+   int pos;
+   uint8_t buf[kDataSize];
+} ext_ud_t;
+
+typedef struct {
+   int failed;
+   int recved;
+   int events;
+   int closed;                  // closed with pending data
+   chann_t *svr;
+   chann_t *cnt;
+   chann_t *pend;
+   chann_addr_t addr;
+} ctx_t;
+
+static int
+_type_fn(void *ext_ctx, chann_type_t ctype) {
+   return CHANN_TYPE_STREAM;
+}
+
+static int
+_filter_fn(void *ext_ctx, chann_msg_t *msg) {
+   return 1;
+}
+
+static void
+_open_cb(void *ext_ctx, chann_t *n) {
+   mnet_ext_chann_set_ud(n, calloc(1, sizeof(ext_ud_t)));
+}
+
+static void
+_close_cb(void *ext_ctx, chann_t *n) {
+   free(mnet_ext_chann_get_ud(n));
+   mnet_ext_chann_set_ud(n, NULL);
+}
+
+static void
+_op_cb(void *ext_ctx, chann_t *n) {
+}
+
+static void
+_accept_cb(void *ext_ctx, chann_t *n) {
+   _open_cb(ext_ctx, n);
+}
+
+static int
+_state_fn(void *ext_ctx, chann_t *n, int state) {
+   return state;
+}
+
+static int
+_recv_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   ext_ud_t *ud = mnet_ext_chann_get_ud(n);
+   if (ud->pos >= ud->len) {
+      int ret = (int)recv(mnet_chann_fd(n), ud->buf, kDataSize, 0);
+      if (ret <= 0) {
+         return ret;
+      }
+      ud->len = ret;
+      ud->pos = 0;
+   }
+   int count = ud->len - ud->pos < len ? ud->len - ud->pos : len;
+   memcpy(buf, ud->buf + ud->pos, count);
+   ud->pos += count;
+   mnet_ext_chann_pending(n, ud->pos < ud->len);
+   return count;
+}
+
+static int
+_send_fn(void *ext_ctx, chann_t *n, void *buf, int len) {
+   return (int)send(mnet_chann_fd(n), buf, len, 0);
+}
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("%s FAILED\n", what);
+      ctx->failed += 1;
+   }
+}
+
+static void
+_on_msg(ctx_t *ctx, chann_msg_t *msg) {
+   uint8_t buf[kDataSize];
+   if (msg->n == ctx->svr) {
+      if (msg->event == CHANN_EVENT_ACCEPT && ctx->pend == NULL) {
+         ctx->pend = msg->r;
+      }
+   } else if (msg->n == ctx->cnt) {
+      if (msg->event == CHANN_EVENT_CONNECTED) {
+         for (int i=0; i<kDataSize; i++) {
+            buf[i] = i & 0xff;
+         }
+         mnet_chann_send(msg->n, buf, kDataSize);
+      }
+   } else if (msg->event == CHANN_EVENT_RECV) {
+      int ret = mnet_chann_recv(msg->n, buf, kReadSize);
+      for (int i=0; i<ret; i++) {
+         _expect(ctx, buf[i] == ((ctx->recved + i) & 0xff), "data order");
+      }
+      ctx->recved += ret > 0 ? ret : 0;
+      ctx->events += 1;
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   if (mnet_parse_ipport(argc > 1 ? argv[1] : "127.0.0.1:8097", &ctx.addr) <= 0) {
+      printf("%s: [ip:port]\n", argv[0]);
+      return 0;
+   }
+
+   mnet_init();
+   mnet_ext_t ext = {
+      .type_fn = _type_fn,
+      .filter_fn = _filter_fn,
+      .open_cb = _open_cb,
+      .close_cb = _close_cb,
+      .listen_cb = _op_cb,
+      .accept_cb = _accept_cb,
+      .connect_cb = _op_cb,
+      .disconnect_cb = _op_cb,
+      .state_fn = _state_fn,
+      .recv_fn = _recv_fn,
+      .send_fn = _send_fn,
+   };
+   _expect(&ctx, mnet_ext_register(CHANN_TYPE_BUFFERED, &ext), "register ext");
+
+   ctx.svr = mnet_chann_open(CHANN_TYPE_BUFFERED);
+   if (!mnet_chann_listen(ctx.svr, ctx.addr.ip, ctx.addr.port, 16)) {
+      printf("fail to listen %s:%d\n", ctx.addr.ip, ctx.addr.port);
+      return 1;
+   }
+   ctx.cnt = mnet_chann_open(CHANN_TYPE_BUFFERED);
+   mnet_chann_connect(ctx.cnt, ctx.addr.ip, ctx.addr.port);
+
+   // drained from ext buffer, long poll timeout not wait for pending
+   int64_t begin = mnet_tm_current();
+   int64_t deadline = begin + kTestSeconds * 1000 * 1000;
+   while (ctx.recved < kDataSize && mnet_tm_current() < deadline) {
+      if (mnet_poll(1000) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         _on_msg(&ctx, msg);
+      }
+   }
+   int64_t elapsed = mnet_tm_current() - begin;
+   _expect(&ctx, ctx.recved == kDataSize, "all data received");
+   _expect(&ctx, ctx.events >= kDataSize / kReadSize, "RECV for each read");
+   _expect(&ctx, elapsed < 900 * 1000, "poll not wait with pending data");
+
+   // close chann with pending data, destroyed in next poll
+   mnet_chann_send(ctx.cnt, "abcdefghijklmnopqrstuvwxyz", 26);
+   for (int i=0; i<100 && ctx.pend && !ctx.closed; i++) {
+      mnet_poll(10);
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->n == ctx.pend && msg->event == CHANN_EVENT_RECV && !ctx.closed) {
+            uint8_t buf[kReadSize];
+            mnet_chann_recv(msg->n, buf, kReadSize);
+            mnet_chann_close(msg->n);
+            ctx.closed = 1;
+         }
+      }
+   }
+   _expect(&ctx, ctx.closed, "close with pending");
+   for (int i=0; i<3; i++) {
+      mnet_poll(10);
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         _expect(&ctx, msg->n != ctx.pend, "no event after close");
+      }
+   }
+
+   mnet_fini();
+
+   printf("pending test %s, %d failed\n", ctx.failed ? "FAILED" : "passed", ctx.failed);
+   return ctx.failed ? 1 : 0;
+}
+
+#endif  /* TEST_PENDING_C */
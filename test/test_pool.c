@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_POOL_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnet_core.h"
+#include "mnet_pool.h"
+
+#define kMaxConns 4
+#define kIdleTimeoutMs 300
+#define kPrewarmCount 2
+#define kRequestCount 100       // sequential request with acquire/release
+#define kTestSeconds 10         // give up whole test after seconds
+
+typedef struct {
+   int phase;
+   int pending;                 // request without response
+   int failed;
+   int accepts;                 // server accepted count
+   int64_t wait_until;          // micro seconds to start next phase
+   chann_t *svr_channs[64];     // server side channs
+   chann_t *lent[kMaxConns];
+   int requests;
+   mnet_pool_t *pool;
+   chann_addr_t addr;
+} ctx_t;
+
+static ctx_t g_ctx;
+static char g_client_tag;       // opaque for client chann
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [ip:port]\n", argv[0]);
+}
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("phase %d: %s FAILED\n", ctx->phase, what);
+      ctx->failed += 1;
+   }
+}
+
+static void
+_pool_stats(ctx_t *ctx, mnet_pool_stats_t *st) {
+   mnet_pool_stats(ctx->pool, st);
+}
+
+/* acquire chann and send request, wait response in CHANN_EVENT_RECV */
+static chann_t*
+_request(ctx_t *ctx, int expect_reused) {
+   int reused = 0;
+   chann_t *n = mnet_pool_acquire(ctx->pool, CHANN_TYPE_STREAM, ctx->addr.ip, ctx->addr.port, &reused);
+   if (n == NULL) {
+      _expect(ctx, 0, "acquire");
+      return NULL;
+   }
+   if (expect_reused >= 0) {
+      _expect(ctx, reused == expect_reused, "reused flag");
+   }
+   mnet_chann_set_opaque(n, &g_client_tag);
+   ctx->pending += 1;
+   if (reused) {
+      mnet_chann_send(n, "ping", 4);
+   }
+   return n;
+}
+
+/* issue next phase when all response received, return 0 for finished */
+static int
+_next_phase(ctx_t *ctx) {
+   mnet_pool_stats_t st;
+   _pool_stats(ctx, &st);
+   if (ctx->pending > 0 || ctx->wait_until > mnet_tm_current()) {
+      return 1;
+   }
+   switch (ctx->phase) {
+      case 0:
+         _expect(ctx, mnet_pool_prewarm(ctx->pool, CHANN_TYPE_STREAM, ctx->addr.ip, ctx->addr.port, kPrewarmCount) == kPrewarmCount, "prewarm");
+         ctx->phase += 1;
+         break;
+      case 1:
+         if (st.idle < kPrewarmCount || ctx->accepts < kPrewarmCount) {
+            return 1;           // wait pre-warming connected
+         }
+         _request(ctx, 1);
+         ctx->phase += 1;
+         break;
+      case 2:
+         if (ctx->requests < kRequestCount) {
+            _request(ctx, 1);
+            break;
+         }
+         _expect(ctx, ctx->accepts == kPrewarmCount, "sequential reuse");
+         _expect(ctx, st.reused == kRequestCount, "reused count");
+         for (int i=0; i<kMaxConns; i++) {
+            ctx->lent[i] = _request(ctx, i < kPrewarmCount);
+         }
+         _expect(ctx, mnet_pool_acquire(ctx->pool, CHANN_TYPE_STREAM, ctx->addr.ip, ctx->addr.port, NULL) == NULL, "max conns");
+         ctx->phase += 1;
+         break;
+      case 3:
+         _expect(ctx, st.idle == kMaxConns && st.lent == 0, "release all");
+         _expect(ctx, ctx->accepts == kMaxConns, "concurrent accepts");
+         // server close all, idle channs should be dropped
+         for (int i=0; i<ctx->accepts; i++) {
+            mnet_chann_close(ctx->svr_channs[i]);
+         }
+         ctx->phase += 1;
+         break;
+      case 4:
+         if (st.idle > 0) {
+            return 1;
+         }
+         _expect(ctx, st.closed_broken == kMaxConns, "peer closed");
+         _request(ctx, 0);
+         ctx->phase += 1;
+         break;
+      case 5:
+         _expect(ctx, st.idle == 1, "keep idle");
+         ctx->wait_until = mnet_tm_current() + (kIdleTimeoutMs + 200) * 1000;
+         ctx->phase += 1;
+         break;
+      case 6:
+         _expect(ctx, st.idle == 0 && st.closed_idle == 1, "idle timeout");
+         ctx->phase += 1;
+         break;
+      default:
+         return 0;
+   }
+   return 1;
+}
+
+static void
+_on_client_msg(ctx_t *ctx, chann_msg_t *msg) {
+   if (msg->event == CHANN_EVENT_CONNECTED) {
+      mnet_chann_send(msg->n, "ping", 4);
+   } else if (msg->event == CHANN_EVENT_RECV) {
+      char buf[8];
+      int ret = mnet_chann_recv(msg->n, buf, sizeof(buf));
+      if (ret == 4) {
+         ctx->pending -= 1;
+         ctx->requests += 1;
+         mnet_pool_release(ctx->pool, msg->n, 1);
+      }
+   } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+      _expect(ctx, 0, "client disconnect");
+      ctx->pending -= 1;
+      mnet_pool_release(ctx->pool, msg->n, 0);
+   }
+}
+
+static void
+_on_server_msg(ctx_t *ctx, chann_msg_t *msg) {
+   if (msg->event == CHANN_EVENT_ACCEPT) {
+      if (ctx->accepts < 64) {
+         ctx->svr_channs[ctx->accepts++] = msg->r;
+      }
+   } else if (msg->event == CHANN_EVENT_RECV) {
+      char buf[8];
+      int ret = mnet_chann_recv(msg->n, buf, sizeof(buf));
+      if (ret > 0) {
+         mnet_chann_send(msg->n, buf, ret);
+      }
+   } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+      mnet_chann_close(msg->n);
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t *ctx = &g_ctx;
+   if (mnet_parse_ipport(argc > 1 ? argv[1] : "127.0.0.1:8092", &ctx->addr) <= 0) {
+      _print_help(argv);
+      return 0;
+   }
+
+   mnet_init();
+
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (!mnet_chann_listen(svr, ctx->addr.ip, ctx->addr.port, 16)) {
+      printf("fail to listen %s:%d\n", ctx->addr.ip, ctx->addr.port);
+      return 1;
+   }
+
+   mnet_pool_conf_t conf = {
+      .max_conns = kMaxConns,
+      .idle_timeout_ms = kIdleTimeoutMs,
+   };
+   ctx->pool = mnet_pool_create(&conf);
+
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (_next_phase(ctx)) {
+
+      if (mnet_tm_current() > deadline) {
+         printf("phase %d not finished in %d seconds\n", ctx->phase, kTestSeconds);
+         ctx->failed += 1;
+         break;
+      }
+
+      if (mnet_poll(10) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (mnet_pool_process(ctx->pool, msg)) {
+            continue;
+         }
+         if (msg->opaque == &g_client_tag) {
+            _on_client_msg(ctx, msg);
+         } else {
+            _on_server_msg(ctx, msg);
+         }
+      }
+   }
+
+   mnet_pool_stats_t st;
+   mnet_pool_stats(ctx->pool, &st);
+   mnet_pool_destroy(ctx->pool);
+   mnet_fini();
+
+   printf("pool test %s, reused %d, created %d, %d failed\n", ctx->failed ? "FAILED" : "passed",
+          (int)st.reused, (int)st.created, ctx->failed);
+   return ctx->failed ? 1 : 0;
+}
+
+#endif  /* TEST_POOL_C */
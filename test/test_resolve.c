@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_RESOLVE_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnet_core.h"
+#include "mdns_resolver.h"
+
+#define kPipelineCount 50       // pipelined queries in one phase
+#define kTimeoutMs 200          // resolver timeout for each try
+#define kAttempts 3
+#define kTestSeconds 10         // give up whole test after seconds
+
+typedef struct {
+   int phase;
+   int pending;                 // resolve callback not invoked
+   int failed;
+   int64_t wait_until;          // micro seconds to start next phase
+   int query_a;                 // stub queries count for each domain
+   int query_nx;
+   int query_drop;
+   int query_pipeline;
+   int query_bad;
+   chann_t *spoof;              // sender not the nameserver
+   char hosts_path[64];
+   char conf_path[64];
+} ctx_t;
+
+static ctx_t g_ctx;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [stub_dns_port]\n", argv[0]);
+}
+
+/* stub DNS server
+ */
+
+static int
+_stub_qname(const uint8_t *buf, int len, char *name, int size) {
+   int pos = 12, n = 0;
+   while (pos < len && buf[pos]) {
+      int llen = buf[pos++];
+      if (pos + llen > len || n + llen + 1 >= size) {
+         return 0;
+      }
+      if (n > 0) {
+         name[n++] = '.';
+      }
+      memcpy(&name[n], &buf[pos], llen);
+      n += llen;
+      pos += llen;
+   }
+   name[n] = 0;
+   return pos + 1 + 4;          // question size
+}
+
+/* answer with compressed name pointer to question */
+static int
+_stub_answer(uint8_t *buf, int qsize, int rcode, const uint8_t *ipv4, uint32_t ttl) {
+   buf[2] = 0x80 | (buf[2] & 0x01); // qr, keep rd
+   buf[3] = 0x80 | rcode;           // ra
+   buf[6] = 0; buf[7] = ipv4 ? 1 : 0;
+   buf[8] = buf[9] = buf[10] = buf[11] = 0;
+   if (ipv4 == NULL) {
+      return qsize;
+   }
+   uint8_t *p = &buf[qsize];
+   *p++ = 0xc0; *p++ = 0x0c;
+   *p++ = 0; *p++ = 1;          // A
+   *p++ = 0; *p++ = 1;          // IN
+   *p++ = ttl >> 24; *p++ = ttl >> 16; *p++ = ttl >> 8; *p++ = ttl;
+   *p++ = 0; *p++ = 4;
+   memcpy(p, ipv4, 4);
+   return qsize + 16;
+}
+
+static void
+_stub_process(chann_t *n, ctx_t *ctx) {
+   uint8_t buf[512];
+   chann_sockaddr_t from;
+   int len = 0;
+   while ((len = mnet_dgram_recvfrom(n, &from, buf, sizeof(buf))) > 0) {
+      char name[256];
+      int qsize = _stub_qname(buf, len, name, sizeof(name));
+      if (qsize <= 0 || qsize > len) {
+         continue;
+      }
+      int rlen = 0;
+      if (strcmp(name, "a.test") == 0) {
+         uint8_t ip[4] = { 10, 0, 0, 1 };
+         ctx->query_a += 1;
+         rlen = _stub_answer(buf, qsize, 0, ip, 1);
+      } else if (strcmp(name, "nx.test") == 0) {
+         ctx->query_nx += 1;
+         rlen = _stub_answer(buf, qsize, 3, NULL, 0);
+      } else if (strcmp(name, "drop.test") == 0) {
+         uint8_t ip[4] = { 10, 0, 0, 2 };
+         ctx->query_drop += 1;
+         if (ctx->query_drop <= 1) {
+            continue;           // lost first query, resolver should retry
+         }
+         rlen = _stub_answer(buf, qsize, 0, ip, 60);
+      } else if (strcmp(name, "bad.test") == 0) {
+         uint8_t ip[4] = { 10, 0, 0, 5 };
+         ctx->query_bad += 1;
+         rlen = _stub_answer(buf, qsize, 0, ip, 60);
+         if (ctx->query_bad <= 1) {
+            buf[3] = 0x80 | 9;  // malformed rcode, resolver should retry
+         }
+      } else if (strcmp(name, "spoof.test") == 0) {
+         uint8_t fake[4] = { 10, 0, 0, 66 };
+         uint8_t sbuf[512];
+         memcpy(sbuf, buf, qsize);
+         int slen = _stub_answer(sbuf, qsize, 0, fake, 60);
+         mnet_dgram_sendto(ctx->spoof, &from, sbuf, slen);
+         uint8_t ip[4] = { 10, 0, 0, 6 };
+         rlen = _stub_answer(buf, qsize, 0, ip, 60);
+      } else if (name[0] == 'p' && strstr(name, ".test")) {
+         uint8_t ip[4] = { 10, 1, 0, atoi(&name[1]) };
+         ctx->query_pipeline += 1;
+         rlen = _stub_answer(buf, qsize, 0, ip, 60);
+      } else {
+         continue;              // no response, resolver should timeout
+      }
+      mnet_dgram_sendto(n, &from, buf, rlen);
+   }
+}
+
+/* resolve callback
+ */
+
+static void
+_expect(ctx_t *ctx, int ok, const char *domain, const char *what) {
+   if (!ok) {
+      printf("phase %d %s: %s FAILED\n", ctx->phase, domain, what);
+      ctx->failed += 1;
+   }
+}
+
+static void
+_on_resolve(void *ud, const char *domain, const uint8_t *ipv4, int err) {
+   ctx_t *ctx = &g_ctx;
+   int expect = (int)(intptr_t)ud;  // last byte for ip, < 0 for error
+   ctx->pending -= 1;
+   if (expect < 0) {
+      _expect(ctx, err == expect && ipv4 == NULL, domain, "error");
+   } else {
+      _expect(ctx, err == MDNS_RESOLVE_OK && ipv4 && ipv4[3] == expect, domain, "address");
+   }
+}
+
+static int
+_resolve(ctx_t *ctx, const char *domain, int expect, int want_sync) {
+   ctx->pending += 1;
+   int ret = mdns_resolve(domain, _on_resolve, (void *)(intptr_t)expect);
+   _expect(ctx, ret == want_sync, domain, want_sync ? "sync" : "async");
+   return ret;
+}
+
+/* issue next phase when all callback invoked, return 0 for finished */
+static int
+_next_phase(ctx_t *ctx) {
+   if (ctx->pending > 0 || ctx->wait_until > mnet_tm_current()) {
+      return 1;
+   }
+   switch (ctx->phase++) {
+      case 0:
+         _resolve(ctx, "a.test", 1, 0);
+         _resolve(ctx, "A.Test.", 1, 0); // merged into same query
+         break;
+      case 1:
+         _expect(ctx, ctx->query_a == 1, "a.test", "merge query");
+         _resolve(ctx, "a.test", 1, 1);
+         _resolve(ctx, "nx.test", MDNS_RESOLVE_NXDOMAIN, 0);
+         break;
+      case 2:
+         _resolve(ctx, "nx.test", MDNS_RESOLVE_NXDOMAIN, 1);
+         _expect(ctx, ctx->query_nx == 1, "nx.test", "negative cache");
+         _resolve(ctx, "host.test", 9, 1);
+         _resolve(ctx, "1.2.3.4", 4, 1);
+         _resolve(ctx, "drop.test", 2, 0);
+         break;
+      case 3: {
+         _expect(ctx, ctx->query_drop == 2, "drop.test", "retry");
+         char domain[32];
+         for (int i=0; i<kPipelineCount; i++) {
+            sprintf(domain, "p%d.test", i);
+            _resolve(ctx, domain, i, 0);
+         }
+         ctx->wait_until = mnet_tm_current() + 1100 * 1000; // a.test expired
+         break;
+      }
+      case 4:
+         _expect(ctx, ctx->query_pipeline == kPipelineCount, "p.test", "pipeline");
+         _resolve(ctx, "a.test", 1, 0);
+         break;
+      case 5:
+         _expect(ctx, ctx->query_a == 2, "a.test", "ttl expire");
+         _resolve(ctx, "slow.test", MDNS_RESOLVE_TIMEOUT, 0);
+         break;
+      case 6:
+         _resolve(ctx, "bad.test", 5, 0);
+         _resolve(ctx, "spoof.test", 6, 0);
+         break;
+      case 7:
+         _expect(ctx, ctx->query_bad == 2, "bad.test", "malformed not cached");
+         break;
+      default:
+         return 0;
+   }
+   return 1;
+}
+
+static void
+_write_file(const char *path, const char *content) {
+   FILE *fp = fopen(path, "w");
+   if (fp) {
+      fputs(content, fp);
+      fclose(fp);
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   int port = argc > 1 ? atoi(argv[1]) : 8053;
+   if (port <= 0) {
+      _print_help(argv);
+      return 0;
+   }
+
+   ctx_t *ctx = &g_ctx;
+   sprintf(ctx->hosts_path, "/tmp/mnet_test_hosts_%d", port);
+   sprintf(ctx->conf_path, "/tmp/mnet_test_resolv_%d", port);
+   _write_file(ctx->hosts_path, "# test hosts\n192.168.1.9 host.test host-alias\n::1 host.test\n");
+   _write_file(ctx->conf_path, "nameserver 127.0.0.2\noptions timeout:5 attempts:1\n");
+
+   mnet_init();
+
+   chann_t *stub = mnet_chann_open(CHANN_TYPE_DGRAM);
+   if (!mnet_chann_listen(stub, "127.0.0.1", port, 1)) {
+      printf("fail to listen stub DNS port %d\n", port);
+      return 1;
+   }
+
+   ctx->spoof = mnet_chann_open(CHANN_TYPE_DGRAM);
+   mnet_chann_listen(ctx->spoof, "127.0.0.1", port + 1, 1);
+
+   char nameserver[32];
+   sprintf(nameserver, "127.0.0.1:%d", port);
+   mdns_resolver_conf_t conf = {
+      .resolv_conf = ctx->conf_path,
+      .hosts = ctx->hosts_path,
+      .nameserver = nameserver,
+      .timeout_ms = kTimeoutMs,
+      .attempts = kAttempts,
+   };
+   if (!mdns_resolver_init(&conf)) {
+      printf("fail to init resolver\n");
+      return 1;
+   }
+
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (_next_phase(ctx)) {
+
+      if (mnet_tm_current() > deadline) {
+         printf("phase %d not finished in %d seconds\n", ctx->phase, kTestSeconds);
+         ctx->failed += 1;
+         break;
+      }
+
+      if (mnet_poll(10) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->n == stub && msg->event == CHANN_EVENT_RECV) {
+            _stub_process(msg->n, ctx);
+         }
+      }
+   }
+
+   mdns_resolver_fini();
+   mnet_fini();
+
+   remove(ctx->hosts_path);
+   remove(ctx->conf_path);
+
+   printf("resolve test %s, %d phases, %d failed\n", ctx->failed ? "FAILED" : "passed",
+          ctx->phase, ctx->failed);
+   return ctx->failed ? 1 : 0;
+}
+
+#endif  /* TEST_RESOLVE_C */
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_TIMEOUT_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnet_core.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define kTimeoutMs 300
+#define kStuffCount 16          // connects to listen chann never accept
+#define kTestSeconds 10         // give up whole test after seconds
+
+typedef enum {
+   ROLE_IDLE = 1,               // keep silent, idle timeout
+   ROLE_ACTIVE,                 // send in interval, keep alive
+   ROLE_SLOW,                   // send 1 byte in interval, slowloris
+   ROLE_STUFF,                  // connect without accept
+} role_t;
+
+typedef struct {
+   role_t role;
+   int64_t begin;               // micro seconds
+   int sended;
+} cnt_t;
+
+typedef struct {
+   int phase;
+   int pending;                 // client wait for disconnect
+   int failed;
+   int connect_timeouts;
+   int svr_rate_closed;
+   chann_addr_t addr;
+} ctx_t;
+
+static ctx_t g_ctx;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [ip:port]\n", argv[0]);
+}
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("phase %d: %s FAILED\n", ctx->phase, what);
+      ctx->failed += 1;
+   }
+}
+
+static chann_t*
+_connect(ctx_t *ctx, role_t role, int port, int connect_ms, int idle_ms) {
+   chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+   cnt_t *c = (cnt_t *)calloc(1, sizeof(cnt_t));
+   c->role = role;
+   c->begin = mnet_tm_current();
+   mnet_chann_set_opaque(n, c);
+   mnet_chann_set_timeout(n, connect_ms, idle_ms);
+   mnet_chann_connect(n, ctx->addr.ip, port);
+   ctx->pending += 1;
+   return n;
+}
+
+/* issue next phase when all client finished, return 0 for finished */
+static int
+_next_phase(ctx_t *ctx) {
+   if (ctx->pending > 0) {
+      return 1;
+   }
+   switch (ctx->phase++) {
+      case 0:
+         _connect(ctx, ROLE_IDLE, ctx->addr.port, 0, kTimeoutMs);
+         _connect(ctx, ROLE_ACTIVE, ctx->addr.port, 0, kTimeoutMs);
+         break;
+      case 1:
+         _connect(ctx, ROLE_SLOW, ctx->addr.port, 0, 0);
+         break;
+      case 2:
+         for (int i=0; i<kStuffCount; i++) {
+            _connect(ctx, ROLE_STUFF, ctx->addr.port + 1, kTimeoutMs, 0);
+         }
+         break;
+      case 3:
+         _expect(ctx, ctx->connect_timeouts > 0, "connect timeout");
+         _expect(ctx, ctx->svr_rate_closed == 1, "recv rate");
+         break;
+      default:
+         return 0;
+   }
+   return 1;
+}
+
+static void
+_on_client_msg(ctx_t *ctx, chann_msg_t *msg) {
+   cnt_t *c = (cnt_t *)msg->opaque;
+   if (msg->event == CHANN_EVENT_CONNECTED) {
+      if (c->role == ROLE_ACTIVE || c->role == ROLE_SLOW) {
+         mnet_chann_active_event(msg->n, CHANN_EVENT_TIMER, c->role == ROLE_ACTIVE ? 100 : 20);
+      } else if (c->role == ROLE_STUFF) {
+         ctx->pending -= 1;      // in accept queue
+         free(c);
+         mnet_chann_close(msg->n);
+      }
+   } else if (msg->event == CHANN_EVENT_TIMER) {
+      char buf[128] = {0};
+      mnet_chann_send(msg->n, buf, c->role == ROLE_ACTIVE ? sizeof(buf) : 1);
+      c->sended += 1;
+      if (c->role == ROLE_ACTIVE && c->sended >= 10) {
+         ctx->pending -= 1;      // alive over 1 second
+         free(c);
+         mnet_chann_close(msg->n);
+      }
+   } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+      int ms = (int)((mnet_tm_current() - c->begin) / 1000);
+      switch (c->role) {
+         case ROLE_IDLE:
+            _expect(ctx, msg->err == MNET_ERR_IDLE_TIMEOUT, "idle timeout err");
+            _expect(ctx, ms >= kTimeoutMs && ms < kTimeoutMs + 300, "idle timeout duration");
+            break;
+         case ROLE_ACTIVE:
+            _expect(ctx, 0, "active disconnect");
+            break;
+         case ROLE_SLOW:
+            _expect(ctx, msg->err >= 0, "slow closed by server");
+            break;
+         case ROLE_STUFF:
+            _expect(ctx, msg->err == MNET_ERR_CONNECT_TIMEOUT, "connect timeout err");
+            _expect(ctx, ms >= kTimeoutMs && ms < kTimeoutMs + 300, "connect timeout duration");
+            ctx->connect_timeouts += 1;
+            break;
+      }
+      ctx->pending -= 1;
+      free(c);
+      mnet_chann_close(msg->n);
+   }
+}
+
+static void
+_on_server_msg(ctx_t *ctx, chann_msg_t *msg) {
+   if (msg->event == CHANN_EVENT_RECV) {
+      char buf[64];
+      mnet_chann_recv(msg->n, buf, sizeof(buf));
+   } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+      if (msg->err == MNET_ERR_RECV_RATE) {
+         ctx->svr_rate_closed += 1;
+      }
+      mnet_chann_close(msg->n);
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t *ctx = &g_ctx;
+   if (mnet_parse_ipport(argc > 1 ? argv[1] : "127.0.0.1:8094", &ctx->addr) <= 0) {
+      _print_help(argv);
+      return 0;
+   }
+
+   mnet_init();
+
+   // accepted chann inherit idle timeout and recv rate guard
+   chann_t *svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   mnet_chann_set_timeout(svr, 0, 3 * kTimeoutMs);
+   mnet_chann_set_recv_rate(svr, 64, kTimeoutMs);
+   if (!mnet_chann_listen(svr, ctx->addr.ip, ctx->addr.port, 16)) {
+      printf("fail to listen %s:%d\n", ctx->addr.ip, ctx->addr.port);
+      return 1;
+   }
+
+   // raw socket never accept, then SYN dropped when accept queue full
+   struct sockaddr_in sin;
+   memset(&sin, 0, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons(ctx->addr.port + 1);
+   sin.sin_addr.s_addr = inet_addr(ctx->addr.ip);
+   int stuff = socket(AF_INET, SOCK_STREAM, 0);
+   if (bind(stuff, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(stuff, 1) < 0) {
+      printf("fail to listen %s:%d\n", ctx->addr.ip, ctx->addr.port + 1);
+      return 1;
+   }
+
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (_next_phase(ctx)) {
+
+      if (mnet_tm_current() > deadline) {
+         printf("phase %d not finished in %d seconds\n", ctx->phase, kTestSeconds);
+         ctx->failed += 1;
+         break;
+      }
+
+      if (mnet_poll(MNET_MILLI_SECOND) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         if (msg->opaque) {
+            _on_client_msg(ctx, msg);
+         } else {
+            _on_server_msg(ctx, msg);
+         }
+      }
+   }
+
+   // timeouts counted in stats disconnect errs
+   mnet_stats_t st;
+   char json[2048];
+   mnet_poll(0);
+   mnet_stats_snapshot(&st);
+   int timeouts = 0;
+   for (int i=0; i<MNET_STATS_ERR_SLOTS; i++) {
+      if (st.disconnect_errs[i].err == MNET_ERR_CONNECT_TIMEOUT) {
+         timeouts = (int)st.disconnect_errs[i].count;
+      }
+   }
+   _expect(ctx, timeouts == ctx->connect_timeouts, "stats connect timeout");
+   _expect(ctx, st.send_cache_bytes == 0 && st.send_cache_chunks == 0, "stats send cache");
+   _expect(ctx, mnet_stats_export(&st, MNET_STATS_JSON, json, sizeof(json)) > 0, "stats export");
+   printf("%s\n", json);
+
+   mnet_fini();
+   close(stuff);
+
+   printf("timeout test %s, %d connect timeout, %d failed\n", ctx->failed ? "FAILED" : "passed",
+          ctx->connect_timeouts, ctx->failed);
+   return ctx->failed ? 1 : 0;
+}
+
+#endif  /* TEST_TIMEOUT_C */
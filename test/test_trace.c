@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2023 lalawue
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef TEST_TRACE_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "mnet_core.h"
+
+#define kRingRecords 1000       // rounded up to 1024
+#define kSmallRecords 5         // rounded up to 8, for overwritten
+#define kTestSeconds 5
+
+typedef struct {
+   int failed;
+   int done;
+   int dump_fd;
+   int dumped;                  // records dumped in signal handler
+   chann_t *svr;
+   chann_t *cnt;
+   uint64_t accepted_id;
+   chann_addr_t addr;
+   char path[64];
+} ctx_t;
+
+static ctx_t g_ctx;
+
+static void
+_print_help(char *argv[]) {
+   printf("%s: [ip:port]\n", argv[0]);
+}
+
+static void
+_expect(ctx_t *ctx, int ok, const char *what) {
+   if (!ok) {
+      printf("%s FAILED\n", what);
+      ctx->failed += 1;
+   }
+}
+
+static void
+_on_signal(int sig) {
+   g_ctx.dumped = mnet_trace_dump(g_ctx.dump_fd);
+}
+
+/* dump by signal, then read back records */
+static int
+_dump_records(ctx_t *ctx, mnet_trace_hdr_t *hdr, mnet_trace_rec_t *recs, int max) {
+   ctx->dump_fd = open(ctx->path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+   ctx->dumped = 0;
+   raise(SIGUSR1);
+   close(ctx->dump_fd);
+
+   int count = 0;
+   FILE *fp = fopen(ctx->path, "rb");
+   if (fp && fread(hdr, sizeof(*hdr), 1, fp) == 1) {
+      while (count < max && fread(&recs[count], sizeof(mnet_trace_rec_t), 1, fp) == 1) {
+         count++;
+      }
+   }
+   if (fp) {
+      fclose(fp);
+   }
+   return count;
+}
+
+static int
+_find(mnet_trace_rec_t *recs, int count, uint64_t id, int op, int event, int bytes) {
+   for (int i=0; i<count; i++) {
+      if (recs[i].chann_id == id && recs[i].op == op &&
+          (event < 0 || recs[i].event == event) &&
+          (bytes < 0 || recs[i].bytes == bytes))
+      {
+         return i;
+      }
+   }
+   return -1;
+}
+
+static void
+_on_msg(ctx_t *ctx, chann_msg_t *msg) {
+   char buf[16];
+   if (msg->n == ctx->svr && msg->event == CHANN_EVENT_ACCEPT) {
+      ctx->accepted_id = mnet_chann_id(msg->r);
+   } else if (msg->n == ctx->cnt) {
+      if (msg->event == CHANN_EVENT_CONNECTED) {
+         mnet_chann_send(msg->n, "hello", 5);
+      } else if (msg->event == CHANN_EVENT_RECV) {
+         mnet_chann_recv(msg->n, buf, sizeof(buf));
+         mnet_chann_close(msg->n);
+         ctx->done = 1;
+      }
+   } else if (msg->event == CHANN_EVENT_RECV) {
+      int ret = mnet_chann_recv(msg->n, buf, sizeof(buf));
+      if (ret > 0) {
+         mnet_chann_send(msg->n, buf, ret);
+      }
+   } else if (msg->event == CHANN_EVENT_DISCONNECT) {
+      mnet_chann_close(msg->n);
+   }
+}
+
+int
+main(int argc, char *argv[]) {
+   ctx_t *ctx = &g_ctx;
+   if (mnet_parse_ipport(argc > 1 ? argv[1] : "127.0.0.1:8096", &ctx->addr) <= 0) {
+      _print_help(argv);
+      return 0;
+   }
+   sprintf(ctx->path, "/tmp/mnet_test_trace_%d", ctx->addr.port);
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = _on_signal;
+   sigaction(SIGUSR1, &sa, NULL);
+
+   mnet_init();
+   _expect(ctx, mnet_trace_enable(kRingRecords) == 1024, "enable capacity");
+
+   ctx->svr = mnet_chann_open(CHANN_TYPE_STREAM);
+   if (!mnet_chann_listen(ctx->svr, ctx->addr.ip, ctx->addr.port, 16)) {
+      printf("fail to listen %s:%d\n", ctx->addr.ip, ctx->addr.port);
+      return 1;
+   }
+   ctx->cnt = mnet_chann_open(CHANN_TYPE_STREAM);
+   mnet_chann_connect(ctx->cnt, ctx->addr.ip, ctx->addr.port);
+   uint64_t cnt_id = mnet_chann_id(ctx->cnt);
+   _expect(ctx, cnt_id > mnet_chann_id(ctx->svr), "chann id");
+
+   int64_t deadline = mnet_tm_current() + kTestSeconds * 1000 * 1000;
+   while (!ctx->done && mnet_tm_current() < deadline) {
+      if (mnet_poll(10) < 0) {
+         printf("poll error !\n");
+         break;
+      }
+      chann_msg_t *msg = NULL;
+      while ((msg = mnet_result_next())) {
+         _on_msg(ctx, msg);
+      }
+   }
+   _expect(ctx, ctx->done, "echo finished");
+
+   // records for client and accepted chann in order
+   mnet_trace_hdr_t hdr;
+   mnet_trace_rec_t recs[kRingRecords];
+   int count = _dump_records(ctx, &hdr, recs, kRingRecords);
+   _expect(ctx, ctx->dumped > 0 && ctx->dumped == count, "dump in signal handler");
+   _expect(ctx, hdr.magic == MNET_TRACE_MAGIC && hdr.rec_size == sizeof(mnet_trace_rec_t), "header");
+   _expect(ctx, hdr.count == (uint32_t)count && hdr.total == (uint64_t)count, "header count");
+   for (int i=1; i<count; i++) {
+      _expect(ctx, recs[i].ts >= recs[i-1].ts, "timestamp order");
+   }
+   int connect = _find(recs, count, cnt_id, MNET_TRACE_CONNECT, -1, -1);
+   int connected = _find(recs, count, cnt_id, MNET_TRACE_EVENT, CHANN_EVENT_CONNECTED, -1);
+   int send = _find(recs, count, cnt_id, MNET_TRACE_SEND, -1, 5);
+   int recv = _find(recs, count, cnt_id, MNET_TRACE_RECV, -1, 5);
+   int closed = _find(recs, count, cnt_id, MNET_TRACE_CLOSE, -1, -1);
+   _expect(ctx, connect >= 0 && connect < connected && connected < send && send < recv && recv < closed,
+           "client records");
+   int accept = _find(recs, count, ctx->accepted_id, MNET_TRACE_ACCEPT, -1, -1);
+   int svr_recv = _find(recs, count, ctx->accepted_id, MNET_TRACE_RECV, -1, 5);
+   _expect(ctx, accept >= 0 && accept < svr_recv && recs[accept].fd > 0, "accepted records");
+
+   // oldest overwritten in small ring, connect and close for each chann
+   _expect(ctx, mnet_trace_enable(kSmallRecords) == 8, "small capacity");
+   uint64_t last_id = 0;
+   for (int i=0; i<3; i++) {
+      chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+      mnet_chann_connect(n, ctx->addr.ip, ctx->addr.port);
+      mnet_chann_close(n);
+   }
+   count = _dump_records(ctx, &hdr, recs, kRingRecords);
+   _expect(ctx, count == 6 && hdr.total == 6, "records before wrap");
+   for (int i=0; i<3; i++) {
+      chann_t *n = mnet_chann_open(CHANN_TYPE_STREAM);
+      mnet_chann_connect(n, ctx->addr.ip, ctx->addr.port);
+      mnet_chann_close(n);
+      last_id = mnet_chann_id(n);
+   }
+   count = _dump_records(ctx, &hdr, recs, kRingRecords);
+   _expect(ctx, count == 8 && hdr.total == 12, "overwritten");
+   _expect(ctx, recs[0].op == MNET_TRACE_CONNECT && recs[0].chann_id == last_id - 3, "oldest first");
+   _expect(ctx, recs[7].op == MNET_TRACE_CLOSE && recs[7].chann_id == last_id, "newest last");
+
+   _expect(ctx, mnet_trace_enable(0) == 0, "disable");
+   _expect(ctx, mnet_trace_dump(1) == -1, "dump disabled");
+
+   mnet_fini();
+   remove(ctx->path);
+
+   printf("trace test %s, %d failed\n", ctx->failed ? "FAILED" : "passed", ctx->failed);
+   return ctx->failed ? 1 : 0;
+}
+
+#endif  /* TEST_TRACE_C */